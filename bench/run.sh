@@ -0,0 +1,25 @@
+#!/bin/sh
+# Run every bench workload against a copy of a CP/M disk.
+# usage: bench/run.sh <altair-bench> <cpm.dsk> [results.json]
+
+BENCH=$1
+DISK=$2
+RESULTS=${3:-bench_results.json}
+DIR=$(dirname "$0")
+
+if [ -z "$BENCH" ] || [ -z "$DISK" ]; then
+	echo "usage: $0 <altair-bench> <cpm.dsk> [results.json]"
+	exit 1
+fi
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+STATUS=0
+for SCRIPT in "$DIR"/*.txt; do
+	NAME=$(basename "$SCRIPT" .txt)
+	cp "$DISK" "$TMP/bench.dsk"
+	"$BENCH" -oFF00 "$DIR/../roms/88dskrom.bin" -dA:"$TMP/bench.dsk" -i"$SCRIPT" -n"$NAME" -j"$RESULTS" > /dev/null || STATUS=1
+done
+cat "$RESULTS"
+exit $STATUS
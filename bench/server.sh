@@ -0,0 +1,46 @@
+#!/bin/sh
+# Check that a fork server job streams its output while it runs.
+# A job prints a directory listing, then waits for text that never comes until its time limit;
+# the listing must reach the client before the job ends.
+# usage: bench/server.sh <altair-server> <altair-job> <cpm.dsk>
+
+SERVER=$1
+JOB=$2
+DISK=$3
+DIR=$(dirname "$0")
+
+if [ -z "$SERVER" ] || [ -z "$JOB" ] || [ -z "$DISK" ]; then
+	echo "usage: $0 <altair-server> <altair-job> <cpm.dsk>"
+	exit 1
+fi
+
+TMP=$(mktemp -d)
+SERVER_PID=
+trap '[ -n "$SERVER_PID" ] && kill $SERVER_PID 2>/dev/null; rm -rf "$TMP"' EXIT
+
+cp "$DISK" "$TMP/server.dsk"
+"$SERVER" -u"$TMP/altair.sock" -oFF00 "$DIR/../roms/88dskrom.bin" -dA:"$TMP/server.dsk" -i"$DIR/boot.txt" > "$TMP/server.log" 2>&1 &
+SERVER_PID=$!
+for i in 1 2 3 4 5 6 7 8 9 10; do
+	[ -S "$TMP/altair.sock" ] && break
+	sleep 1
+done
+
+printf 'send DIR\\r\nwait NEVER PRINTED\n' > "$TMP/job.txt"
+"$JOB" -u"$TMP/altair.sock" -i"$TMP/job.txt" -l4 > "$TMP/out.txt" 2> "$TMP/status.txt" &
+JOB_PID=$!
+sleep 2
+if ! kill -0 $JOB_PID 2>/dev/null; then
+	echo "FAIL: the job ended before its time limit"
+	exit 1
+fi
+if [ ! -s "$TMP/out.txt" ]; then
+	echo "FAIL: no output while the job was running"
+	exit 1
+fi
+wait $JOB_PID
+if ! grep -q '"status":"timeout"' "$TMP/status.txt"; then
+	echo "FAIL: unexpected status: $(cat "$TMP/status.txt")"
+	exit 1
+fi
+echo "OK: output streamed before the status frame"
@@ -5,10 +5,21 @@
 
 #include <stdint.h>
 #include <stdio.h>
-#include <malloc.h>
+#include <stdlib.h>
 #include <string.h>
 
+#ifndef _WIN32
+#include <unistd.h>
+#else
+/* <io.h> would resolve to the emulator's io.h */
+int __cdecl _commit(int fd);
+#endif
+
 #include "88_dcdd.h"
+#include "dcdd_hostdir.h"
+#include "dcdd_overlay.h"
+#include "io.h"
+#include "file.h"
 
  /* SECTOR BYTE
  
@@ -22,6 +33,12 @@
 		T - ACTIVE_LOW  - sector true; the sector is positioned to read or write.
 
 		If head is unloaded, hardware returns 0xFF.
+
+		By default the next sector comes under the head every time the sector port is read, so a guest
+		never waits for one. With rotation timing (dcdd->rotate) the disk turns at 360 RPM on the machine
+		clock: sector true is asserted for the first DCDD_TRUE_CYCLES of every DCDD_SECTOR_CYCLES, and a
+		sector pulse event raises the interrupt at the start of each sector while it is enabled and
+		the head is loaded. Reading the sector port acknowledges the interrupt.
  */
 
  /* STATUS BYTE
@@ -41,18 +58,6 @@
 		W - ACTIVE_LOW  - write device is ready
  */
 
-#define DCDD_TRACKS_PER_DISK       77   // Number of tracks per disk
-#define DCDD_SECTORS_PER_TRACK     32   // Number of sectors per track
-#define DCDD_BYTES_PER_SECTOR      137  // Number of bytes per sector
-
-#define DCDD_STATUS_WRITE_READY    0x01 // ACTIVE_LOW - write device is ready
-#define DCDD_STATUS_MOVE_HEAD      0x02 // ACTIVE_LOW - head can be moved
-#define DCDD_STATUS_HEAD_LOADED    0x04 // ACTIVE_LOW - head is loaded for r/w
-#define DCDD_STATUS_DRV_SELECT     0x08 // ACTIVE_LOW - disk is selected and active
-#define DCDD_STATUS_INT_ENABLED    0x20 // ACTIVE_LOW - interrupts are enabled
-#define DCDD_STATUS_TRACK_ZERO     0x40 // ACTIVE_LOW - head is on track 0
-#define DCDD_STATUS_READ_READY     0x80 // ACTIVE_LOW - read device is ready
-
 #define DCDD_CMD_STEP_IN           0x01 // step in head command
 #define DCDD_CMD_STEP_OUT          0x02 // step out head command
 #define DCDD_CMD_LOAD_HEAD         0x04 // load head command
@@ -62,25 +67,25 @@
 #define DCDD_CMD_REDUCE_HEAD       0x40 // reduce head voltage command
 #define DCDD_CMD_WRITE_ENABLE      0x80 // write enable command
 
-#define PORT_DCDD_STATUS           0x08 // status port (in)
-#define PORT_DCDD_SELECTOR         0x08 // selector port (out)
-#define PORT_DCDD_SECTOR           0x09 // sector port (in)
-#define PORT_DCDD_COMMAND          0x09 // command port (out)
-#define PORT_DCDD_DATA             0x0A // data port (in/out)
-
-#define DCDD_SELECTOR_DRV_SELECT   0x80 // ACTIVE_HIGH - disk controller - no disk selected
-#define DCDD_SECTOR_TRUE           0x01 // ACTIVE_LOW  - the sector is positioned to r/w
-
 #define track_pos(disk)  (DCDD_SECTORS_PER_TRACK * DCDD_BYTES_PER_SECTOR * disk.track)
 #define sector_pos(disk) (DCDD_BYTES_PER_SECTOR * disk.sector)
 #define head_pos(disk)   (track_pos(disk) + sector_pos(disk) + disk.index)
 
-static uint8_t dcdd_status(DCDD* dcdd);
-static uint8_t dcdd_sector(DCDD* dcdd);
-static uint8_t dcdd_read(DCDD* dcdd);
-static void dcdd_write(DCDD* dcdd, uint8_t value);
-static void dcdd_selector(DCDD* dcdd, uint8_t value);
-static void dcdd_command(DCDD* dcdd, uint8_t value);
+ /* JOURNAL
+	Dirty sectors are written to <filename>.jnl before they are written to the image.
+	If the emulator dies mid-flush, the journal is replayed the next time the image is loaded,
+	so the image never holds a partially written sector.
+
+		+--------+--------+-----------------+-----+--------+--------+
+		| SECTOR | SECTOR | DATA (137)      | ... | 0xFFFF | COUNT  |
+		|  LO    |  HI    |                 |     | (2)    | (2)    |
+		+--------+--------+-----------------+-----+--------+--------+
+
+	A journal without the 0xFFFF trailer, or with a count that does not match, is incomplete and is discarded.
+ */
+
+#define DCDD_JOURNAL_EXT           ".jnl"
+#define DCDD_JOURNAL_END           0xFFFF
 
 int dcdd_init(DCDD* dcdd) {
 	dcdd->disks = (DISK*)malloc(sizeof(DISK) * DCDD_MAX_DISKS);
@@ -88,20 +93,278 @@ int dcdd_init(DCDD* dcdd) {
 		return 1;
 	}
 	memset(dcdd->disks, 0, sizeof(DISK) * DCDD_MAX_DISKS);
+	dcdd->flush_timer = 0;
 	return 0;
 }
 void dcdd_free(DCDD* dcdd) {
 	if (dcdd->disks != NULL) {
 		for (int i = 0; i < DCDD_MAX_DISKS; ++i) {
-			if (dcdd->disks[i].file != NULL) {
-				fclose(dcdd->disks[i].file);
-				dcdd->disks[i].file = NULL;
-			}
+			dcdd_unload_disk(dcdd, i);
 		}
 		free(dcdd->disks);
 		dcdd->disks = NULL;
 	}
 }
+void dcdd_update(DCDD* dcdd) {
+	dcdd->flush_timer++;
+	if (dcdd->flush_timer >= DCDD_FLUSH_RATE) {
+		dcdd->flush_timer = 0;
+		for (int i = 0; i < DCDD_MAX_DISKS; ++i) {
+			dcdd_flush_disk(dcdd, i);
+		}
+	}
+}
+
+static char* journal_name(const char* filename) {
+	size_t len = strlen(filename);
+	char* name = (char*)malloc(len + sizeof(DCDD_JOURNAL_EXT));
+	if (name == NULL) {
+		return NULL;
+	}
+	memcpy(name, filename, len);
+	memcpy(name + len, DCDD_JOURNAL_EXT, sizeof(DCDD_JOURNAL_EXT));
+	return name;
+}
+static int replay_journal(DISK* disk) {
+	char* name = journal_name(disk->filename);
+	if (name == NULL) {
+		return 1;
+	}
+
+	FILE* journal = NULL;
+	fopen_s(&journal, name, "rb");
+	if (journal == NULL) {
+		/* no journal; last flush completed */
+		free(name);
+		return 0;
+	}
+
+	/* validate the journal before touching the image */
+	uint8_t data[DCDD_BYTES_PER_SECTOR];
+	uint8_t header[2];
+	uint16_t count = 0;
+	int complete = 0;
+	while (fread(header, 1, 2, journal) == 2) {
+		uint16_t sector = header[0] | (header[1] << 8);
+		if (sector == DCDD_JOURNAL_END) {
+			complete = fread(header, 1, 2, journal) == 2 && (header[0] | (header[1] << 8)) == count;
+			break;
+		}
+		if (sector >= DCDD_TRACKS_PER_DISK * DCDD_SECTORS_PER_TRACK || fread(data, 1, DCDD_BYTES_PER_SECTOR, journal) != DCDD_BYTES_PER_SECTOR) {
+			break;
+		}
+		count++;
+	}
+
+	if (complete) {
+		fseek(journal, 0, SEEK_SET);
+		for (uint16_t i = 0; i < count; ++i) {
+			fread(header, 1, 2, journal);
+			fread(data, 1, DCDD_BYTES_PER_SECTOR, journal);
+			fseek(disk->file, (header[0] | (header[1] << 8)) * DCDD_BYTES_PER_SECTOR, SEEK_SET);
+			fwrite(data, 1, DCDD_BYTES_PER_SECTOR, disk->file);
+		}
+		fflush(disk->file);
+		printf("%s\t-> replayed %u sectors\n", name, count);
+	}
+
+	fclose(journal);
+	remove(name);
+	free(name);
+	return 0;
+}
+
+int dcdd_load_disk(DCDD* dcdd, uint8_t disk, const char* filename) {
+	DISK* d = &dcdd->disks[disk];
+	dcdd_unload_disk(dcdd, disk);
+
+	if (dcdd_is_directory(filename)) {
+		return dcdd_load_hostdir(dcdd, disk, filename);
+	}
+	if (strchr(filename, ',') != NULL) {
+		/* <base>,<delta> */
+		return dcdd_load_overlay(dcdd, disk, filename);
+	}
+
+	fopen_s(&d->file, filename, "r+b");
+	if (d->file == NULL) {
+		printf("Failed to open disk file: %s\n", filename);
+		return 1;
+	}
+
+	size_t len = strlen(filename) + 1;
+	d->filename = (char*)malloc(len);
+	d->buffer = (uint8_t*)malloc(DCDD_DISK_SIZE);
+	if (d->filename == NULL || d->buffer == NULL) {
+		printf("Failed to allocate disk buffer: %s\n", filename);
+		dcdd_unload_disk(dcdd, disk);
+		return 1;
+	}
+	memcpy(d->filename, filename, len);
+
+	replay_journal(d);
+
+	memset(d->buffer, 0, DCDD_DISK_SIZE);
+	fseek(d->file, 0, SEEK_SET);
+	fread(d->buffer, 1, DCDD_DISK_SIZE, d->file);
+	memset(d->dirty, 0, sizeof(d->dirty));
+	d->dirty_count = 0;
+	return 0;
+}
+void dcdd_unload_disk(DCDD* dcdd, uint8_t disk) {
+	DISK* d = &dcdd->disks[disk];
+	dcdd_flush_disk(dcdd, disk);
+
+	if (dcdd->selector == disk) {
+		dcdd->selector = DCDD_SELECTOR_DRV_SELECT;
+	}
+	if (d->file != NULL) {
+		fclose(d->file);
+		d->file = NULL;
+	}
+	if (d->base != NULL) {
+		dcdd_unload_overlay(dcdd, disk);
+	}
+	if (d->host != NULL) {
+		dcdd_unload_hostdir(dcdd, disk);
+	}
+	if (d->buffer != NULL) {
+		free(d->buffer);
+		d->buffer = NULL;
+	}
+	if (d->filename != NULL) {
+		free(d->filename);
+		d->filename = NULL;
+	}
+	memset(d->dirty, 0, sizeof(d->dirty));
+	d->dirty_count = 0;
+}
+int dcdd_flush_disk(DCDD* dcdd, uint8_t disk) {
+	DISK* d = &dcdd->disks[disk];
+	if (d->dirty_count == 0 || d->file == NULL) {
+		return 0;
+	}
+	if (d->base != NULL) {
+		return dcdd_flush_overlay(dcdd, disk);
+	}
+	if (dcdd_write_image(d->filename, d->file, d->buffer, d->dirty) != 0) {
+		return 1;
+	}
+	memset(d->dirty, 0, sizeof(d->dirty));
+	d->dirty_count = 0;
+	return 0;
+}
+static int sync_file(FILE* file) {
+	/* flush <file> and force it to the device */
+	if (fflush(file) != 0) {
+		return 1;
+	}
+#ifdef _WIN32
+	return _commit(_fileno(file)) != 0;
+#else
+	return fsync(fileno(file)) != 0;
+#endif
+}
+int dcdd_write_image(const char* filename, FILE* file, const uint8_t* buffer, const uint32_t* sectors) {
+	/* write the sectors set in the <sectors> bitmap to <file>, through the journal */
+	char* name = journal_name(filename);
+	if (name == NULL) {
+		return 1;
+	}
+
+	/* write the journal */
+	FILE* journal = NULL;
+	fopen_s(&journal, name, "wb");
+	if (journal == NULL) {
+		printf("Failed to open disk journal: %s\n", name);
+		free(name);
+		return 1;
+	}
+
+	int failed = 0;
+	uint8_t header[2];
+	uint16_t count = 0;
+	for (uint16_t i = 0; i < DCDD_TRACKS_PER_DISK * DCDD_SECTORS_PER_TRACK; ++i) {
+		if (sectors[i >> 5] & (1u << (i & 31))) {
+			header[0] = i & 0xFF;
+			header[1] = i >> 8;
+			failed |= fwrite(header, 1, 2, journal) != 2;
+			failed |= fwrite(buffer + i * DCDD_BYTES_PER_SECTOR, 1, DCDD_BYTES_PER_SECTOR, journal) != DCDD_BYTES_PER_SECTOR;
+			count++;
+		}
+	}
+	header[0] = DCDD_JOURNAL_END & 0xFF;
+	header[1] = DCDD_JOURNAL_END >> 8;
+	failed |= fwrite(header, 1, 2, journal) != 2;
+	header[0] = count & 0xFF;
+	header[1] = count >> 8;
+	failed |= fwrite(header, 1, 2, journal) != 2;
+	/* the journal must be on the device before the image is touched */
+	if (failed || sync_file(journal) != 0) {
+		printf("Failed to write disk journal: %s\n", name);
+		fclose(journal);
+		remove(name);
+		free(name);
+		return 1;
+	}
+	fclose(journal);
+
+	/* write the sectors to the image */
+	for (uint16_t i = 0; i < DCDD_TRACKS_PER_DISK * DCDD_SECTORS_PER_TRACK; ++i) {
+		if (sectors[i >> 5] & (1u << (i & 31))) {
+			failed |= fseek(file, i * DCDD_BYTES_PER_SECTOR, SEEK_SET) != 0;
+			failed |= fwrite(buffer + i * DCDD_BYTES_PER_SECTOR, 1, DCDD_BYTES_PER_SECTOR, file) != DCDD_BYTES_PER_SECTOR;
+		}
+	}
+	/* and the image before the journal is dropped */
+	if (failed || sync_file(file) != 0) {
+		/* keep the journal; it is replayed on next load */
+		printf("Failed to write disk file: %s\n", filename);
+		free(name);
+		return 1;
+	}
+
+	remove(name);
+	free(name);
+	return 0;
+}
+void dcdd_detach_disk(DCDD* dcdd, uint8_t disk) {
+	/* keep the cached image but drop the file; later writes stay in memory */
+	DISK* d = &dcdd->disks[disk];
+	if (d->file != NULL) {
+		fclose(d->file);
+		d->file = NULL;
+	}
+	if (d->host != NULL) {
+		dcdd_detach_hostdir(dcdd, disk);
+	}
+}
+int dcdd_export_disk(DCDD* dcdd, uint8_t disk, const char* filename) {
+	DISK* d = &dcdd->disks[disk];
+	if (d->buffer == NULL) {
+		printf("Error: no disk in %c:\n", 'A' + disk);
+		return 1;
+	}
+	if (dcdd_is_directory(filename)) {
+		/* unpack the CP/M files instead */
+		return dcdd_export_files(dcdd, disk, filename);
+	}
+	dcdd_fill_hostdir(d);
+
+	FILE* file = NULL;
+	fopen_s(&file, filename, "wb");
+	if (file == NULL) {
+		printf("Failed to open disk file: %s\n", filename);
+		return 1;
+	}
+	if (fwrite(d->buffer, 1, DCDD_DISK_SIZE, file) != DCDD_DISK_SIZE || fflush(file) != 0) {
+		printf("Failed to write disk file: %s\n", filename);
+		fclose(file);
+		return 1;
+	}
+	fclose(file);
+	return 0;
+}
 void dcdd_reset(DCDD* dcdd) {
 	dcdd->selector = DCDD_SELECTOR_DRV_SELECT;
 	for (int i = 0; i < DCDD_MAX_DISKS; ++i) {
@@ -117,55 +380,72 @@ void dcdd_reset(DCDD* dcdd) {
 			DCDD_STATUS_TRACK_ZERO  |
 			DCDD_STATUS_READ_READY;
 	}
-}
-int dcdd_read_io(DCDD* dcdd, uint8_t port, uint8_t* value) {
-	switch (port) {		
-
-		case PORT_DCDD_STATUS:
-			*value = dcdd_status(dcdd);
-			break;
-
-		case PORT_DCDD_SECTOR:
-			*value = dcdd_sector(dcdd);
-			break;
-
-		case PORT_DCDD_DATA:
-			*value = dcdd_read(dcdd);
-			break;
-
-		default:
-			return 0;
+	if (dcdd->sched != NULL) {
+		sched_irq(dcdd->sched, dcdd->irq_source, 0);
 	}
-	return 1;
 }
-int dcdd_write_io(DCDD* dcdd, uint8_t port, uint8_t value) {
-	switch (port) {
-
-		case PORT_DCDD_COMMAND:
-			dcdd_command(dcdd, value);
-			break;
-
-		case PORT_DCDD_SELECTOR:
-			dcdd_selector(dcdd, value);
-			break;
-
-		case PORT_DCDD_DATA:
-			dcdd_write(dcdd, value);
-			break;
+static uint8_t in_status(void* context, uint8_t port) {
+	return dcdd_status((DCDD*)context);
+}
+static uint8_t in_sector(void* context, uint8_t port) {
+	return dcdd_sector((DCDD*)context);
+}
+static uint8_t in_data(void* context, uint8_t port) {
+	return dcdd_read((DCDD*)context);
+}
+static void out_selector(void* context, uint8_t port, uint8_t value) {
+	dcdd_selector((DCDD*)context, value);
+}
+static void out_command(void* context, uint8_t port, uint8_t value) {
+	dcdd_command((DCDD*)context, value);
+}
+static void out_data(void* context, uint8_t port, uint8_t value) {
+	dcdd_write((DCDD*)context, value);
+}
 
-		default:
-			return 0;
-	}
-	return 1;
+int dcdd_register_io(DCDD* dcdd, IO* io) {
+	int status = 0;
+	status |= io_register_read(io, PORT_DCDD_STATUS, in_status, dcdd, 1);
+	status |= io_register_read(io, PORT_DCDD_SECTOR, in_sector, dcdd, (uint8_t)dcdd->rotate); // a wait on a timed sector can idle
+	status |= io_register_read(io, PORT_DCDD_DATA, in_data, dcdd, 0);
+	status |= io_register_write(io, PORT_DCDD_SELECTOR, out_selector, dcdd);
+	status |= io_register_write(io, PORT_DCDD_COMMAND, out_command, dcdd);
+	status |= io_register_write(io, PORT_DCDD_DATA, out_data, dcdd);
+	return status;
 }
 
-static uint8_t dcdd_status(DCDD* dcdd) {
+uint8_t dcdd_status(DCDD* dcdd) {
 	if (dcdd->selector & DCDD_SELECTOR_DRV_SELECT) {
 		return 0xFF;
 	}
 	return dcdd->disks[dcdd->selector].status;
 }
-static uint8_t dcdd_sector(DCDD* dcdd) {
+static void sector_pulse(void* context) {
+	DCDD* dcdd = (DCDD*)context;
+	dcdd->pulse = 0;
+	if (dcdd->selector & DCDD_SELECTOR_DRV_SELECT) {
+		return;
+	}
+	DISK* disk = &dcdd->disks[dcdd->selector];
+	if (disk->status & DCDD_STATUS_HEAD_LOADED) {
+		/* the pulses stop until the head is loaded again */
+		return;
+	}
+	if ((disk->status & DCDD_STATUS_INT_ENABLED) == 0) {
+		sched_irq(dcdd->sched, dcdd->irq_source, 1);
+	}
+	dcdd_schedule(dcdd);
+}
+void dcdd_schedule(DCDD* dcdd) {
+	/* post the pulse for the start of the next sector */
+	if (!dcdd->rotate || dcdd->pulse || dcdd->sched == NULL) {
+		return;
+	}
+	uint64_t next = (sched_now(dcdd->sched) / DCDD_SECTOR_CYCLES + 1) * DCDD_SECTOR_CYCLES;
+	dcdd->pulse = sched_post(dcdd->sched, next, sector_pulse, dcdd) == 0;
+}
+
+uint8_t dcdd_sector(DCDD* dcdd) {
 	if (dcdd->selector & DCDD_SELECTOR_DRV_SELECT) {
 		return 0xFF;
 	}
@@ -174,6 +454,22 @@ static uint8_t dcdd_sector(DCDD* dcdd) {
 		// head not loaded
 		return 0xFF;
 	}
+
+	if (dcdd->rotate) {
+		/* the sector under the head follows the machine clock */
+		DISK* disk = &dcdd->disks[dcdd->selector];
+		uint64_t now = sched_now(dcdd->sched);
+		uint8_t sector = (uint8_t)((now / DCDD_SECTOR_CYCLES) % DCDD_SECTORS_PER_TRACK);
+		if (disk->sector != sector) {
+			disk->sector = sector;
+			disk->index = 0;
+		}
+		sched_irq(dcdd->sched, dcdd->irq_source, 0);
+		if (now % DCDD_SECTOR_CYCLES >= DCDD_TRUE_CYCLES) {
+			return (sector << 1) | DCDD_SECTOR_TRUE;
+		}
+		return sector << 1;
+	}
 	
 	dcdd->disks[dcdd->selector].sector++;
 	if (dcdd->disks[dcdd->selector].sector >= DCDD_SECTORS_PER_TRACK) {
@@ -182,7 +478,7 @@ static uint8_t dcdd_sector(DCDD* dcdd) {
 	dcdd->disks[dcdd->selector].index = 0;
 	return (dcdd->disks[dcdd->selector].sector << 1);
 }
-static uint8_t dcdd_read(DCDD* dcdd) {
+uint8_t dcdd_read(DCDD* dcdd) {
 	if (dcdd->selector & DCDD_SELECTOR_DRV_SELECT) {
 		return 0xFF;
 	}
@@ -192,21 +488,24 @@ static uint8_t dcdd_read(DCDD* dcdd) {
 		return 0xFF;
 	}
 
-	if (dcdd->disks[dcdd->selector].file == NULL) {
+	if (dcdd->disks[dcdd->selector].buffer == NULL) {
 		return 0xFF;
 	}
 
+	DISK* disk = &dcdd->disks[dcdd->selector];
 	uint32_t offset = head_pos(dcdd->disks[dcdd->selector]);
-	if (fseek(dcdd->disks[dcdd->selector].file, offset, SEEK_SET) != 0) {
-		return 0xFF;
+	if (disk->index++ == 0) {
+		disk->reads++;
 	}
-	
-	uint8_t v = 0;
-	fread(&v, 1, 1, dcdd->disks[dcdd->selector].file);
-	dcdd->disks[dcdd->selector].index++;
-	return v;
+	if (offset >= DCDD_DISK_SIZE) {
+		return 0x00;
+	}
+	if (disk->host != NULL) {
+		dcdd_fill_sector(disk, offset / DCDD_BYTES_PER_SECTOR);
+	}
+	return disk->buffer[offset];
 }
-static void dcdd_write(DCDD* dcdd, uint8_t value) {
+void dcdd_write(DCDD* dcdd, uint8_t value) {
 	if (dcdd->selector & DCDD_SELECTOR_DRV_SELECT) {
 		return;
 	}
@@ -221,30 +520,47 @@ static void dcdd_write(DCDD* dcdd, uint8_t value) {
 		return;
 	}
 
-	if (dcdd->disks[dcdd->selector].file == NULL) {
+	if (dcdd->disks[dcdd->selector].buffer == NULL) {
 		return;
 	}
 
+	DISK* disk = &dcdd->disks[dcdd->selector];
 	uint32_t offset = head_pos(dcdd->disks[dcdd->selector]);
-	if (fseek(dcdd->disks[dcdd->selector].file, offset, SEEK_SET) != 0) {
+	if (disk->index++ == 0) {
+		disk->writes++;
+	}
+	if (offset >= DCDD_DISK_SIZE) {
 		return;
 	}
-	
-	fwrite(&value, 1, 1, dcdd->disks[dcdd->selector].file);
-	dcdd->disks[dcdd->selector].index++;
+
+	uint32_t sector = offset / DCDD_BYTES_PER_SECTOR;
+	if (disk->host != NULL) {
+		dcdd_fill_sector(disk, sector);
+	}
+	disk->buffer[offset] = value;
+
+	uint32_t mask = 1u << (sector & 31);
+	if ((disk->dirty[sector >> 5] & mask) == 0) {
+		disk->dirty[sector >> 5] |= mask;
+		disk->dirty_count++;
+	}
 }
 
-static void dcdd_selector(DCDD* dcdd, uint8_t value) {
+void dcdd_selector(DCDD* dcdd, uint8_t value) {
 	if (value & DCDD_SELECTOR_DRV_SELECT) {
 		/* deselect disk */
 		if ((dcdd->selector & DCDD_SELECTOR_DRV_SELECT) == 0) {
+			dcdd_flush_disk(dcdd, dcdd->selector);
 			dcdd->disks[dcdd->selector].status |= DCDD_STATUS_DRV_SELECT | DCDD_STATUS_MOVE_HEAD;
 			dcdd->selector = DCDD_SELECTOR_DRV_SELECT;
 		}
 	}
 	else {
 		uint8_t selector = value & 0x0F;
-		if (dcdd->disks[selector].file == NULL) {
+		if ((dcdd->selector & DCDD_SELECTOR_DRV_SELECT) == 0 && dcdd->selector != selector) {
+			dcdd_flush_disk(dcdd, dcdd->selector);
+		}
+		if (dcdd->disks[selector].buffer == NULL) {
 			/* disk error */
 			dcdd->disks[selector].status |= DCDD_STATUS_DRV_SELECT | DCDD_STATUS_MOVE_HEAD;
 			dcdd->selector = DCDD_SELECTOR_DRV_SELECT;
@@ -253,11 +569,15 @@ static void dcdd_selector(DCDD* dcdd, uint8_t value) {
 			/* select disk */
 			dcdd->disks[selector].status &= ~(DCDD_STATUS_DRV_SELECT | DCDD_STATUS_MOVE_HEAD);
 			dcdd->selector = selector;
+			if ((dcdd->disks[selector].status & DCDD_STATUS_HEAD_LOADED) == 0) {
+				dcdd_schedule(dcdd);
+			}
 		}
 	}
 }
 
 static void step_in(DCDD* dcdd) {
+	dcdd->disks[dcdd->selector].steps++;
 	if (dcdd->disks[dcdd->selector].track < DCDD_TRACKS_PER_DISK-1) {
 		dcdd->disks[dcdd->selector].track++;
 		dcdd->disks[dcdd->selector].sector = 0xFF;
@@ -266,6 +586,7 @@ static void step_in(DCDD* dcdd) {
 	dcdd->disks[dcdd->selector].status |= DCDD_STATUS_TRACK_ZERO; // Track not 0
 }
 static void step_out(DCDD* dcdd) {
+	dcdd->disks[dcdd->selector].steps++;
 	if (dcdd->disks[dcdd->selector].track > 0) {
 		dcdd->disks[dcdd->selector].track--;
 		dcdd->disks[dcdd->selector].sector = 0xFF;
@@ -279,24 +600,32 @@ static void load_head(DCDD* dcdd) {
 	dcdd->disks[dcdd->selector].status &= ~DCDD_STATUS_HEAD_LOADED; // head loaded for r/w
 	dcdd->disks[dcdd->selector].status &= ~DCDD_STATUS_READ_READY;  // read ready
 	dcdd->disks[dcdd->selector].sector = 0xFF; // set sector to FF so next time it's read it will read 0.
+	dcdd_schedule(dcdd);
 }
 static void unload_head(DCDD* dcdd) {
+	dcdd_flush_disk(dcdd, dcdd->selector);
 	dcdd->disks[dcdd->selector].status |= DCDD_STATUS_HEAD_LOADED; // head unloaded
 	dcdd->disks[dcdd->selector].status |= DCDD_STATUS_READ_READY;  // read not ready
 	dcdd->disks[dcdd->selector].status |= DCDD_STATUS_WRITE_READY; // write not ready
+	if (dcdd->sched != NULL) {
+		sched_irq(dcdd->sched, dcdd->irq_source, 0);
+	}
 }
 static void write_enable(DCDD* dcdd) {
 	dcdd->disks[dcdd->selector].index = 0;
 	dcdd->disks[dcdd->selector].status &= ~DCDD_STATUS_WRITE_READY;
 }
 static void enable_int(DCDD* dcdd) {
-	dcdd->disks[dcdd->selector].status |= DCDD_STATUS_INT_ENABLED;
+	dcdd->disks[dcdd->selector].status &= ~DCDD_STATUS_INT_ENABLED; // active low
 }
 static void disable_int(DCDD* dcdd) {
-	dcdd->disks[dcdd->selector].status &= ~DCDD_STATUS_INT_ENABLED;
+	dcdd->disks[dcdd->selector].status |= DCDD_STATUS_INT_ENABLED;
+	if (dcdd->sched != NULL) {
+		sched_irq(dcdd->sched, dcdd->irq_source, 0);
+	}
 }
 
-static void dcdd_command(DCDD* dcdd, uint8_t value) {	
+void dcdd_command(DCDD* dcdd, uint8_t value) {	
 
 	if (dcdd->selector & DCDD_SELECTOR_DRV_SELECT) {
 		return;
@@ -9,26 +9,90 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#include "io.h"
+#include "sched.h"
+
 #define DCDD_MAX_DISKS 16
 
+#define DCDD_TRACKS_PER_DISK       77   // Number of tracks per disk
+#define DCDD_SECTORS_PER_TRACK     32   // Number of sectors per track
+#define DCDD_BYTES_PER_SECTOR      137  // Number of bytes per sector
+#define DCDD_DISK_SIZE             (DCDD_TRACKS_PER_DISK * DCDD_SECTORS_PER_TRACK * DCDD_BYTES_PER_SECTOR)
+
+#define DCDD_FLUSH_RATE            60   // Number of updates between dirty sector flushes
+
+#define DCDD_SECTOR_CYCLES         10417 // cpu cycles per sector with rotation timing; 360 RPM, 32 sectors, 2 Mhz
+#define DCDD_TRUE_CYCLES           60    // cpu cycles sector true is asserted at the start of a sector (30us)
+
+#define DCDD_STATUS_WRITE_READY    0x01 // ACTIVE_LOW - write device is ready
+#define DCDD_STATUS_MOVE_HEAD      0x02 // ACTIVE_LOW - head can be moved
+#define DCDD_STATUS_HEAD_LOADED    0x04 // ACTIVE_LOW - head is loaded for r/w
+#define DCDD_STATUS_DRV_SELECT     0x08 // ACTIVE_LOW - disk is selected and active
+#define DCDD_STATUS_INT_ENABLED    0x20 // ACTIVE_LOW - interrupts are enabled
+#define DCDD_STATUS_TRACK_ZERO     0x40 // ACTIVE_LOW - head is on track 0
+#define DCDD_STATUS_READ_READY     0x80 // ACTIVE_LOW - read device is ready
+
+#define PORT_DCDD_STATUS           0x08 // status port (in)
+#define PORT_DCDD_SELECTOR         0x08 // selector port (out)
+#define PORT_DCDD_SECTOR           0x09 // sector port (in)
+#define PORT_DCDD_COMMAND          0x09 // command port (out)
+#define PORT_DCDD_DATA             0x0A // data port (in/out)
+
+#define DCDD_SELECTOR_DRV_SELECT   0x80 // ACTIVE_HIGH - disk controller - no disk selected
+#define DCDD_SECTOR_TRUE           0x01 // ACTIVE_LOW  - the sector is positioned to r/w
+
+typedef struct HOSTDIR HOSTDIR;
+
 typedef struct {
 	uint8_t status; // disk status
 	uint8_t sector; // sector position
 	uint8_t track;  // track position
 	uint32_t index; // track index 
-	FILE* file;
+	FILE* file;      // image file (overlay: delta file), or NULL when detached or the delta is in memory
+	char* filename;  // image path, <base>,<delta> for an overlay or a host directory; the journal is kept at <filename>.jnl
+	uint8_t* buffer; // cached disk image (DCDD_DISK_SIZE)
+	uint32_t dirty[DCDD_TRACKS_PER_DISK]; // dirty sector bitmap; 1 bit per sector, 1 word per track
+	uint32_t dirty_count; // number of dirty sectors
+	char* base;      // overlay: read only base image path, or NULL (see dcdd_overlay.c)
+	int mapped;      // overlay: buffer is a private mapping of the base
+	uint64_t base_hash; // overlay: hash of the base the delta applies to
+	uint32_t delta[DCDD_TRACKS_PER_DISK]; // overlay: sectors in the delta file; same layout as dirty
+	HOSTDIR* host;   // host directory disk state, or NULL (see dcdd_hostdir.c)
+	uint64_t reads;  // sectors read (metrics)
+	uint64_t writes; // sectors written (metrics)
+	uint64_t steps;  // head steps (metrics)
 } DISK;
 
 typedef struct {
 	int8_t selector; // disk selector
 	DISK* disks;     // disks (16)
+	uint32_t flush_timer; // updates since the last flush
+	SCHED* sched;    // machine clock and interrupt line, or NULL
+	int irq_source;  // interrupt source on sched
+	int rotate;      // sectors pass under the head with the machine clock instead of one per sector read
+	int pulse;       // rotate: a sector pulse event is posted
 } DCDD;
 
 int dcdd_init(DCDD* dcdd);
 void dcdd_free(DCDD* dcdd);
 void dcdd_reset(DCDD* dcdd);
+void dcdd_update(DCDD* dcdd);
+
+int dcdd_load_disk(DCDD* dcdd, uint8_t disk, const char* filename);
+void dcdd_unload_disk(DCDD* dcdd, uint8_t disk);
+int dcdd_flush_disk(DCDD* dcdd, uint8_t disk);
+void dcdd_detach_disk(DCDD* dcdd, uint8_t disk);
+int dcdd_export_disk(DCDD* dcdd, uint8_t disk, const char* filename);
+int dcdd_write_image(const char* filename, FILE* file, const uint8_t* buffer, const uint32_t* sectors);
+
+int dcdd_register_io(DCDD* dcdd, IO* io);
+void dcdd_schedule(DCDD* dcdd);
 
-int dcdd_read_io(DCDD* dcdd, uint8_t port, uint8_t* value);
-int dcdd_write_io(DCDD* dcdd, uint8_t port, uint8_t value);
+uint8_t dcdd_status(DCDD* dcdd);
+uint8_t dcdd_sector(DCDD* dcdd);
+uint8_t dcdd_read(DCDD* dcdd);
+void dcdd_write(DCDD* dcdd, uint8_t value);
+void dcdd_selector(DCDD* dcdd, uint8_t value);
+void dcdd_command(DCDD* dcdd, uint8_t value);
 
 #endif
@@ -1,143 +1,282 @@
 /* 88_sio.c
- * Serial io board - 88-SIO
+ * Serial io board - 88-2SIO
  * Github: https:\\github.com\tommojphillips
  */
 
- /* The board provides serial communication between the ALTAIR and any serial Input/Output devices. 
-  * The board has two device code addresses which are hardware selectable by jumpers for any even address from 0x00 to 0xFE.
-  * The board provides both hardware and software interrupt capability.
-  
- - CONTROL CHANNEL:
-	The control channel has two purposes: it is used to enable/disable the hardware interrupt capability for the input or output device,
-	and to test the status of the input/output device. 
+ /* The board has two serial channels, each a Motorola 6850 ACIA. The board base is jumper selectable;
+  * port A uses base + 0 (control/status) and base + 1 (data), port B base + 2 and base + 3.
+  * Each SIO is one channel. Port A is the operator terminal; port B is free for transfers.
 
- - STATUS BYTE (in)
+ - STATUS REGISTER (in)
 
 		  7   6   5   4   3   2   1   0
 		+---+---+---+---+---+---+---+---+
-		| W | X | A | O | F | P | E | R |
+		|IRQ| PE|OVR| FE|CTS|DCD|TDE|RDF|
 		+---+---+---+---+---+---+---+---+
 
-		W - ACTIVE_LOW  - output device is ready (a ready pulse has been sent from the device)
-		X - not used
-		A - ACTIVE HIGH - data Available  (data is in the buffer on the io board)
-		O - ACTIVE HIGH - data overflow  (new data has been recieved before the previous data was inputed to A)
-		F - ACTIVE_HIGH - framming error (no valid stop bit)
-		P - ACTIVE_HIGH - parity error (recieved parity does not equal selected parity)
-		E - ACTIVE HIGH - data buffer is empty (the data has been X-mitted and new data may be outputted)
-		R - ACTIVE_LOW  - input device is ready (a ready pulse has been sent from the device)
- 
- - STATUS BYTE (out)
-	When an "OUT" instruction is executed with the status address, data bits
-	0 & 1 are gated to the input/output interrupt flip-flops,
-
-	|  DO  |  D1  | OUTPUT INT |  INPUT INT |
-	| LOW  | LOW  |  disabled  |  disabled  |
-	| LOW  | HIGH |  enabled   |  disabled  |
-	| HIGH | LOW  |  disabled  |  enabled   |
-	| HIGH | HIGH |  enabled   |  enabled   |
+		IRQ - interrupt request; an enabled interrupt condition is pending
+		PE  - parity error (never set)
+		OVR - receiver overrun; a byte was lost because the last one was not read in time
+		FE  - framing error (never set)
+		CTS - clear to send; ACTIVE LOW (always clear)
+		DCD - data carrier detect; ACTIVE LOW (always present)
+		TDE - transmit data register empty
+		RDF - receive data register full
+
+ - CONTROL REGISTER (out)
+
+		  7   6   5   4   3   2   1   0
+		+---+---+---+---+---+---+---+---+
+		|RIE|  TC   |  WORD SEL |  DIV  |
+		+---+---+---+---+---+---+---+---+
+
+		RIE  - receive interrupt enable; IRQ while RDF or OVR
+		TC   - transmit control; 01 enables the transmit interrupt (IRQ while TDE), 00, 10 and 11 disable it
+		WORD - data bits, parity and stop bits; ignored, bytes are passed through as 8 bits
+		DIV  - clock divide; 11 is a master reset
+
+	Baud rates are not emulated; a byte is transmitted as soon as it is written.
+	Input that the host has queued is not lost by a master reset; it has not "arrived" yet.
 */
 
 #include <stdint.h>
 #include <stdio.h>
-#include <conio.h>
+#include <stdlib.h>
 
 #include "88_sio.h"
+#include "console.h"
+#include "io.h"
 
-#define SIO_OUTPUT_DEVICE_READY  0x80 // ACTIVE LOW  - output device is ready
-#define SIO_DATA_AVAILABLE       0x20 // ACTIVE HIGH - data Available
-#define SIO_DATA_OVERFLOW        0x10 // ACTIVE HIGH - data Overflow
-#define SIO_DATA_EMPTY           0x02 // ACTIVE HIGH - data buffer is empty
-#define SIO_INPUT_DEVICE_READY   0x01 // ACTIVE LOW  - input device is ready
+#define SIO_STATUS_RDF          0x01 // receive data register full
+#define SIO_STATUS_TDE          0x02 // transmit data register empty
+#define SIO_STATUS_DCD          0x04 // data carrier detect; active low
+#define SIO_STATUS_CTS          0x08 // clear to send; active low
+#define SIO_STATUS_FE           0x10 // framing error
+#define SIO_STATUS_OVR          0x20 // receiver overrun
+#define SIO_STATUS_PE           0x40 // parity error
+#define SIO_STATUS_IRQ          0x80 // interrupt request
 
-#define PORT_SIO_STATUS          0x10 // status port (in)
-#define PORT_SIO_CONTROL         0x10 // status port (out)
-#define PORT_SIO_DATA            0x11 // data port (in/out)
-#define PORT_SIO_DATA1           0x01 // data port (in/out)
+#define SIO_CONTROL_RESET       0x03 // DIV bits; master reset
+#define SIO_CONTROL_TC          0x60 // transmit control bits
+#define SIO_CONTROL_TIE         0x20 // TC value that enables the transmit interrupt
+#define SIO_CONTROL_RIE         0x80 // receive interrupt enable
 
-void sio_reset(SIO* sio) {
-	sio->status = 0;
-	sio->status |= SIO_DATA_EMPTY;
+#define rx_count(sio) ((sio)->rx_head - (sio)->rx_tail)
+
+static void update_irq(SIO* sio) {
+	/* the IRQ output follows the status and control registers */
+	if (sio->sched != NULL) {
+		sched_irq(sio->sched, sio->irq_source, sio_irq(sio));
+	}
 }
-void sio_update(SIO* sio) {
-	if (_kbhit()) {
-		if (sio->ch != 0) {
-			sio->status |= SIO_DATA_OVERFLOW;
-		}
-		else {
-			sio->status &= ~SIO_DATA_OVERFLOW;
-		}
-		sio->ch = (char)_getch();		
-		sio->status |= SIO_INPUT_DEVICE_READY;
-		sio->status &= ~SIO_DATA_EMPTY;
-		sio->status |= SIO_DATA_AVAILABLE;
+
+int sio_init(SIO* sio, uint32_t rx_size) {
+	/* round up to a power of two */
+	uint32_t size = 1;
+	while (size < rx_size && size < 0x100000) {
+		size <<= 1;
 	}
-	else {
-		sio->status &= ~SIO_INPUT_DEVICE_READY;
+	uint8_t* rx = (uint8_t*)malloc(size);
+	if (rx == NULL) {
+		return 1;
 	}
+	free(sio->rx);
+	sio->rx = rx;
+	sio->rx_size = size;
+	sio->rx_head = 0;
+	sio->rx_tail = 0;
+	return 0;
+}
+void sio_free(SIO* sio) {
+	free(sio->rx);
+	sio->rx = NULL;
+	sio->rx_size = 0;
+}
+void sio_reset(SIO* sio) {
+	sio->status = SIO_STATUS_TDE;
+	sio->control = SIO_CONTROL_RESET;
+	sio->output_interrupt = 0;
+	sio->input_interrupt = 0;
+	sio->rx_head = 0;
+	sio->rx_tail = 0;
+	update_irq(sio);
 }
 
-int sio_read_io(SIO* sio, uint8_t port, uint8_t* value) {
-	switch (port) {
-
-		case PORT_SIO_STATUS:
-			*value = sio_status(sio);
-			break;
+static int input_ready(SIO* sio) {
+	if (replay_playing(sio->replay)) {
+		/* the log stands in for the console */
+		return replay_input_ready(sio->replay, sio->channel);
+	}
+	return console_kbhit(sio->console);
+}
+static char input_getch(SIO* sio) {
+	if (replay_playing(sio->replay)) {
+		return replay_getch(sio->replay, sio->channel);
+	}
+	char ch = (char)console_getch(sio->console);
+	if (replay_recording(sio->replay)) {
+		replay_record_input(sio->replay, sio->channel, ch);
+	}
+	return ch;
+}
 
-		case PORT_SIO_DATA:
-			*value = sio_read(sio);
+static void receive(SIO* sio) {
+	/* take everything the console has; with flow control the rest waits on the host side */
+	while (!(sio->flow_control && rx_count(sio) == sio->rx_size) && input_ready(sio)) {
+		char ch = input_getch(sio);
+		if (ch == 0x1B && sio->terminal) {
+			sio->escape = 1;
 			break;
+		}
+		if (rx_count(sio) == sio->rx_size) {
+			sio->status |= SIO_STATUS_OVR;
+			update_irq(sio);
+			continue;
+		}
+		sio->rx[sio->rx_head++ & (sio->rx_size - 1)] = (uint8_t)ch;
+	}
+}
 
-		default:
-			return 0;
+static void latch(SIO* sio) {
+	/* move the next received byte into the data register once the guest has read the last one */
+	if (sio->status & SIO_STATUS_RDF) {
+		return;
+	}
+	if (rx_count(sio) == 0 && sio->instant) {
+		/* the guest wants input; the other side may be waiting on what it sent (eg an XMODEM ACK) */
+		sio_flush(sio);
+		receive(sio);
+	}
+	if (rx_count(sio) == 0) {
+		return;
 	}
-	return 1;
+	sio->ch = (char)sio->rx[sio->rx_tail++ & (sio->rx_size - 1)];
+	sio->status |= SIO_STATUS_RDF;
+	update_irq(sio);
 }
-int sio_write_io(SIO* sio, uint8_t port, uint8_t value) {
-	switch (port) {
 
-		case PORT_SIO_CONTROL:
-			sio_control(sio, value);
-			break;
+void sio_update(SIO* sio) {
+	sio_flush(sio);
+	receive(sio);
+	latch(sio);
+}
+void sio_flush(SIO* sio) {
+	if (sio->tx_len != 0) {
+		if (sio->screen != NULL) {
+			/* drawn on the console when the screen is rendered */
+			screen_write(sio->screen, sio->tx, sio->tx_len);
+			console_record(sio->console, sio->tx, sio->tx_len);
+		}
+		else {
+			console_write(sio->console, sio->tx, sio->tx_len);
+		}
+		sio->tx_len = 0;
+	}
+}
 
-		case PORT_SIO_DATA:
-			sio_write(value);
-			break;
+int sio_wait(SIO* sio, uint32_t timeout_us) {
+	/* block until host input is available or the timeout expires. */
+	sio_flush(sio);
+	if ((sio->status & SIO_STATUS_RDF) || rx_count(sio) != 0) {
+		return 1;
+	}
+	return console_wait(sio->console, timeout_us);
+}
 
-		case PORT_SIO_DATA1:
-			sio_write(value);
-			break;
+static uint8_t in_status(void* context, uint8_t port) {
+	return sio_status((SIO*)context);
+}
+static uint8_t in_data(void* context, uint8_t port) {
+	return sio_read((SIO*)context);
+}
+static void out_control(void* context, uint8_t port, uint8_t value) {
+	sio_control((SIO*)context, value);
+}
+static void out_data(void* context, uint8_t port, uint8_t value) {
+	sio_write((SIO*)context, value);
+}
 
-		default:
-			return 0;
+int sio_register_io(SIO* sio, IO* io, uint8_t base) {
+	base &= 0xFE;
+	if (!io_available(io, base + PORT_SIO_STATUS, sio) || !io_available(io, base + PORT_SIO_DATA, sio) ||
+		(sio->terminal && !io_available(io, PORT_SIO_DATA1, sio))) {
+		printf("Error: SIO ports %02X-%02X are already in use\n", base, base + PORT_SIO_DATA);
+		return 1;
+	}
+	/* moving the board; release the old ports */
+	sio_release_io(sio);
+	sio->io = io;
+	sio->base = base & 0xFE;
+	io_register_read(io, sio->base + PORT_SIO_STATUS, in_status, sio, 1);
+	io_register_read(io, sio->base + PORT_SIO_DATA, in_data, sio, 0);
+	io_register_write(io, sio->base + PORT_SIO_CONTROL, out_control, sio);
+	io_register_write(io, sio->base + PORT_SIO_DATA, out_data, sio);
+	if (sio->terminal) {
+		io_register_write(io, PORT_SIO_DATA1, out_data, sio);
 	}
-	return 1;
+	return 0;
+}
+void sio_release_io(SIO* sio) {
+	if (sio->io == NULL) {
+		return;
+	}
+	io_release(sio->io, sio->base + PORT_SIO_STATUS, sio);
+	io_release(sio->io, sio->base + PORT_SIO_DATA, sio);
+	if (sio->terminal) {
+		io_release(sio->io, PORT_SIO_DATA1, sio);
+	}
+	sio->io = NULL;
 }
 
+int sio_irq(SIO* sio) {
+	return (sio->input_interrupt && (sio->status & (SIO_STATUS_RDF | SIO_STATUS_OVR))) ||
+		(sio->output_interrupt && (sio->status & SIO_STATUS_TDE));
+}
 uint8_t sio_status(SIO* sio) {
+	latch(sio);
+	if (sio_irq(sio)) {
+		return sio->status | SIO_STATUS_IRQ;
+	}
 	return sio->status;
 }
 uint8_t sio_read(SIO* sio) {
 	char ch = sio->ch;
 	sio->ch = 0;
-	if (ch >= 'a' && ch <= 'z') {
+	if (sio->terminal && ch >= 'a' && ch <= 'z') {
 		ch -= 0x20;
 	}
-	sio->status &= ~SIO_INPUT_DEVICE_READY;
-	sio->status |= SIO_DATA_EMPTY;
-	sio->status &= ~SIO_DATA_AVAILABLE;
+	if (sio->status & SIO_STATUS_RDF) {
+		sio->busy++;
+		sio->rx_bytes++;
+	}
+	sio->status &= ~(SIO_STATUS_RDF | SIO_STATUS_OVR);
+	latch(sio);
+	update_irq(sio);
 	return ch;
 }
-void sio_write(char ch) {
-	if (ch == 0x08) {
-		printf("\b");
+void sio_write(SIO* sio, char ch) {
+	sio->busy++;
+	sio->tx_bytes++;
+	if (sio->replay != NULL) {
+		replay_output(sio->replay, ch);
 	}
-	else {
-		printf("%c", ch);
+	sio->tx[sio->tx_len++] = ch;
+	if (sio->tx_len == SIO_TX_SIZE) {
+		sio_flush(sio);
 	}
 }
 void sio_control(SIO* sio, uint8_t value) {
-	sio->control = value & 0x03;
-	sio->input_interrupt = value & 0x01;
-	sio->output_interrupt = (value & 0x02) >> 1;
+	sio->control = value;
+	if ((value & SIO_CONTROL_RESET) == SIO_CONTROL_RESET) {
+		/* master reset; a received byte stays, see above */
+		sio->status &= SIO_STATUS_RDF;
+		sio->status |= SIO_STATUS_TDE;
+		sio->input_interrupt = 0;
+		sio->output_interrupt = 0;
+		update_irq(sio);
+		return;
+	}
+	sio->input_interrupt = (value & SIO_CONTROL_RIE) != 0;
+	sio->output_interrupt = (value & SIO_CONTROL_TC) == SIO_CONTROL_TIE;
+	update_irq(sio);
 }
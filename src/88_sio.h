@@ -1,5 +1,5 @@
 /* 88_sio.h
- * Serial io board - 88-SIO
+ * Serial io board - 88-2SIO
  * Github: https:\\github.com\tommojphillips
  */
 
@@ -8,23 +8,67 @@
 
 #include <stdint.h>
 
+#include "console.h"
+#include "io.h"
+#include "sched.h"
+#include "replay.h"
+#include "screen.h"
+
+#define SIO_DEFAULT_BASE         0x10 // default board base port; jumper selectable, any even port
+#define PORT_SIO_STATUS          0x00 // status port (in); channel base + 0
+#define PORT_SIO_CONTROL         0x00 // control port (out); channel base + 0
+#define PORT_SIO_DATA            0x01 // data port (in/out); channel base + 1
+#define PORT_SIO_DATA1           0x01 // data port (out); DBL error output
+#define PORT_SIO_B               0x02 // port B channel base; board base + 2
+
+#define SIO_TX_SIZE              256  // transmit buffer; flushed to the console when full or on every poll
+#define SIO_RX_SIZE              256  // default receive fifo size
+
+/* one 6850 ACIA channel */
 typedef struct {
 	uint8_t status;
 	uint8_t control;
-	uint8_t output_interrupt;
-	uint8_t input_interrupt;
-	char ch;
+	uint8_t output_interrupt; // transmit interrupt enabled
+	uint8_t input_interrupt;  // receive interrupt enabled
+	char ch;          // data register
+	CONSOLE* console; // device connected to the port
+	uint8_t base;     // channel base port
+	int terminal;     // operator terminal: input is upper cased, ESC is for the host and DBL errors (port 01) are echoed
+	int instant;      // fetch input as soon as the guest wants it instead of once per poll
+	uint32_t busy;    // transfer activity since the end of the last frame
+	IO* io;           // bus the ports are registered on
+	SCHED* sched;     // interrupt line, or NULL
+	int irq_source;   // interrupt source on sched
+	REPLAY* replay;   // input log being recorded or played, or NULL
+	uint8_t channel;  // replay log channel; 0 port A, 1 port B
+	SCREEN* screen;   // terminal emulation output goes through, or NULL
+	uint8_t* rx;      // receive fifo
+	uint32_t rx_size; // fifo size; a power of two
+	uint32_t rx_head; // next byte to write
+	uint32_t rx_tail; // next byte to read
+	int flow_control; // stop reading the console while the fifo is full; otherwise overflow and drop
+	int escape;       // ESC was typed; it is for the host, not the guest
+	char tx[SIO_TX_SIZE]; // transmit buffer
+	uint32_t tx_len;
+	uint64_t rx_bytes;    // bytes the guest read (metrics)
+	uint64_t tx_bytes;    // bytes the guest wrote (metrics)
 } SIO;
 
+int sio_init(SIO* sio, uint32_t rx_size);
+void sio_free(SIO* sio);
 void sio_reset(SIO* sio);
 void sio_update(SIO* sio);
+void sio_flush(SIO* sio);
+int sio_wait(SIO* sio, uint32_t timeout_us);
 
-int sio_read_io(SIO* sio, uint8_t port, uint8_t* value);
-int sio_write_io(SIO* sio, uint8_t port, uint8_t value);
+/* install the channel at <base>; returns 1, leaving it where it was, if another device has one of the ports */
+int sio_register_io(SIO* sio, IO* io, uint8_t base);
+void sio_release_io(SIO* sio);
 
+int sio_irq(SIO* sio);
 uint8_t sio_status(SIO* sio);
 uint8_t sio_read(SIO* sio);
-void sio_write(char ch);
+void sio_write(SIO* sio, char ch);
 void sio_control(SIO* sio, uint8_t value);
 
 #endif
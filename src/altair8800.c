@@ -4,7 +4,6 @@
 
 #include <stdint.h>
 #include <stdlib.h>
-#include <malloc.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -12,6 +11,21 @@
 #include "i8080.h"
 #include "88_sio.h"
 #include "88_dcdd.h"
+#include "dcdd_overlay.h"
+#include "dcdd_trap.h"
+#include "timing.h"
+#include "idle.h"
+#include "console.h"
+#include "io.h"
+#include "memmap.h"
+#include "jit.h"
+#include "predecode.h"
+#include "snapshot.h"
+#include "trace.h"
+#include "profile.h"
+#include "sched.h"
+#include "replay.h"
+#include "bank.h"
 
 #define REFRESH_RATE 60
 #define CPU_CLOCK 2000000 /* 2 Mhz */
@@ -25,95 +39,453 @@
 #define dbg_err(x, ...)
 #endif
 
-ALTAIR8800 altair = { 0 };
+/* the i8080 bus callbacks take no context; the machine being stepped on this thread */
+static THREAD_LOCAL ALTAIR8800* bus = NULL;
 
-uint8_t altair8800_read_byte(uint16_t address) {
-	return *(uint8_t*)(altair.memory + (address & 0xFFFF));
+static uint8_t altair8800_read_byte(uint16_t address) {
+	return memmap_read(&bus->memmap, address);
 }
-void altair8800_write_byte(uint16_t address, uint8_t value) {
-	if (address < altair.ram_size)
-		*(uint8_t*)(altair.memory + (address & 0xFFFF)) = value;
+static void altair8800_write_byte(uint16_t address, uint8_t value) {
+	if (trace_enabled(&bus->trace)) {
+		trace_event(&bus->trace, TRACE_WRITE, address, value);
+	}
+	PAGE* page = &bus->memmap.pages[address >> 8];
+	if (page->flags & PAGE_WRITE) {
+		uint8_t* ptr = page->ptr + (address & 0xFF);
+		if (*ptr != value) {
+			idle_activity(&bus->idle);
+			page->generation++;
+			*ptr = value;
+		}
+	}
+	else if (page->flags & PAGE_MMIO) {
+		idle_activity(&bus->idle);
+		memmap_write_slow(&bus->memmap, address, value);
+	}
 }
 
-uint8_t altair8800_read_io(uint8_t port) {
-	uint8_t value;
-	if (port == PORT_FRONT_PANEL_SWITCHES) {
-		return altair.front_panel_switches;
+void altair8800_map_ram(ALTAIR8800* machine, uint32_t ram_size) {
+	/* RAM from 0 to ram_size; roms are left in place and images above it read only */
+	machine->ram_size = ram_size;
+	for (uint32_t i = 0; i < MEMMAP_PAGES; ++i) {
+		uint32_t address = i * MEMMAP_PAGE_SIZE;
+		if (machine->images[i] == IMAGE_ROM) {
+			continue;
+		}
+		if (address < ram_size) {
+			memmap_map(&machine->memmap, address, MEMMAP_PAGE_SIZE, machine->memory + address, PAGE_RAM);
+		}
+		else if (machine->images[i] == IMAGE_RAM) {
+			memmap_map(&machine->memmap, address, MEMMAP_PAGE_SIZE, machine->memory + address, PAGE_ROM);
+		}
+		else {
+			memmap_unmap(&machine->memmap, address, MEMMAP_PAGE_SIZE);
+		}
 	}
-	else if (dcdd_read_io(&altair.dcdd, port, &value)) {
-		return value;
+}
+void altair8800_map_image(ALTAIR8800* machine, uint16_t address, uint32_t size, int type) {
+	/* whole pages; a ROM image write protects the rest of its first and last page */
+	if (size == 0) {
+		return;
 	}
-	else if (sio_read_io(&altair.sio, port, &value)) {
-		return value;
+	uint32_t end = address + size - 1;
+	if (end > 0xFFFF) {
+		end = 0xFFFF;
 	}
-	else {
-		dbg_err("Reading from undefined port: %02X\n", port);
-		return 0xFF;
+	for (uint32_t i = address >> 8; i <= (end >> 8); ++i) {
+		uint32_t page = i * MEMMAP_PAGE_SIZE;
+		if (machine->images[i] != IMAGE_ROM) {
+			machine->images[i] = (uint8_t)type;
+		}
+		if (machine->images[i] == IMAGE_ROM || page >= machine->ram_size) {
+			memmap_map(&machine->memmap, page, MEMMAP_PAGE_SIZE, machine->memory + page, PAGE_ROM);
+		}
 	}
 }
-void altair8800_write_io(uint8_t port, uint8_t value) {
-	if (port == PORT_FRONT_PANEL_SWITCHES) {
+int altair8800_map_sio(ALTAIR8800* machine, uint8_t base) {
+	/* the 2SIO board; port A at base, port B at base + 2. on a conflict the board stays where it was */
+	int mapped = machine->sio.io != NULL;
+	uint8_t old = machine->sio.base;
+	sio_release_io(&machine->sio);
+	sio_release_io(&machine->sio_b);
+	if (sio_register_io(&machine->sio, &machine->io, base) == 0 &&
+		sio_register_io(&machine->sio_b, &machine->io, base + PORT_SIO_B) == 0) {
+		return 0;
+	}
+	sio_release_io(&machine->sio);
+	if (mapped) {
+		sio_register_io(&machine->sio, &machine->io, old);
+		sio_register_io(&machine->sio_b, &machine->io, old + PORT_SIO_B);
+	}
+	return 1;
+}
+int altair8800_set_engine(ALTAIR8800* machine, int engine) {
+	if (machine->engine == engine) {
+		return 0;
+	}
+	if (engine != ENGINE_INTERPRETER && (trace_enabled(&machine->trace) || profile_enabled(&machine->profile))) {
+		printf("Error: tracing and profiling need the interpreter\n");
+		return 1;
+	}
+	if (machine->engine == ENGINE_JIT) {
+		jit_destroy(&machine->jit);
+	}
+	else if (machine->engine == ENGINE_PREDECODE) {
+		predecode_destroy(&machine->predecode);
+	}
+	machine->engine = ENGINE_INTERPRETER;
+	if (engine == ENGINE_JIT) {
+		if (jit_init(&machine->jit, &machine->memmap) != 0) {
+			return 1;
+		}
+	}
+	else if (engine == ENGINE_PREDECODE) {
+		if (predecode_init(&machine->predecode, &machine->memmap) != 0) {
+			return 1;
+		}
+	}
+	machine->engine = engine;
+	return 0;
+}
 
+static uint8_t altair8800_read_io(uint8_t port) {
+	IO_PORT* p = &bus->io.ports[port];
+	uint8_t value = p->read(p->read_context, port);
+	metrics_in(&bus->metrics, port);
+	if (trace_enabled(&bus->trace)) {
+		trace_event(&bus->trace, TRACE_IN, port, value);
 	}
-	else if (dcdd_write_io(&altair.dcdd, port, value)) {
-		return;
+	if (profile_enabled(&bus->profile)) {
+		profile_in(&bus->profile, port);
 	}
-	else if (sio_write_io(&altair.sio, port, value)) {
-		return;
+	if (p->status) {
+		idle_read_io(&bus->idle, &bus->cpu, port, value);
 	}
 	else {
-		dbg_err("Writing to undefined port: %02X = %02X\n", port, value);
+		idle_activity(&bus->idle);
+	}
+	return value;
+}
+static void altair8800_write_io(uint8_t port, uint8_t value) {
+	metrics_out(&bus->metrics, port);
+	if (trace_enabled(&bus->trace)) {
+		trace_event(&bus->trace, TRACE_OUT, port, value);
 	}
+	if (profile_enabled(&bus->profile)) {
+		profile_out(&bus->profile, port);
+	}
+	idle_activity(&bus->idle);
+	io_write(&bus->io, port, value);
+}
+
+static uint8_t front_panel_read(void* context, uint8_t port) {
+	return *(uint8_t*)context;
+}
+static void front_panel_write(void* context, uint8_t port, uint8_t value) {
+
 }
 
 void push_word(I8080* cpu, uint16_t value);
 
-static void altair8800_interrupt(uint8_t rst_num) {
-	if (altair.cpu.flags.interrupt) {
-		altair.cpu.flags.interrupt = 0;
-		push_word(&altair.cpu, altair.cpu.pc);
-		altair.cpu.pc = (rst_num & 0b111) << 3;
+static void altair8800_interrupt(ALTAIR8800* machine, uint8_t rst_num) {
+	if (machine->cpu.flags.interrupt) {
+		machine->cpu.flags.interrupt = 0;
+		machine->cpu.flags.halt = 0;
+		push_word(&machine->cpu, machine->cpu.pc);
+		machine->cpu.pc = (rst_num & 0b111) << 3;
 	}
 }
-void altair8800_update() {
-	altair.cpu.cycles = 0;
-	while (altair.cpu.cycles < VBLANK_RATE) {
-		i8080_execute(&altair.cpu);
+void altair8800_step(ALTAIR8800* machine) {
+	/* run one frame; the cpu runs in batches up to the next device event */
+	bus = machine;
+	machine->cpu.cycles = 0;
+	if (machine->replay.mode != REPLAY_OFF && !machine->replay.started &&
+		replay_begin(&machine->replay, machine->memory, &machine->front_panel_switches, &machine->dcdd) != 0) {
+		replay_close(&machine->replay);
+		machine->running = 0;
+		return;
+	}
+	while (machine->cpu.cycles < VBLANK_RATE) {
+		if (machine->sched.irq != 0 && machine->cpu.flags.interrupt && !machine->interrupt_delay) {
+			altair8800_interrupt(machine, sched_vector(&machine->sched));
+		}
+		uint32_t limit = sched_limit(&machine->sched, VBLANK_RATE);
+		if (machine->cpu.cycles >= limit) {
+			sched_run(&machine->sched);
+			continue;
+		}
+		if (machine->cpu.flags.halt) {
+			/* nothing happens until an event raises an interrupt */
+			machine->idle.skipped += limit - machine->cpu.cycles;
+			machine->cpu.cycles = limit;
+			continue;
+		}
+		if (machine->engine != ENGINE_INTERPRETER && !machine->interrupt_delay) {
+			/* runs up to the next IN, OUT, HLT, EI or DI; the instruction after EI runs below */
+			if (machine->engine == ENGINE_JIT) {
+				machine->instructions += jit_execute(&machine->jit, &machine->cpu, limit);
+			}
+			else {
+				machine->instructions += predecode_execute(&machine->predecode, &machine->cpu, limit);
+			}
+			if (machine->cpu.cycles >= limit) {
+				continue;
+			}
+		}
+		if (machine->disk_trap) {
+			dcdd_trap(&machine->cpu, &machine->dcdd);
+		}
+		if (trace_enabled(&machine->trace)) {
+			trace_instruction(&machine->trace, &machine->cpu, &machine->memmap);
+			if (machine->cpu.pc == machine->trace.trigger && !machine->trace.dumped && machine->trace.filename != NULL) {
+				trace_dump(&machine->trace, machine->trace.filename);
+				machine->trace.dumped = 1;
+			}
+		}
+		int interrupt = machine->cpu.flags.interrupt;
+		if (profile_enabled(&machine->profile)) {
+			profile_execute(&machine->profile, &machine->cpu, &machine->memmap);
+		}
+		else {
+			i8080_execute(&machine->cpu);
+		}
+		machine->instructions++;
+		/* an interrupt waits for the instruction after EI, so an ISR ending EI, RET returns first */
+		machine->interrupt_delay = !interrupt && machine->cpu.flags.interrupt;
+		if (machine->idle.detected) {
+			/* guest is spinning on a status port; skip to the next event or the end of the frame */
+			if (machine->cpu.cycles < limit) {
+				machine->idle.skipped += limit - machine->cpu.cycles;
+				machine->cpu.cycles = limit;
+			}
+			if (limit < VBLANK_RATE) {
+				/* let the guest look again after the event; an unchanged poll is idle again at once */
+				machine->idle.detected = 0;
+			}
+		}
 	}
-	sio_update(&altair.sio);
-	if (altair.sio.ch == 0x1B) {
-		altair.running = 0;
+	/* the frame is over; the machine clock reads the end of it until the next frame starts */
+	uint32_t cycles = machine->cpu.cycles;
+	sched_frame(&machine->sched, cycles);
+	machine->cpu.cycles = 0;
+	int poll = timing_poll(&machine->timing);
+	if (replay_playing(&machine->replay)) {
+		/* input comes from the log at the cycle it was recorded; look every frame */
+		poll = 1;
+	}
+	uint64_t idle_wait = 0;
+	machine->waiting_input = 0;
+	if (machine->idle.detected || machine->cpu.flags.halt) {
+		machine->idle.detected = 0;
+		if (!poll) {
+			if (machine->nonblocking) {
+				/* the caller waits on the console for us */
+				poll = sio_wait(&machine->sio, 0);
+				if (!poll) {
+					machine->waiting_input = 1;
+					idle_wait = timing_until_poll(&machine->timing);
+				}
+			}
+			else if (machine->sio_b.instant) {
+				/* wake for a transfer straight away; the terminal is still polled */
+				poll = sio_wait(&machine->sio_b, timing_until_poll(&machine->timing));
+				machine->sio_b.busy += poll;
+			}
+			else {
+				poll = sio_wait(&machine->sio, timing_until_poll(&machine->timing));
+			}
+		}
+	}
+	if (poll || machine->console.done) {
+		/* output first; it can advance a script to a save or trace command */
+		sio_flush(&machine->sio);
+		sio_flush(&machine->sio_b);
+		if (machine->sio.screen != NULL) {
+			screen_render(machine->sio.screen, machine->sio.console);
+		}
+	}
+	if (machine->console.disk[0] != '\0') {
+		/* queued overlay disk commands, one per line */
+		char* command = machine->console.disk;
+		char* end;
+		while ((end = strchr(command, '\n')) != NULL) {
+			*end = '\0';
+			if (replay_recording(&machine->replay)) {
+				replay_record_command(&machine->replay, command);
+			}
+			dcdd_overlay_command(&machine->dcdd, command);
+			command = end + 1;
+		}
+		machine->console.disk[0] = '\0';
+	}
+	if (replay_playing(&machine->replay)) {
+		char command[REPLAY_COMMAND];
+		while (replay_command(&machine->replay, command, sizeof(command))) {
+			dcdd_overlay_command(&machine->dcdd, command);
+		}
+	}
+	if (machine->console.snapshot[0] != '\0') {
+		/* between instructions and before any more input is delivered */
+		snapshot_save(machine, machine->console.snapshot);
+		machine->console.snapshot[0] = '\0';
+	}
+	if (machine->console.trace[0] != '\0') {
+		trace_dump(&machine->trace, machine->console.trace);
+		machine->console.trace[0] = '\0';
+	}
+	if (poll) {
+		sio_update(&machine->sio);
+		sio_update(&machine->sio_b);
+		dcdd_update(&machine->dcdd);
+		if (machine->sio.escape) {
+			/* the ESC is for the host; don't leave input pending for the guest */
+			machine->sio.escape = 0;
+			sio_reset(&machine->sio);
+			machine->running = 0;
+		}
+	}
+	if (machine->replay.mode != REPLAY_OFF && replay_frame(&machine->replay, machine->memory)) {
+		/* the log has run out, like a script at its end, unless the run went its own way */
+		machine->console.done = machine->replay.mismatches == 0;
+		machine->running = 0;
+	}
+	if (machine->console.done) {
+		machine->running = 0;
+	}
+	if (!machine->running) {
+		sio_flush(&machine->sio);
+		sio_flush(&machine->sio_b);
+		if (machine->sio.screen != NULL) {
+			screen_render(machine->sio.screen, machine->sio.console);
+			screen_end(machine->sio.screen, machine->sio.console);
+		}
+		replay_close(&machine->replay);
+	}
+	if (!machine->running && machine->snapshot != NULL) {
+		snapshot_save(machine, machine->snapshot);
+		machine->snapshot = NULL;
+	}
+	if (!machine->running && trace_enabled(&machine->trace) && machine->trace.filename != NULL && !machine->trace.dumped) {
+		trace_dump(&machine->trace, machine->trace.filename);
+		machine->trace.dumped = 1;
+	}
+	if (!machine->running && profile_enabled(&machine->profile) && machine->profile.filename != NULL) {
+		profile_report(&machine->profile, &machine->memmap, machine->profile.filename);
+		machine->profile.filename = NULL;
+	}
+	uint64_t delay = 0;
+	if (machine->sio_b.instant && machine->sio_b.busy) {
+		/* a transfer is running on port B; don't hold it to the cpu clock */
+		timing_frame_unthrottled(&machine->timing, cycles);
+	}
+	else {
+		delay = timing_frame_delay(&machine->timing, cycles);
+	}
+	machine->sio_b.busy = 0;
+	if (metrics_enabled(&machine->metrics)) {
+		/* the last export before the machine stops has the final counts */
+		metrics_update(&machine->metrics, !machine->running, machine->instructions, &machine->timing, &machine->idle,
+			&machine->sio, &machine->sio_b, &machine->dcdd);
+	}
+	if (machine->nonblocking) {
+		machine->resume = timing_now() + (delay > idle_wait ? delay : idle_wait);
+	}
+	else if (delay != 0) {
+		timing_sleep(delay);
 	}
 }
 
-int altair8800_init() {
-	altair.memory = (uint8_t*)malloc(0x10000);
-	if (altair.memory == NULL) {
+ALTAIR8800* altair8800_create() {
+	ALTAIR8800* machine = (ALTAIR8800*)calloc(1, sizeof(ALTAIR8800));
+	if (machine == NULL) {
+		dbg_err("Failed to allocate machine\n");
+		return NULL;
+	}
+	machine->memory = (uint8_t*)calloc(1, 0x10000);
+	if (machine->memory == NULL) {
 		dbg_err("Failed to allocate Memory\n");
-		return 1;
+		free(machine);
+		return NULL;
 	}
-	memset(altair.memory, 0, 0x10000);
 
-	i8080_init(&altair.cpu);
-	altair.cpu.read_byte = altair8800_read_byte;
-	altair.cpu.write_byte = altair8800_write_byte;
-	altair.cpu.read_io = altair8800_read_io;
-	altair.cpu.write_io = altair8800_write_io;
+	i8080_init(&machine->cpu);
+	sched_init(&machine->sched, &machine->cpu.cycles);
+	machine->cpu.read_byte = altair8800_read_byte;
+	machine->cpu.write_byte = altair8800_write_byte;
+	machine->cpu.read_io = altair8800_read_io;
+	machine->cpu.write_io = altair8800_write_io;
 	
-	altair.ram_size = 0x10000;
-	altair.front_panel_switches = 0x00;
-	altair.running = 1;
+	machine->instructions = 0;
+	memmap_init(&machine->memmap);
+	altair8800_map_ram(machine, 0x10000);
+	machine->front_panel_switches = 0x00;
+	machine->running = 1;
+	machine->disk_trap = 0;
+	machine->engine = ENGINE_INTERPRETER;
+	machine->interrupt_delay = 0;
+	machine->snapshot = NULL;
+	machine->trace.trigger = TRACE_NO_TRIGGER;
 	
-	sio_reset(&altair.sio);
-	dcdd_init(&altair.dcdd);
-	dcdd_reset(&altair.dcdd);
-	return 0;
+	io_init(&machine->io);
+	io_register_read(&machine->io, PORT_FRONT_PANEL_SWITCHES, front_panel_read, &machine->front_panel_switches, 1);
+	io_register_write(&machine->io, PORT_FRONT_PANEL_SWITCHES, front_panel_write, &machine->front_panel_switches);
+
+	/* no terminal until the front end attaches one */
+	console_init_null(&machine->console);
+	console_init_null(&machine->console_b);
+	machine->sio.console = &machine->console;
+	machine->sio.sched = &machine->sched;
+	machine->sio.irq_source = sched_add_source(&machine->sched, ALTAIR8800_IRQ_RST);
+	machine->sio.flow_control = 1;
+	machine->sio.terminal = 1;
+	machine->sio_b.console = &machine->console_b;
+	machine->sio_b.sched = &machine->sched;
+	machine->sio_b.irq_source = sched_add_source(&machine->sched, ALTAIR8800_IRQ_RST);
+	machine->sio_b.channel = 1;
+	machine->sio_b.flow_control = 1;
+	if (sio_init(&machine->sio, SIO_RX_SIZE) != 0 || sio_init(&machine->sio_b, SIO_RX_SIZE) != 0) {
+		altair8800_destroy(machine);
+		return NULL;
+	}
+	sio_reset(&machine->sio);
+	sio_reset(&machine->sio_b);
+	altair8800_map_sio(machine, SIO_DEFAULT_BASE);
+	if (dcdd_init(&machine->dcdd) != 0) {
+		altair8800_destroy(machine);
+		return NULL;
+	}
+	machine->dcdd.sched = &machine->sched;
+	machine->dcdd.irq_source = sched_add_source(&machine->sched, ALTAIR8800_IRQ_RST);
+	dcdd_reset(&machine->dcdd);
+	dcdd_register_io(&machine->dcdd, &machine->io);
+	timing_init(&machine->timing, CPU_CLOCK, TIMING_ACCURATE);
+	
+	idle_init(&machine->idle);
+	metrics_init(&machine->metrics);
+	return machine;
 }
-void altair8800_destroy() {
-	if (altair.memory != NULL) {
-		free(altair.memory);
-		altair.memory = NULL;
+void altair8800_destroy(ALTAIR8800* machine) {
+	if (machine == NULL) {
+		return;
+	}
+	altair8800_set_engine(machine, ENGINE_INTERPRETER);
+
+	if (machine->memory != NULL) {
+		free(machine->memory);
+		machine->memory = NULL;
 	}
 
-	dcdd_free(&altair.dcdd);
+	dcdd_free(&machine->dcdd);
+	sio_flush(&machine->sio);
+	sio_free(&machine->sio);
+	sio_flush(&machine->sio_b);
+	sio_free(&machine->sio_b);
+	console_destroy(&machine->console);
+	console_destroy(&machine->console_b);
+	replay_close(&machine->replay);
+	bank_free(&machine->bank);
+	metrics_close(&machine->metrics);
+	trace_destroy(&machine->trace);
+	profile_destroy(&machine->profile);
+	free(machine);
 }
@@ -8,21 +8,76 @@
 #include "i8080.h"
 #include "88_sio.h"
 #include "88_dcdd.h"
+#include "timing.h"
+#include "idle.h"
+#include "console.h"
+#include "io.h"
+#include "memmap.h"
+#include "jit.h"
+#include "predecode.h"
+#include "trace.h"
+#include "profile.h"
+#include "sched.h"
+#include "replay.h"
+#include "bank.h"
+#include "metrics.h"
+
+#define ENGINE_INTERPRETER 0 // i8080_execute one instruction at a time
+#define ENGINE_JIT         1 // translated blocks, interpreter fallback
+#define ENGINE_PREDECODE   2 // cached decoded instructions, interpreter fallback
+
+#define IMAGE_RAM 1 // loaded with -o or -m; writable below RAMTOP, read only above it like the original machine
+#define IMAGE_ROM 2 // loaded with -o<offset>,rom; always read only
+
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL _Thread_local
+#endif
+
+#define ALTAIR8800_IRQ_RST 7 // RST the INT line is answered with; there is no vectored interrupt board
 
 typedef struct {
 	I8080 cpu;
+	uint64_t instructions; // instructions executed
 	uint8_t* memory;
 	uint32_t ram_size;
+	MEMMAP memmap;
+	uint8_t images[MEMMAP_PAGES]; // IMAGE_* for pages holding a loaded image, else 0
+	BANK bank;     // bank select memory board; bank.count is 0 without one
 	uint8_t front_panel_switches;
-	SIO sio;
+	SIO sio;       // 2SIO port A; the terminal
+	SIO sio_b;     // 2SIO port B
 	DCDD dcdd;
+	SCHED sched;   // machine clock, device events and the interrupt line
+	TIMING timing;
+	IDLE idle;
+	CONSOLE console;
+	CONSOLE console_b; // device on 2SIO port B
+	SCREEN screen;     // terminal emulation on port A; screen.enabled is 0 without one
+	IO io;
 	int running;
+	int disk_trap; // accelerate known disk sector loops
+	int engine;    // ENGINE_*
+	int interrupt_delay; // EI just enabled interrupts; none is taken before the next instruction
+	const char* snapshot; // snapshot written when the machine stops, or NULL
+	JIT jit;
+	PREDECODE predecode;
+	TRACE trace;
+	PROFILE profile;
+	REPLAY replay;      // input log being recorded or played
+	METRICS metrics;    // per port counters and the metrics export
+	int nonblocking;    // step never sleeps or waits for input; the caller multiplexes machines (evloop.c)
+	int waiting_input;  // nonblocking: idle until console input arrives or resume
+	uint64_t resume;    // nonblocking: host time (us) to run the next frame
 } ALTAIR8800;
 
-extern ALTAIR8800 altair;
-
-void altair8800_update();
-int altair8800_init();
-void altair8800_destroy();
+ALTAIR8800* altair8800_create();
+void altair8800_destroy(ALTAIR8800* machine);
+void altair8800_step(ALTAIR8800* machine);
+void altair8800_map_ram(ALTAIR8800* machine, uint32_t ram_size);
+void altair8800_map_image(ALTAIR8800* machine, uint16_t address, uint32_t size, int type);
+int altair8800_map_sio(ALTAIR8800* machine, uint8_t base);
+int altair8800_set_engine(ALTAIR8800* machine, int engine);
 
 #endif
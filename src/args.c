@@ -0,0 +1,392 @@
+/* args.c
+ * Command line arguments
+ * Github: https:\\github.com\tommojphillips
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "args.h"
+#include "altair8800.h"
+#include "console.h"
+#include "file.h"
+#include "snapshot.h"
+#include "trace.h"
+#include "profile.h"
+#include "replay.h"
+#include "bank.h"
+#include "metrics.h"
+
+static void reopen_console(ALTAIR8800* machine, const char* script, int raw) {
+	/* keep any capture file across the switch */
+	FILE* capture = machine->console.capture;
+	machine->console.capture = NULL;
+	console_destroy(&machine->console);
+	if (script == NULL || console_init_script(&machine->console, script, 1) != 0) {
+		console_init_host(&machine->console, raw);
+	}
+	else {
+		printf("SIO\t-> %s\n", script);
+	}
+	machine->console.capture = capture;
+}
+
+static int attach_console(CONSOLE* console, const char* backend) {
+	/* console, null, pty[:<link>], socket:<path> or file:<in>[,<out>]; keeps any capture file */
+	FILE* capture = console->capture;
+	console->capture = NULL;
+	console_destroy(console);
+
+	int status = 1;
+	if (strcmp("console", backend) == 0) {
+		status = console_init_host(console, 0);
+	}
+	else if (strcmp("null", backend) == 0) {
+		status = console_init_null(console);
+	}
+	else if (strncmp("pty", backend, 3) == 0 && (backend[3] == '\0' || backend[3] == ':')) {
+		status = console_init_pty(console, backend[3] == ':' ? backend + 4 : NULL);
+	}
+	else if (strncmp("socket:", backend, 7) == 0) {
+		status = console_init_socket(console, backend + 7);
+	}
+	else if (strncmp("file:", backend, 5) == 0) {
+		char input[CONSOLE_PATH] = { 0 };
+		const char* output = strchr(backend + 5, ',');
+		size_t len = output != NULL ? (size_t)(output - (backend + 5)) : strlen(backend + 5);
+		if (len < sizeof(input)) {
+			memcpy(input, backend + 5, len);
+			status = console_init_file(console, input, output != NULL ? output + 1 : NULL);
+		}
+	}
+	else {
+		printf("Error: unknown SIO backend: %s\n", backend);
+	}
+
+	if (status != 0) {
+		console_init_null(console);
+	}
+	console->capture = capture;
+	return status;
+}
+
+void args(ALTAIR8800* machine, int argc, char** argv, ARG_HANDLER handler) {
+	uint32_t offset = 0;
+	int rom = 0;
+	for (int i = 1; i < argc; ++i) {
+		size_t len = strlen(argv[i]);
+		for (size_t j = 0; j < len;) {
+			const char* arg = argv[i] + j;
+
+			if (handler != NULL && handler(machine, arg)) {
+				break;
+			}
+
+			if (strncmp("-o", arg, 2) == 0) {
+				char* end = NULL;
+				offset = strtol(arg + 2, &end, 16);
+				machine->cpu.pc = offset & 0xFFFF;
+				rom = strcmp(end, ",rom") == 0;
+				break;
+			}
+
+			if (strncmp("-m", arg, 2) == 0) {
+				offset = strtol(arg + 2, NULL, 16);
+				machine->cpu.pc = offset & 0xFFFF;
+				rom = 0;
+				break;
+			}
+
+			if (strncmp("-rbank:", arg, 7) == 0) {
+				/* <count>[,<size>[,<port>]] */
+				char* end;
+				uint32_t count = strtoul(arg + 7, &end, 10);
+				uint32_t size = BANK_DEFAULT_SIZE;
+				uint32_t port = BANK_DEFAULT_PORT;
+				if (*end == ',') {
+					size = strtoul(end + 1, &end, 16);
+				}
+				if (*end == ',') {
+					port = strtoul(end + 1, &end, 16) & 0xFF;
+				}
+				if (count < 2) {
+					printf("Error: expected -rbank:<count>[,<size>[,<port>]] with at least 2 banks: %s\n", arg);
+					machine->running = 0;
+					break;
+				}
+				if (bank_init(&machine->bank, &machine->memmap, machine->memory, (uint8_t)(count > 0xFF ? 0xFF : count), size) != 0) {
+					machine->running = 0;
+					break;
+				}
+				if (bank_register_io(&machine->bank, &machine->io, (uint8_t)port) != 0) {
+					machine->running = 0;
+					break;
+				}
+				printf("%u x %04X\t-> MEMORY BANKS ( port %02X )\n", count, size, port);
+				break;
+			}
+
+			if (strncmp("-r", arg, 2) == 0) {
+				uint32_t ram_size = strtol(arg + 2, NULL, 16);
+				if (ram_size > 0x10000) {
+					ram_size = 0x10000;
+				}
+				altair8800_map_ram(machine, ram_size);
+				printf("%04X\t-> RAMTOP\n", machine->ram_size);
+				break;
+			}
+
+			if (strncmp("-p", arg, 2) == 0) {
+				reopen_console(machine, NULL, 1);
+				break;
+			}
+
+			if (strncmp("-tmetrics:", arg, 10) == 0) {
+				/* <file>|unix:<path>[,<seconds>] */
+				char target[FILENAME_MAX];
+				snprintf(target, sizeof(target), "%s", arg + 10);
+				uint32_t period = METRICS_DEFAULT_PERIOD;
+				char* comma = strrchr(target, ',');
+				if (comma != NULL) {
+					*comma = '\0';
+					period = strtoul(comma + 1, NULL, 10);
+				}
+				if (metrics_open(&machine->metrics, target, period) != 0) {
+					machine->running = 0;
+					break;
+				}
+				printf("%s\t<- METRICS ( every %llu s )\n", target, (unsigned long long)(machine->metrics.period / 1000000));
+				break;
+			}
+
+			if (strncmp("-t", arg, 2) == 0) {
+				machine->timing.multiplier = strtol(arg + 2, NULL, 10);
+				if (machine->timing.multiplier == TIMING_TURBO) {
+					printf("TURBO\t-> CPU SPEED\n");
+				}
+				else {
+					printf("x%u\t-> CPU SPEED\n", machine->timing.multiplier);
+				}
+				break;
+			}
+
+			if (strncmp("-f", arg, 2) == 0) {
+				if (strcmp("rotate", arg + 2) == 0) {
+					/* sectors follow the machine clock; the sector pulse can interrupt */
+					machine->dcdd.rotate = 1;
+					dcdd_register_io(&machine->dcdd, &machine->io);
+					printf("ROTATE\t-> DISK TIMING\n");
+				}
+				else {
+					machine->disk_trap = 1;
+				}
+				break;
+			}
+
+			if (strncmp("-e", arg, 2) == 0) {
+				if (strcmp("jit", arg + 2) == 0) {
+					if (altair8800_set_engine(machine, ENGINE_JIT) == 0) {
+						printf("JIT\t-> CPU ENGINE\n");
+					}
+				}
+				else if (strcmp("predecode", arg + 2) == 0) {
+					if (altair8800_set_engine(machine, ENGINE_PREDECODE) == 0) {
+						printf("PREDEC\t-> CPU ENGINE\n");
+					}
+				}
+				else {
+					altair8800_set_engine(machine, ENGINE_INTERPRETER);
+					printf("INTERP\t-> CPU ENGINE\n");
+				}
+				break;
+			}
+
+			if (strncmp("-s", arg, 2) == 0) {
+				if (snapshot_load(machine, arg + 2) != 0) {
+					machine->running = 0;
+				}
+				break;
+			}
+
+			if (strncmp("-w", arg, 2) == 0) {
+				machine->snapshot = arg + 2;
+				printf("%s\t<- SNAPSHOT ON EXIT\n", arg + 2);
+				break;
+			}
+
+			if (strncmp("-u", arg, 2) == 0) {
+				/* record:<file> or replay:<file> */
+				int mode = REPLAY_OFF;
+				const char* filename = NULL;
+				if (strncmp("record:", arg + 2, 7) == 0) {
+					mode = REPLAY_RECORD;
+					filename = arg + 9;
+				}
+				else if (strncmp("replay:", arg + 2, 7) == 0) {
+					mode = REPLAY_PLAY;
+					filename = arg + 9;
+				}
+				else {
+					printf("Error: expected -urecord:<file> or -ureplay:<file>: %s\n", arg);
+					machine->running = 0;
+					break;
+				}
+				if (replay_open(&machine->replay, filename, mode, &machine->sched) != 0) {
+					machine->running = 0;
+					break;
+				}
+				machine->sio.replay = &machine->replay;
+				machine->sio_b.replay = &machine->replay;
+				printf(mode == REPLAY_RECORD ? "%s\t<- REPLAY\n" : "%s\t-> REPLAY\n", filename);
+				break;
+			}
+
+			if (strncmp("-x", arg, 2) == 0) {
+				machine->trace.filename = arg + 2;
+				if (!trace_enabled(&machine->trace) && trace_init(&machine->trace) != 0) {
+					break;
+				}
+				if (machine->engine != ENGINE_INTERPRETER) {
+					altair8800_set_engine(machine, ENGINE_INTERPRETER);
+					printf("INTERP\t-> CPU ENGINE\n");
+				}
+				printf("%s\t<- TRACE ON EXIT ( %u records )\n", arg + 2, machine->trace.mask + 1);
+				break;
+			}
+
+			if (strncmp("-y", arg, 2) == 0) {
+				machine->trace.size = strtoul(arg + 2, NULL, 10);
+				if (trace_enabled(&machine->trace)) {
+					trace_destroy(&machine->trace);
+					trace_init(&machine->trace);
+				}
+				break;
+			}
+
+			if (strncmp("-k", arg, 2) == 0) {
+				machine->trace.trigger = strtol(arg + 2, NULL, 16) & 0xFFFF;
+				printf("%04X\t-> TRACE TRIGGER\n", machine->trace.trigger);
+				break;
+			}
+
+			if (strncmp("-q", arg, 2) == 0) {
+				machine->profile.filename = arg + 2;
+				if (!profile_enabled(&machine->profile) && profile_init(&machine->profile) != 0) {
+					break;
+				}
+				if (machine->engine != ENGINE_INTERPRETER) {
+					altair8800_set_engine(machine, ENGINE_INTERPRETER);
+					printf("INTERP\t-> CPU ENGINE\n");
+				}
+				printf("%s\t<- PROFILE ON EXIT\n", arg + 2);
+				break;
+			}
+
+			if (strncmp("-g", arg, 2) == 0) {
+				profile_load_symbols(&machine->profile, arg + 2);
+				break;
+			}
+
+			if (strncmp("-b", arg, 2) == 0) {
+				if (altair8800_map_sio(machine, strtol(arg + 2, NULL, 16) & 0xFF) != 0) {
+					machine->running = 0;
+					break;
+				}
+				printf("%02X\t-> SIO BASE\n", machine->sio.base);
+				break;
+			}
+
+			if (strncmp("-z", arg, 2) == 0) {
+				if (sio_init(&machine->sio, strtoul(arg + 2, NULL, 10)) == 0) {
+					printf("%u\t-> SIO RX FIFO\n", machine->sio.rx_size);
+				}
+				break;
+			}
+
+			if (strncmp("-h", arg, 2) == 0) {
+				machine->sio.flow_control = 0;
+				printf("OFF\t-> SIO FLOW CONTROL\n");
+				break;
+			}
+
+			if (strncmp("-aterm", arg, 6) == 0) {
+				/* [:adm3a|:vt52] */
+				int type = SCREEN_ADM3A;
+				if (strcmp(":vt52", arg + 6) == 0) {
+					type = SCREEN_VT52;
+				}
+				else if (arg[6] != '\0' && strcmp(":adm3a", arg + 6) != 0) {
+					printf("Error: expected -aterm[:adm3a|:vt52]: %s\n", arg);
+					machine->running = 0;
+					break;
+				}
+				screen_init(&machine->screen, type);
+				machine->sio.screen = &machine->screen;
+				printf("%s\t-> SIO TERMINAL\n", type == SCREEN_VT52 ? "VT52" : "ADM-3A");
+				break;
+			}
+
+			if (strncmp("-a", arg, 2) == 0) {
+				if (attach_console(&machine->console, arg + 2) != 0) {
+					machine->running = 0;
+				}
+				break;
+			}
+
+			if (strncmp("-v", arg, 2) == 0) {
+				if (strcmp("fast", arg + 2) == 0) {
+					machine->sio_b.instant = 1;
+					printf("FAST\t-> SIO PORT B\n");
+				}
+				else if (attach_console(&machine->console_b, arg + 2) != 0) {
+					machine->running = 0;
+				}
+				break;
+			}
+
+			if (strncmp("-i", arg, 2) == 0) {
+				reopen_console(machine, arg + 2, 0);
+				break;
+			}
+
+			if (strncmp("-c", arg, 2) == 0) {
+				if (console_capture(&machine->console, arg + 2) == 0) {
+					printf("%s\t<- SIO\n", arg + 2);
+				}
+				break;
+			}
+
+			if (strncmp("-d", arg, 2) == 0) {
+				arg += 2; 
+				uint8_t disk = 0; 
+				if (arg[1] == ':') {
+					if ((arg[0] >= 'A' && arg[0] <= 'Z')) {
+						disk = arg[0] - 'A';
+					}
+					else if (arg[0] >= 'a' && arg[0] <= 'z') {
+						disk = arg[0] - 'a';
+					}
+					else {
+						disk = strtol(arg, NULL, 10) & 0xFF;
+					}
+					arg += 2;
+					disk &= 0xF; // map disk A-P (0-15)
+				}
+
+				if (dcdd_load_disk(&machine->dcdd, disk, arg) == 0) {
+					printf("%c:\t-> %s\n", 'A'+disk, arg);
+				}
+				break;
+			}
+
+			uint32_t file_size = 0;
+			if (read_file_into_buffer(arg, machine->memory, 0x10000, offset, &file_size, 0) == 0) {
+				altair8800_map_image(machine, offset & 0xFFFF, file_size, rom ? IMAGE_ROM : IMAGE_RAM);
+			}
+			offset += file_size;
+			break;
+		}
+	}
+}
@@ -0,0 +1,16 @@
+/* args.h
+ * Command line arguments
+ * Github: https:\\github.com\tommojphillips
+ */
+
+#ifndef ARGS_H
+#define ARGS_H
+
+#include "altair8800.h"
+
+/* return 1 if the argument was handled */
+typedef int (*ARG_HANDLER)(ALTAIR8800* machine, const char* arg);
+
+void args(ALTAIR8800* machine, int argc, char** argv, ARG_HANDLER handler);
+
+#endif
@@ -0,0 +1,112 @@
+/* bank.c
+ * Bank select memory board
+ * Github: https:\\github.com\tommojphillips
+ */
+
+ /* Up to BANK_MAX banks of RAM share the address space below bank->size (48K or 32K); the memory
+	above it is common and always visible, which is where banked CP/M 3 keeps its resident BIOS,
+	BDOS entry and buffers. Bank 0 is the machine's own 64K, so everything that only knows about
+	bank 0 (snapshots, replay hashes, loading images) keeps working.
+
+	Selecting a bank repoints the pages of the banked area at the bank's memory; nothing is copied.
+	Only RAM pages are repointed. ROM and unmapped pages stay as they are in every bank, so a boot
+	ROM in the banked area is still visible and memory above -r stays absent.
+
+ - BANK SELECT PORT (in/out, default 40h)
+
+	OUT - select bank <value>; a value past the last bank is ignored
+	IN  - the selected bank
+
+	The board powers up and resets to bank 0.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bank.h"
+#include "io.h"
+#include "memmap.h"
+
+int bank_init(BANK* bank, MEMMAP* map, uint8_t* memory, uint8_t count, uint32_t size) {
+	if (count > BANK_MAX) {
+		printf("Error: at most %u memory banks\n", BANK_MAX);
+		return 1;
+	}
+	if (size < BANK_MIN_SIZE || size > BANK_MAX_SIZE || (size & (MEMMAP_PAGE_SIZE - 1)) != 0) {
+		printf("Error: bad memory bank size %X\n", size);
+		return 1;
+	}
+	uint8_t* banks = NULL;
+	if (count > 1) {
+		banks = (uint8_t*)calloc(count - 1, size);
+		if (banks == NULL) {
+			printf("Failed to allocate memory banks\n");
+			return 1;
+		}
+	}
+	bank_reset(bank);
+	free(bank->banks);
+	bank->banks = banks;
+	bank->count = count;
+	bank->size = size;
+	bank->memory = memory;
+	bank->map = map;
+	bank->selected = 0;
+	return 0;
+}
+void bank_free(BANK* bank) {
+	free(bank->banks);
+	bank->banks = NULL;
+	bank->count = 0;
+}
+void bank_reset(BANK* bank) {
+	bank_select(bank, 0);
+}
+
+uint8_t* bank_memory(BANK* bank, uint8_t n) {
+	if (n == 0) {
+		return bank->memory;
+	}
+	return bank->banks + (uint32_t)(n - 1) * bank->size;
+}
+
+void bank_select(BANK* bank, uint8_t selected) {
+	if (selected >= bank->count || selected == bank->selected) {
+		return;
+	}
+	uint8_t* memory = bank_memory(bank, selected);
+	for (uint32_t i = 0; i < (bank->size >> 8); ++i) {
+		/* RAM, or RAM the JIT has write protected; never ROM or unmapped pages */
+		uint8_t flags = bank->map->pages[i].flags;
+		if (flags == PAGE_UNMAPPED || flags == PAGE_ROM) {
+			continue;
+		}
+		memmap_map(bank->map, (uint16_t)(i << 8), MEMMAP_PAGE_SIZE, memory + (i << 8), PAGE_RAM);
+	}
+	bank->selected = selected;
+	bank->switches++;
+}
+
+static uint8_t in_select(void* context, uint8_t port) {
+	return ((BANK*)context)->selected;
+}
+static void out_select(void* context, uint8_t port, uint8_t value) {
+	bank_select((BANK*)context, value);
+}
+
+int bank_register_io(BANK* bank, IO* io, uint8_t port) {
+	if (!io_available(io, port, bank)) {
+		printf("Error: bank select port %02X is already in use\n", port);
+		return 1;
+	}
+	if (bank->io != NULL) {
+		io_release(bank->io, bank->port, bank);
+	}
+	bank->io = io;
+	bank->port = port;
+	io_register_read(io, port, in_select, bank, 1);
+	io_register_write(io, port, out_select, bank);
+	return 0;
+}
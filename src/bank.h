@@ -0,0 +1,40 @@
+/* bank.h
+ * Bank select memory board
+ * Github: https:\\github.com\tommojphillips
+ */
+
+#ifndef BANK_H
+#define BANK_H
+
+#include <stdint.h>
+
+#include "io.h"
+#include "memmap.h"
+
+#define BANK_MAX           16     // banks, including bank 0
+#define BANK_DEFAULT_PORT  0x40   // bank select port (in/out)
+#define BANK_DEFAULT_SIZE  0xC000 // banked memory from address 0; 48K, the 16K above is common
+#define BANK_MIN_SIZE      0x1000
+#define BANK_MAX_SIZE      0xF000
+
+typedef struct {
+	uint8_t count;     // banks; 0 when there is no board
+	uint8_t selected;  // bank mapped from address 0
+	uint32_t size;     // banked memory from address 0; the memory above is common to every bank
+	uint8_t port;      // bank select port
+	uint8_t* memory;   // bank 0; the machine's 64K
+	uint8_t* banks;    // banks 1 to count - 1, size bytes each
+	MEMMAP* map;
+	IO* io;            // bus the port is registered on
+	uint64_t switches; // selects that changed the bank
+} BANK;
+
+int bank_init(BANK* bank, MEMMAP* map, uint8_t* memory, uint8_t count, uint32_t size);
+void bank_free(BANK* bank);
+void bank_reset(BANK* bank);
+int bank_register_io(BANK* bank, IO* io, uint8_t port);
+
+void bank_select(BANK* bank, uint8_t selected);
+uint8_t* bank_memory(BANK* bank, uint8_t n);
+
+#endif
@@ -0,0 +1,103 @@
+/* bench.c
+ * Headless benchmark harness
+ * Github: https:\\github.com\tommojphillips
+ */
+
+ /* Runs the machine in turbo with a scripted console and reports one JSON line:
+
+	{"name":"boot","status":"ok","instructions":0,"cycles":0,"idle_cycles":0,"wall_s":0.000,"ips":0,"cps":0,"mhz":0.00}
+
+	status is "ok" when the script ran to the end and "timeout" when the time limit was hit.
+	cycles are the cycles actually executed; idle_cycles were skipped while the guest waited on a device.
+
+	Options (plus all altair options)
+		-n<name>     workload name
+		-l<seconds>  wall-clock time limit (default 300)
+		-j<file>     append the result to <file> instead of printing it
+		-i<script>   script file; guest output is not echoed
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "altair8800.h"
+#include "args.h"
+#include "console.h"
+#include "timing.h"
+#include "file.h"
+
+#define BENCH_TIME_LIMIT 300 // seconds
+
+static const char* name = "bench";
+static const char* json = NULL;
+static uint64_t time_limit = BENCH_TIME_LIMIT * 1000000ULL;
+
+static int bench_args(ALTAIR8800* altair, const char* arg) {
+	if (strncmp("-n", arg, 2) == 0) {
+		name = arg + 2;
+		return 1;
+	}
+
+	if (strncmp("-l", arg, 2) == 0) {
+		time_limit = strtoul(arg + 2, NULL, 10) * 1000000ULL;
+		return 1;
+	}
+
+	if (strncmp("-j", arg, 2) == 0) {
+		json = arg + 2;
+		return 1;
+	}
+
+	if (strncmp("-i", arg, 2) == 0) {
+		FILE* capture = altair->console.capture;
+		altair->console.capture = NULL;
+		console_destroy(&altair->console);
+		if (console_init_script(&altair->console, arg + 2, 0) != 0) {
+			exit(1);
+		}
+		altair->console.capture = capture;
+		return 1;
+	}
+
+	return 0;
+}
+
+int main(int argc, char** argv) {
+	ALTAIR8800* altair = altair8800_create();
+	if (altair == NULL) {
+		return 1;
+	}
+	altair->timing.multiplier = TIMING_TURBO;
+	args(altair, argc, argv, bench_args);
+
+	uint64_t start = timing_now();
+	uint64_t elapsed = 0;
+	while (altair->running && elapsed < time_limit) {
+		altair8800_step(altair);
+		elapsed = timing_now() - start;
+	}
+
+	double wall = elapsed / 1000000.0;
+	uint64_t cycles = altair->timing.total_cycles - altair->idle.skipped;
+	FILE* out = stdout;
+	if (json != NULL) {
+		fopen_s(&out, json, "ab");
+		if (out == NULL) {
+			printf("Failed to open result file: %s\n", json);
+			out = stdout;
+		}
+	}
+	fprintf(out, "{\"name\":\"%s\",\"status\":\"%s\",\"instructions\":%llu,\"cycles\":%llu,\"idle_cycles\":%llu,\"wall_s\":%.3f,\"ips\":%.0f,\"cps\":%.0f,\"mhz\":%.2f}\n",
+		name, altair->console.done ? "ok" : "timeout",
+		(unsigned long long)altair->instructions, (unsigned long long)cycles, (unsigned long long)altair->idle.skipped, wall,
+		wall > 0 ? altair->instructions / wall : 0.0, wall > 0 ? cycles / wall : 0.0, wall > 0 ? cycles / wall / 1000000.0 : 0.0);
+	if (out != stdout) {
+		fclose(out);
+	}
+
+	int status = altair->console.done ? 0 : 1;
+	altair8800_destroy(altair);
+	return status;
+}
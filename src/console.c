@@ -0,0 +1,297 @@
+/* console.c
+ * Host console - terminal attached to SIO
+ * Github: https:\\github.com\tommojphillips
+ */
+
+ /* Backends
+	- host:   the terminal the emulator was started from. conio on windows, termios elsewhere.
+	- script: headless; input is fed from a script file, see console_script.c.
+	- null:   no input; output only goes to the capture file, if any.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <conio.h>
+#else
+#include <errno.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
+
+#include "console.h"
+#include "file.h"
+
+int console_kbhit(CONSOLE* console) {
+	return console->kbhit(console);
+}
+int console_getch(CONSOLE* console) {
+	return console->getch(console);
+}
+void console_putch(CONSOLE* console, char ch) {
+	console->putch(console, ch);
+	if (console->capture != NULL) {
+		fputc(ch, console->capture);
+	}
+}
+void console_write(CONSOLE* console, const char* data, size_t len) {
+	console_display(console, data, len);
+	console_record(console, data, len);
+}
+void console_display(CONSOLE* console, const char* data, size_t len) {
+	if (console->write != NULL) {
+		console->write(console, data, len);
+	}
+	else {
+		for (size_t i = 0; i < len; ++i) {
+			console->putch(console, data[i]);
+		}
+	}
+}
+void console_record(CONSOLE* console, const char* data, size_t len) {
+	if (console->capture != NULL) {
+		fwrite(data, 1, len, console->capture);
+	}
+}
+int console_wait(CONSOLE* console, uint32_t timeout_us) {
+	return console->wait(console, timeout_us);
+}
+
+int console_capture(CONSOLE* console, const char* filename) {
+	if (console->capture != NULL) {
+		fclose(console->capture);
+		console->capture = NULL;
+	}
+	fopen_s(&console->capture, filename, "wb");
+	if (console->capture == NULL) {
+		printf("Failed to open capture file: %s\n", filename);
+		return 1;
+	}
+	return 0;
+}
+void console_destroy(CONSOLE* console) {
+	if (console->destroy != NULL) {
+		console->destroy(console);
+	}
+	if (console->capture != NULL) {
+		fclose(console->capture);
+	}
+	memset(console, 0, sizeof(CONSOLE));
+}
+
+#ifdef _WIN32
+
+typedef struct {
+	HANDLE input;
+	DWORD mode; // console mode to restore
+} HOST;
+
+static int host_kbhit(CONSOLE* console) {
+	return _kbhit();
+}
+static int host_getch(CONSOLE* console) {
+	return _getch();
+}
+static void host_putch(CONSOLE* console, char ch) {
+	if (ch == 0x08) {
+		printf("\b");
+	}
+	else {
+		printf("%c", ch);
+	}
+}
+static void host_write(CONSOLE* console, const char* data, size_t len) {
+	fwrite(data, 1, len, stdout);
+}
+static int host_wait(CONSOLE* console, uint32_t timeout_us) {
+	HOST* host = (HOST*)console->data;
+	return WaitForSingleObject(host->input, timeout_us / 1000) == WAIT_OBJECT_0;
+}
+static void host_destroy(CONSOLE* console) {
+	HOST* host = (HOST*)console->data;
+	SetConsoleMode(host->input, host->mode);
+	free(host);
+}
+
+static void host_init(HOST* host, int raw) {
+	host->input = GetStdHandle(STD_INPUT_HANDLE);
+	GetConsoleMode(host->input, &host->mode);
+	if (raw) {
+		/* pass ctrl-c through to the guest */
+		SetConsoleMode(host->input, host->mode & ~ENABLE_PROCESSED_INPUT);
+	}
+}
+
+#else
+
+#define HOST_INPUT 256 // bytes taken from stdin per read
+
+typedef struct {
+	struct termios mode; // terminal mode to restore
+	int tty;             // stdin is a terminal
+	uint8_t input[HOST_INPUT]; // read from stdin, not yet taken by the guest
+	size_t input_len;
+	size_t input_pos;
+	int eof;             // stdin reached its end or failed; it is not polled again
+} HOST;
+
+static int host_kbhit(CONSOLE* console) {
+	HOST* host = (HOST*)console->data;
+	if (host->input_pos >= host->input_len) {
+		/* one read for everything that is waiting, eg a paste */
+		struct pollfd fd = { STDIN_FILENO, POLLIN, 0 };
+		host->input_pos = 0;
+		host->input_len = 0;
+		if (!host->eof && poll(&fd, 1, 0) > 0) {
+			ssize_t n = read(STDIN_FILENO, host->input, sizeof(host->input));
+			if (n > 0) {
+				host->input_len = n;
+			}
+			else if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+				/* a file or a closed pipe polls readable forever */
+				host->eof = 1;
+				console->fd = -1;
+			}
+		}
+	}
+	return host->input_pos < host->input_len;
+}
+static int host_getch(CONSOLE* console) {
+	HOST* host = (HOST*)console->data;
+	if (host->input_pos >= host->input_len) {
+		return -1;
+	}
+	return host->input[host->input_pos++];
+}
+static void host_putch(CONSOLE* console, char ch) {
+	putchar(ch);
+}
+static void host_write(CONSOLE* console, const char* data, size_t len) {
+	/* one write per flush of the SIO transmit buffer */
+	fflush(stdout);
+	while (len > 0) {
+		ssize_t n = write(STDOUT_FILENO, data, len);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				/* stdout is non-blocking and full; wait for the terminal to catch up */
+				struct pollfd fd = { STDOUT_FILENO, POLLOUT, 0 };
+				poll(&fd, 1, -1);
+				continue;
+			}
+			return;
+		}
+		data += n;
+		len -= n;
+	}
+}
+static int host_wait(CONSOLE* console, uint32_t timeout_us) {
+	HOST* host = (HOST*)console->data;
+	fflush(stdout);
+	if (host->input_pos < host->input_len) {
+		return 1;
+	}
+	if (host->eof) {
+		/* nothing will arrive; just sleep */
+		poll(NULL, 0, timeout_us / 1000);
+		return 0;
+	}
+	struct pollfd fd = { STDIN_FILENO, POLLIN, 0 };
+	if (poll(&fd, 1, timeout_us / 1000) <= 0) {
+		return 0;
+	}
+	if (fd.revents & (POLLERR | POLLNVAL)) {
+		host->eof = 1;
+		console->fd = -1;
+		return 0;
+	}
+	/* a hang up with no data left is left for host_kbhit to read as the end of input */
+	return (fd.revents & (POLLIN | POLLHUP)) != 0;
+}
+static void host_destroy(CONSOLE* console) {
+	HOST* host = (HOST*)console->data;
+	fflush(stdout);
+	if (host->tty) {
+		tcsetattr(STDIN_FILENO, TCSANOW, &host->mode);
+	}
+	free(host);
+}
+
+static void host_init(HOST* host, int raw) {
+	host->input_len = 0;
+	host->input_pos = 0;
+	host->eof = 0;
+	host->tty = isatty(STDIN_FILENO);
+	if (host->tty) {
+		struct termios mode;
+		tcgetattr(STDIN_FILENO, &host->mode);
+		mode = host->mode;
+		mode.c_lflag &= ~(ICANON | ECHO);
+		if (raw) {
+			/* pass ctrl-c through to the guest */
+			mode.c_lflag &= ~ISIG;
+		}
+		mode.c_iflag &= ~ICRNL;
+		mode.c_cc[VMIN] = 0;
+		mode.c_cc[VTIME] = 0;
+		tcsetattr(STDIN_FILENO, TCSANOW, &mode);
+	}
+}
+
+#endif
+
+int console_init_host(CONSOLE* console, int raw) {
+	HOST* host = (HOST*)malloc(sizeof(HOST));
+	if (host == NULL) {
+		return 1;
+	}
+	host_init(host, raw);
+
+	console->kbhit = host_kbhit;
+	console->getch = host_getch;
+	console->putch = host_putch;
+	console->write = host_write;
+	console->wait = host_wait;
+	console->destroy = host_destroy;
+	console->data = host;
+#ifdef _WIN32
+	console->fd = -1;
+#else
+	console->fd = STDIN_FILENO;
+#endif
+	console->done = 0;
+	return 0;
+}
+
+static int null_kbhit(CONSOLE* console) {
+	return 0;
+}
+static int null_getch(CONSOLE* console) {
+	return 0;
+}
+static void null_putch(CONSOLE* console, char ch) {
+
+}
+static int null_wait(CONSOLE* console, uint32_t timeout_us) {
+	return 0;
+}
+
+int console_init_null(CONSOLE* console) {
+	console->kbhit = null_kbhit;
+	console->getch = null_getch;
+	console->putch = null_putch;
+	console->write = NULL;
+	console->wait = null_wait;
+	console->destroy = NULL;
+	console->data = NULL;
+	console->fd = -1;
+	console->done = 0;
+	return 0;
+}
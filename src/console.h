@@ -0,0 +1,49 @@
+/* console.h
+ * Host console - terminal attached to SIO
+ * Github: https:\\github.com\tommojphillips
+ */
+
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define CONSOLE_PATH 260
+
+typedef struct CONSOLE {
+	int (*kbhit)(struct CONSOLE* console);
+	int (*getch)(struct CONSOLE* console);
+	void (*putch)(struct CONSOLE* console, char ch);
+	void (*write)(struct CONSOLE* console, const char* data, size_t len); // bulk output, or NULL to use putch
+	int (*wait)(struct CONSOLE* console, uint32_t timeout_us);
+	void (*destroy)(struct CONSOLE* console);
+	void* data;    // backend state
+	int fd;        // descriptor that becomes readable when input arrives, or -1
+	FILE* capture; // copy of all output, or NULL
+	int done;      // input is exhausted; the machine should stop
+	char snapshot[CONSOLE_PATH]; // save a snapshot here at the end of the frame, or empty
+	char trace[CONSOLE_PATH];    // dump the trace ring here at the end of the frame, or empty
+	char disk[CONSOLE_PATH];     // overlay disk commands to run at the end of the frame, one per line, or empty
+} CONSOLE;
+
+int console_init_host(CONSOLE* console, int raw);
+int console_init_null(CONSOLE* console);
+int console_init_script(CONSOLE* console, const char* filename, int echo);
+int console_init_script_file(CONSOLE* console, FILE* file, int echo);
+int console_init_pty(CONSOLE* console, const char* link);
+int console_init_socket(CONSOLE* console, const char* path);
+int console_init_file(CONSOLE* console, const char* input, const char* output);
+int console_capture(CONSOLE* console, const char* filename);
+void console_destroy(CONSOLE* console);
+
+int console_kbhit(CONSOLE* console);
+int console_getch(CONSOLE* console);
+void console_putch(CONSOLE* console, char ch);
+void console_write(CONSOLE* console, const char* data, size_t len);
+void console_display(CONSOLE* console, const char* data, size_t len); // the device only; not captured
+void console_record(CONSOLE* console, const char* data, size_t len);  // the capture file only
+int console_wait(CONSOLE* console, uint32_t timeout_us);
+
+#endif
@@ -0,0 +1,349 @@
+/* console_fd.c
+ * Descriptor consoles - SIO attached to a PTY, a unix socket or files
+ * Github: https:\\github.com\tommojphillips
+ */
+
+ /* All three backends read and write non-blocking descriptors, and publish the descriptor
+	that becomes readable on input in console->fd so one event loop can wait on many machines.
+
+		pty     a pseudo terminal; connect a terminal program to the slave path (eg screen, minicom).
+		        With a link, the slave path is also symlinked there. The slave is kept open
+		        so the master never hangs up while nobody is attached.
+		socket  a listening unix socket; one client at a time. Output is dropped while no client
+		        is connected. When the client goes away the socket listens again.
+		file    input from a file, fifo or "-" (stdin); output to a file or "-" (stdout, the default).
+		        The end of the input does not stop the machine.
+
+	Output that the other side is not reading is dropped rather than stalling the machine.
+ */
+
+#ifndef _WIN32
+#define _GNU_SOURCE // posix_openpt, cfmakeraw
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "console.h"
+
+#ifdef _WIN32
+
+int console_init_pty(CONSOLE* console, const char* link) {
+	printf("Error: pty consoles need a POSIX host\n");
+	return 1;
+}
+int console_init_socket(CONSOLE* console, const char* path) {
+	printf("Error: socket consoles need a POSIX host\n");
+	return 1;
+}
+int console_init_file(CONSOLE* console, const char* input, const char* output) {
+	printf("Error: file consoles need a POSIX host\n");
+	return 1;
+}
+
+#else
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#define FD_CONSOLE_INPUT 256 // bytes taken per read
+
+typedef struct {
+	int in;         // input descriptor, or -1
+	int out;        // output descriptor, or -1
+	int listener;   // socket: listening descriptor, or -1
+	int slave;      // pty: slave kept open, or -1
+	char* unlink;   // path removed on destroy, or NULL
+	uint8_t input[FD_CONSOLE_INPUT];
+	size_t input_len;
+	size_t input_pos;
+} FD_CONSOLE;
+
+static void set_nonblocking(int fd) {
+	int flags = fcntl(fd, F_GETFL, 0);
+	if (flags >= 0) {
+		fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+	}
+}
+
+static void socket_disconnect(CONSOLE* console) {
+	/* back to listening */
+	FD_CONSOLE* con = (FD_CONSOLE*)console->data;
+	close(con->in);
+	con->in = -1;
+	con->out = -1;
+	console->fd = con->listener;
+}
+
+static int socket_accept(CONSOLE* console) {
+	FD_CONSOLE* con = (FD_CONSOLE*)console->data;
+	int client = accept(con->listener, NULL, NULL);
+	if (client < 0) {
+		return 0;
+	}
+	set_nonblocking(client);
+	con->in = client;
+	con->out = client;
+	console->fd = client;
+	return 1;
+}
+
+static int fd_kbhit(CONSOLE* console) {
+	FD_CONSOLE* con = (FD_CONSOLE*)console->data;
+	if (con->input_pos < con->input_len) {
+		return 1;
+	}
+	if (con->in < 0 && (con->listener < 0 || !socket_accept(console))) {
+		return 0;
+	}
+	con->input_pos = 0;
+	con->input_len = 0;
+	if (con->in == STDIN_FILENO) {
+		/* stdin is shared with the host and left blocking; only read what is there */
+		struct pollfd fd = { STDIN_FILENO, POLLIN, 0 };
+		if (poll(&fd, 1, 0) <= 0) {
+			return 0;
+		}
+	}
+	ssize_t n = read(con->in, con->input, sizeof(con->input));
+	if (n > 0) {
+		con->input_len = n;
+	}
+	else if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+		if (con->listener >= 0) {
+			socket_disconnect(console);
+		}
+		else if (con->slave < 0) {
+			/* end of the input file; nothing more to wait for */
+			if (con->in != STDIN_FILENO) {
+				close(con->in);
+			}
+			con->in = -1;
+			console->fd = -1;
+		}
+	}
+	return con->input_pos < con->input_len;
+}
+static int fd_getch(CONSOLE* console) {
+	FD_CONSOLE* con = (FD_CONSOLE*)console->data;
+	if (con->input_pos >= con->input_len) {
+		return -1;
+	}
+	return con->input[con->input_pos++];
+}
+static void fd_write(CONSOLE* console, const char* data, size_t len) {
+	FD_CONSOLE* con = (FD_CONSOLE*)console->data;
+	if (con->out < 0) {
+		return;
+	}
+	if (con->out == STDOUT_FILENO) {
+		fflush(stdout);
+	}
+	while (len > 0) {
+		ssize_t n = write(con->out, data, len);
+		if (n > 0) {
+			data += n;
+			len -= n;
+			continue;
+		}
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n < 0 && errno != EAGAIN && con->listener >= 0) {
+			socket_disconnect(console);
+		}
+		/* nobody is reading; drop the rest */
+		break;
+	}
+}
+static void fd_putch(CONSOLE* console, char ch) {
+	fd_write(console, &ch, 1);
+}
+static int fd_wait(CONSOLE* console, uint32_t timeout_us) {
+	FD_CONSOLE* con = (FD_CONSOLE*)console->data;
+	if (con->input_pos < con->input_len) {
+		return 1;
+	}
+	if (console->fd < 0) {
+		/* the input has ended; nothing will arrive */
+		poll(NULL, 0, timeout_us / 1000);
+		return 0;
+	}
+	struct pollfd fd = { console->fd, POLLIN, 0 };
+	return poll(&fd, 1, timeout_us / 1000) > 0;
+}
+static void fd_destroy(CONSOLE* console) {
+	FD_CONSOLE* con = (FD_CONSOLE*)console->data;
+	if (con->in >= 0 && con->in != STDIN_FILENO) {
+		close(con->in);
+	}
+	if (con->out >= 0 && con->out != con->in && con->out != STDOUT_FILENO) {
+		close(con->out);
+	}
+	if (con->listener >= 0) {
+		close(con->listener);
+	}
+	if (con->slave >= 0) {
+		close(con->slave);
+	}
+	if (con->unlink != NULL) {
+		unlink(con->unlink);
+		free(con->unlink);
+	}
+	free(con);
+}
+
+static FD_CONSOLE* fd_create(CONSOLE* console) {
+	FD_CONSOLE* con = (FD_CONSOLE*)malloc(sizeof(FD_CONSOLE));
+	if (con == NULL) {
+		return NULL;
+	}
+	memset(con, 0, sizeof(FD_CONSOLE));
+	con->in = -1;
+	con->out = -1;
+	con->listener = -1;
+	con->slave = -1;
+
+	console->kbhit = fd_kbhit;
+	console->getch = fd_getch;
+	console->putch = fd_putch;
+	console->write = fd_write;
+	console->wait = fd_wait;
+	console->destroy = fd_destroy;
+	console->data = con;
+	console->done = 0;
+	console->fd = -1;
+	return con;
+}
+static int fd_fail(CONSOLE* console) {
+	fd_destroy(console);
+	console->destroy = NULL;
+	console->data = NULL;
+	return 1;
+}
+
+int console_init_pty(CONSOLE* console, const char* link) {
+	FD_CONSOLE* con = fd_create(console);
+	if (con == NULL) {
+		return 1;
+	}
+
+	int master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+		printf("Error: could not open a pty\n");
+		if (master >= 0) {
+			close(master);
+		}
+		return fd_fail(console);
+	}
+	set_nonblocking(master);
+	con->in = master;
+	con->out = master;
+	console->fd = master;
+
+	const char* name = ptsname(master);
+	con->slave = name != NULL ? open(name, O_RDWR | O_NOCTTY) : -1;
+	if (con->slave < 0) {
+		printf("Error: could not open the pty slave\n");
+		return fd_fail(console);
+	}
+
+	/* the guest sees raw bytes */
+	struct termios mode;
+	if (tcgetattr(con->slave, &mode) == 0) {
+		cfmakeraw(&mode);
+		tcsetattr(con->slave, TCSANOW, &mode);
+	}
+
+	if (link != NULL && link[0] != '\0') {
+		unlink(link);
+		if (symlink(name, link) != 0) {
+			printf("Error: could not link %s to %s\n", link, name);
+			return fd_fail(console);
+		}
+		con->unlink = strdup(link);
+		printf("%s\t<- SIO ( %s )\n", link, name);
+	}
+	else {
+		printf("%s\t<- SIO\n", name);
+	}
+	return 0;
+}
+
+int console_init_socket(CONSOLE* console, const char* path) {
+	struct sockaddr_un addr = { 0 };
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		printf("Error: socket path is too long: %s\n", path);
+		return 1;
+	}
+	strcpy(addr.sun_path, path);
+
+	FD_CONSOLE* con = fd_create(console);
+	if (con == NULL) {
+		return 1;
+	}
+	con->listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (con->listener < 0) {
+		printf("Error: could not create socket\n");
+		return fd_fail(console);
+	}
+	unlink(path);
+	if (bind(con->listener, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(con->listener, 1) != 0) {
+		printf("Error: could not listen on %s\n", path);
+		return fd_fail(console);
+	}
+	set_nonblocking(con->listener);
+	con->unlink = strdup(path);
+	console->fd = con->listener;
+	printf("%s\t<- SIO\n", path);
+	return 0;
+}
+
+int console_init_file(CONSOLE* console, const char* input, const char* output) {
+	FD_CONSOLE* con = fd_create(console);
+	if (con == NULL) {
+		return 1;
+	}
+
+	if (strcmp(input, "-") == 0) {
+		con->in = STDIN_FILENO;
+	}
+	else {
+		/* a fifo is opened for writing too so it never reads end of file between writers */
+		struct stat info;
+		int mode = stat(input, &info) == 0 && S_ISFIFO(info.st_mode) ? O_RDWR : O_RDONLY;
+		con->in = open(input, mode | O_NONBLOCK);
+		if (con->in < 0) {
+			printf("Failed to open input file: %s\n", input);
+			return fd_fail(console);
+		}
+	}
+	console->fd = con->in;
+
+	if (output == NULL || strcmp(output, "-") == 0) {
+		con->out = STDOUT_FILENO;
+	}
+	else {
+		con->out = open(output, O_WRONLY | O_CREAT | O_TRUNC | O_NONBLOCK, 0644);
+		if (con->out < 0) {
+			printf("Failed to open output file: %s\n", output);
+			return fd_fail(console);
+		}
+	}
+	printf("%s\t-> SIO\n", input);
+	if (output != NULL) {
+		printf("%s\t<- SIO\n", output);
+	}
+	return 0;
+}
+
+#endif
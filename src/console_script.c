@@ -0,0 +1,222 @@
+/* console_script.c
+ * Headless console - SIO input is fed from a script file
+ * Github: https:\\github.com\tommojphillips
+ */
+
+ /* SCRIPT FILE
+	One command per line. Blank lines and lines starting with '#' are ignored.
+
+		wait <text>   wait until the guest prints <text>
+		send <text>   type <text>
+		save <file>   save a snapshot of the machine to <file>
+		trace <file>  dump the trace ring to <file> (-x)
+		discard <X>   drop the delta of overlay disk <X> (see dcdd_overlay.c)
+		commit <X>    write the delta of overlay disk <X> into its base image
+		delta <X> <file>  write the delta of overlay disk <X> to <file>
+		quit          stop the machine
+
+	<text> may contain the escapes \r \n \e (ESC) \\ and \xHH.
+	The machine also stops when the end of the script is reached.
+
+	e.g.
+		wait A>
+		send DIR\r
+		wait A>
+		quit
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "console.h"
+#include "file.h"
+
+#define SCRIPT_LINE 256
+
+typedef struct {
+	FILE* file;
+	int echo;                 // print guest output to stdout
+	char send[SCRIPT_LINE];   // text to type
+	size_t send_len;
+	size_t send_pos;
+	char match[SCRIPT_LINE];  // text to wait for
+	size_t match_len;
+	size_t match_pos;
+	size_t match_next[SCRIPT_LINE]; // longest proper prefix of match that is also a suffix of match[0..i]
+} SCRIPT;
+
+static size_t unescape(char* dst, const char* src) {
+	size_t len = 0;
+	while (*src != '\0' && *src != '\n' && *src != '\r' && len < SCRIPT_LINE) {
+		if (*src != '\\') {
+			dst[len++] = *src++;
+			continue;
+		}
+		src++;
+		switch (*src) {
+			case 'r':  dst[len++] = '\r'; src++; break;
+			case 'n':  dst[len++] = '\n'; src++; break;
+			case 'e':  dst[len++] = 0x1B; src++; break;
+			case '\\': dst[len++] = '\\'; src++; break;
+			case 'x': {
+				char hex[3] = { 0 };
+				strncpy(hex, src + 1, 2);
+				dst[len++] = (char)strtol(hex, NULL, 16);
+				src += 1 + strlen(hex);
+			} break;
+			default:
+				dst[len++] = '\\';
+				break;
+		}
+	}
+	return len;
+}
+
+static void match_prepare(SCRIPT* script) {
+	/* prefix table, so a mismatch falls back to the longest prefix the output still ends with;
+	   "AAB" is then found in "AAAB" */
+	size_t k = 0;
+	script->match_next[0] = 0;
+	for (size_t i = 1; i < script->match_len; ++i) {
+		while (k > 0 && script->match[i] != script->match[k]) {
+			k = script->match_next[k - 1];
+		}
+		if (script->match[i] == script->match[k]) {
+			k++;
+		}
+		script->match_next[i] = k;
+	}
+	script->match_pos = 0;
+}
+
+static void script_next(CONSOLE* console) {
+	/* arm the next command */
+	SCRIPT* script = (SCRIPT*)console->data;
+	char line[SCRIPT_LINE];
+	while (fgets(line, sizeof(line), script->file) != NULL) {
+		if (strncmp(line, "wait ", 5) == 0) {
+			script->match_len = unescape(script->match, line + 5);
+			match_prepare(script);
+			return;
+		}
+		if (strncmp(line, "send ", 5) == 0) {
+			script->send_len = unescape(script->send, line + 5);
+			script->send_pos = 0;
+			return;
+		}
+		if (strncmp(line, "save ", 5) == 0) {
+			line[strcspn(line, "\r\n")] = '\0';
+			strncpy(console->snapshot, line + 5, CONSOLE_PATH - 1);
+			continue;
+		}
+		if (strncmp(line, "trace ", 6) == 0) {
+			line[strcspn(line, "\r\n")] = '\0';
+			strncpy(console->trace, line + 6, CONSOLE_PATH - 1);
+			continue;
+		}
+		if (strncmp(line, "discard ", 8) == 0 || strncmp(line, "commit ", 7) == 0 || strncmp(line, "delta ", 6) == 0) {
+			/* queued for the machine; the controller is not ours */
+			size_t queued = strlen(console->disk);
+			size_t len = strcspn(line, "\r\n");
+			if (queued + len + 2 > CONSOLE_PATH) {
+				printf("Error: too many disk commands in a row: %s", line);
+				continue;
+			}
+			memcpy(console->disk + queued, line, len);
+			memcpy(console->disk + queued + len, "\n", 2);
+			continue;
+		}
+		if (strncmp(line, "quit", 4) == 0) {
+			break;
+		}
+		if (line[0] != '#' && line[0] != '\n' && line[0] != '\r') {
+			printf("Unknown script command: %s", line);
+		}
+	}
+	console->done = 1;
+}
+
+static int script_kbhit(CONSOLE* console) {
+	SCRIPT* script = (SCRIPT*)console->data;
+	return script->match_len == 0 && script->send_pos < script->send_len;
+}
+static int script_getch(CONSOLE* console) {
+	SCRIPT* script = (SCRIPT*)console->data;
+	if (script->send_pos >= script->send_len) {
+		return 0;
+	}
+	char ch = script->send[script->send_pos++];
+	if (script->send_pos >= script->send_len) {
+		script->send_len = 0;
+		script_next(console);
+	}
+	return (uint8_t)ch;
+}
+static void script_putch(CONSOLE* console, char ch) {
+	SCRIPT* script = (SCRIPT*)console->data;
+	if (script->echo) {
+		putchar(ch);
+	}
+	if (script->match_len != 0) {
+		while (script->match_pos > 0 && ch != script->match[script->match_pos]) {
+			script->match_pos = script->match_next[script->match_pos - 1];
+		}
+		if (ch == script->match[script->match_pos]) {
+			script->match_pos++;
+		}
+		if (script->match_pos >= script->match_len) {
+			script->match_len = 0;
+			script_next(console);
+		}
+	}
+}
+static int script_wait(CONSOLE* console, uint32_t timeout_us) {
+	/* headless; never sleep */
+	return script_kbhit(console);
+}
+static void script_destroy(CONSOLE* console) {
+	SCRIPT* script = (SCRIPT*)console->data;
+	if (script->echo) {
+		fflush(stdout);
+	}
+	fclose(script->file);
+	free(script);
+}
+
+int console_init_script(CONSOLE* console, const char* filename, int echo) {
+	FILE* file = NULL;
+	fopen_s(&file, filename, "rb");
+	if (file == NULL) {
+		printf("Failed to open script file: %s\n", filename);
+		return 1;
+	}
+	if (console_init_script_file(console, file, echo) != 0) {
+		fclose(file);
+		return 1;
+	}
+	return 0;
+}
+int console_init_script_file(CONSOLE* console, FILE* file, int echo) {
+	/* the console owns <file> once this succeeds */
+	SCRIPT* script = (SCRIPT*)malloc(sizeof(SCRIPT));
+	if (script == NULL) {
+		return 1;
+	}
+	memset(script, 0, sizeof(SCRIPT));
+	script->echo = echo;
+	script->file = file;
+
+	console->kbhit = script_kbhit;
+	console->getch = script_getch;
+	console->putch = script_putch;
+	console->write = NULL;
+	console->wait = script_wait;
+	console->destroy = script_destroy;
+	console->data = script;
+	console->fd = -1;
+	console->done = 0;
+	script_next(console);
+	return 0;
+}
@@ -0,0 +1,410 @@
+/* cpu_ops.c
+ * i8080 instruction semantics for translated and predecoded execution
+ * Github: https:\\github.com\tommojphillips
+ */
+
+ /* The interpreter in lib/I8080 fetches and decodes every instruction as it runs it. The JIT and
+  * the predecode cache decode once and call these handlers with the operand already fetched.
+  * Handlers follow the documented 8080 semantics (flags, cycles) and work only on the public
+  * I8080 state, so they can run interleaved with i8080_execute. altair-cputest -x checks them
+  * against i8080_execute.
+  *
+  * IN, OUT, HLT, EI and DI have no handler; they always run in the interpreter.
+  */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "cpu_ops.h"
+#include "i8080.h"
+
+#define REG(r)       cpu->registers[r]
+#define DST(opcode)  (((opcode) >> 3) & 0x07)
+#define SRC(opcode)  ((opcode) & 0x07)
+#define RP(opcode)   (((opcode) >> 4) & 0x03)
+#define REG_M        6
+
+static const uint8_t reg_index[8] = { REG_B, REG_C, REG_D, REG_E, REG_H, REG_L, 0, REG_A };
+
+static uint16_t get_hl(I8080* cpu) {
+	return (REG(REG_H) << 8) | REG(REG_L);
+}
+static uint8_t get_reg(I8080* cpu, uint8_t r) {
+	if (r == REG_M) {
+		return cpu->read_byte(get_hl(cpu));
+	}
+	return REG(reg_index[r]);
+}
+static void set_reg(I8080* cpu, uint8_t r, uint8_t value) {
+	if (r == REG_M) {
+		cpu->write_byte(get_hl(cpu), value);
+	}
+	else {
+		REG(reg_index[r]) = value;
+	}
+}
+static uint16_t get_rp(I8080* cpu, uint8_t rp) {
+	switch (rp) {
+		case 0: return (REG(REG_B) << 8) | REG(REG_C);
+		case 1: return (REG(REG_D) << 8) | REG(REG_E);
+		case 2: return get_hl(cpu);
+		default: return cpu->sp;
+	}
+}
+static void set_rp(I8080* cpu, uint8_t rp, uint16_t value) {
+	switch (rp) {
+		case 0: REG(REG_B) = value >> 8; REG(REG_C) = value & 0xFF; break;
+		case 1: REG(REG_D) = value >> 8; REG(REG_E) = value & 0xFF; break;
+		case 2: REG(REG_H) = value >> 8; REG(REG_L) = value & 0xFF; break;
+		default: cpu->sp = value; break;
+	}
+}
+
+static uint8_t parity(uint8_t value) {
+	value ^= value >> 4;
+	value ^= value >> 2;
+	value ^= value >> 1;
+	return (~value) & 1;
+}
+static void set_zsp(I8080* cpu, uint8_t value) {
+	cpu->flags.z = value == 0;
+	cpu->flags.s = value >> 7;
+	cpu->flags.p = parity(value);
+}
+static uint8_t get_psw(I8080* cpu) {
+	return (cpu->flags.s << 7) | (cpu->flags.z << 6) | (cpu->flags.ac << 4) | (cpu->flags.p << 2) | 0x02 | cpu->flags.c;
+}
+static void set_psw(I8080* cpu, uint8_t value) {
+	cpu->flags.s = (value >> 7) & 1;
+	cpu->flags.z = (value >> 6) & 1;
+	cpu->flags.ac = (value >> 4) & 1;
+	cpu->flags.p = (value >> 2) & 1;
+	cpu->flags.c = value & 1;
+}
+static int condition(I8080* cpu, uint8_t opcode) {
+	switch (DST(opcode)) {
+		case 0: return !cpu->flags.z;
+		case 1: return cpu->flags.z;
+		case 2: return !cpu->flags.c;
+		case 3: return cpu->flags.c;
+		case 4: return !cpu->flags.p;
+		case 5: return cpu->flags.p;
+		case 6: return !cpu->flags.s;
+		default: return cpu->flags.s;
+	}
+}
+static void push(I8080* cpu, uint16_t value) {
+	cpu->sp -= 2;
+	cpu->write_byte(cpu->sp + 1, value >> 8);
+	cpu->write_byte(cpu->sp, value & 0xFF);
+}
+static uint16_t pop(I8080* cpu) {
+	uint16_t value = cpu->read_byte(cpu->sp) | (cpu->read_byte(cpu->sp + 1) << 8);
+	cpu->sp += 2;
+	return value;
+}
+
+static inline void alu(I8080* cpu, uint8_t operation, uint8_t value) {
+	uint8_t a = REG(REG_A);
+	uint16_t result;
+	uint8_t carry;
+	switch (operation) {
+		case 0: /* ADD */
+		case 1: /* ADC */
+			carry = (operation == 1) ? cpu->flags.c : 0;
+			result = a + value + carry;
+			cpu->flags.ac = ((a & 0x0F) + (value & 0x0F) + carry) > 0x0F;
+			cpu->flags.c = result > 0xFF;
+			REG(REG_A) = (uint8_t)result;
+			set_zsp(cpu, (uint8_t)result);
+			break;
+		case 2: /* SUB */
+		case 3: /* SBB */
+		case 7: /* CMP */
+			carry = (operation == 3) ? cpu->flags.c : 0;
+			result = a - value - carry;
+			cpu->flags.ac = ((a & 0x0F) + (~value & 0x0F) + !carry) > 0x0F;
+			cpu->flags.c = result > 0xFF;
+			set_zsp(cpu, (uint8_t)result);
+			if (operation != 7) {
+				REG(REG_A) = (uint8_t)result;
+			}
+			break;
+		case 4: /* ANA */
+			result = a & value;
+			cpu->flags.ac = ((a | value) & 0x08) != 0;
+			cpu->flags.c = 0;
+			REG(REG_A) = (uint8_t)result;
+			set_zsp(cpu, (uint8_t)result);
+			break;
+		case 5: /* XRA */
+			result = a ^ value;
+			cpu->flags.ac = 0;
+			cpu->flags.c = 0;
+			REG(REG_A) = (uint8_t)result;
+			set_zsp(cpu, (uint8_t)result);
+			break;
+		default: /* ORA */
+			result = a | value;
+			cpu->flags.ac = 0;
+			cpu->flags.c = 0;
+			REG(REG_A) = (uint8_t)result;
+			set_zsp(cpu, (uint8_t)result);
+			break;
+	}
+}
+
+static void op_nop(I8080* cpu, uint8_t opcode, uint16_t operand) {
+
+}
+static void op_mov(I8080* cpu, uint8_t opcode, uint16_t operand) {
+	set_reg(cpu, DST(opcode), get_reg(cpu, SRC(opcode)));
+}
+static void op_mvi(I8080* cpu, uint8_t opcode, uint16_t operand) {
+	set_reg(cpu, DST(opcode), (uint8_t)operand);
+}
+
+/* one handler per operation so alu() folds to the operation */
+#define ALU_HANDLERS(name, operation) \
+static void op_##name(I8080* cpu, uint8_t opcode, uint16_t operand) { \
+	alu(cpu, operation, get_reg(cpu, SRC(opcode))); \
+} \
+static void op_##name##_imm(I8080* cpu, uint8_t opcode, uint16_t operand) { \
+	alu(cpu, operation, (uint8_t)operand); \
+}
+ALU_HANDLERS(add, 0)
+ALU_HANDLERS(adc, 1)
+ALU_HANDLERS(sub, 2)
+ALU_HANDLERS(sbb, 3)
+ALU_HANDLERS(ana, 4)
+ALU_HANDLERS(xra, 5)
+ALU_HANDLERS(ora, 6)
+ALU_HANDLERS(cmp, 7)
+static void op_inr(I8080* cpu, uint8_t opcode, uint16_t operand) {
+	uint8_t value = get_reg(cpu, DST(opcode)) + 1;
+	cpu->flags.ac = (value & 0x0F) == 0;
+	set_zsp(cpu, value);
+	set_reg(cpu, DST(opcode), value);
+}
+static void op_dcr(I8080* cpu, uint8_t opcode, uint16_t operand) {
+	uint8_t value = get_reg(cpu, DST(opcode)) - 1;
+	cpu->flags.ac = (value & 0x0F) != 0x0F;
+	set_zsp(cpu, value);
+	set_reg(cpu, DST(opcode), value);
+}
+static void op_lxi(I8080* cpu, uint8_t opcode, uint16_t operand) {
+	set_rp(cpu, RP(opcode), operand);
+}
+static void op_inx(I8080* cpu, uint8_t opcode, uint16_t operand) {
+	set_rp(cpu, RP(opcode), get_rp(cpu, RP(opcode)) + 1);
+}
+static void op_dcx(I8080* cpu, uint8_t opcode, uint16_t operand) {
+	set_rp(cpu, RP(opcode), get_rp(cpu, RP(opcode)) - 1);
+}
+static void op_dad(I8080* cpu, uint8_t opcode, uint16_t operand) {
+	uint32_t result = get_hl(cpu) + get_rp(cpu, RP(opcode));
+	cpu->flags.c = result > 0xFFFF;
+	set_rp(cpu, 2, (uint16_t)result);
+}
+static void op_stax(I8080* cpu, uint8_t opcode, uint16_t operand) {
+	cpu->write_byte(get_rp(cpu, RP(opcode)), REG(REG_A));
+}
+static void op_ldax(I8080* cpu, uint8_t opcode, uint16_t operand) {
+	REG(REG_A) = cpu->read_byte(get_rp(cpu, RP(opcode)));
+}
+static void op_shld(I8080* cpu, uint8_t opcode, uint16_t operand) {
+	cpu->write_byte(operand, REG(REG_L));
+	cpu->write_byte(operand + 1, REG(REG_H));
+}
+static void op_lhld(I8080* cpu, uint8_t opcode, uint16_t operand) {
+	REG(REG_L) = cpu->read_byte(operand);
+	REG(REG_H) = cpu->read_byte(operand + 1);
+}
+static void op_sta(I8080* cpu, uint8_t opcode, uint16_t operand) {
+	cpu->write_byte(operand, REG(REG_A));
+}
+static void op_lda(I8080* cpu, uint8_t opcode, uint16_t operand) {
+	REG(REG_A) = cpu->read_byte(operand);
+}
+static void op_rlc(I8080* cpu, uint8_t opcode, uint16_t operand) {
+	uint8_t a = REG(REG_A);
+	cpu->flags.c = a >> 7;
+	REG(REG_A) = (a << 1) | (a >> 7);
+}
+static void op_rrc(I8080* cpu, uint8_t opcode, uint16_t operand) {
+	uint8_t a = REG(REG_A);
+	cpu->flags.c = a & 1;
+	REG(REG_A) = (a >> 1) | (a << 7);
+}
+static void op_ral(I8080* cpu, uint8_t opcode, uint16_t operand) {
+	uint8_t a = REG(REG_A);
+	uint8_t carry = cpu->flags.c;
+	cpu->flags.c = a >> 7;
+	REG(REG_A) = (a << 1) | carry;
+}
+static void op_rar(I8080* cpu, uint8_t opcode, uint16_t operand) {
+	uint8_t a = REG(REG_A);
+	uint8_t carry = cpu->flags.c;
+	cpu->flags.c = a & 1;
+	REG(REG_A) = (a >> 1) | (carry << 7);
+}
+static void op_daa(I8080* cpu, uint8_t opcode, uint16_t operand) {
+	uint8_t a = REG(REG_A);
+	uint8_t correction = 0;
+	uint8_t carry = cpu->flags.c;
+	if ((a & 0x0F) > 9 || cpu->flags.ac) {
+		correction |= 0x06;
+	}
+	if ((a >> 4) > 9 || carry || ((a >> 4) >= 9 && (a & 0x0F) > 9)) {
+		correction |= 0x60;
+		carry = 1;
+	}
+	alu(cpu, 0, correction);
+	cpu->flags.c = carry;
+}
+static void op_cma(I8080* cpu, uint8_t opcode, uint16_t operand) {
+	REG(REG_A) = ~REG(REG_A);
+}
+static void op_stc(I8080* cpu, uint8_t opcode, uint16_t operand) {
+	cpu->flags.c = 1;
+}
+static void op_cmc(I8080* cpu, uint8_t opcode, uint16_t operand) {
+	cpu->flags.c = !cpu->flags.c;
+}
+static void op_jmp(I8080* cpu, uint8_t opcode, uint16_t operand) {
+	cpu->pc = operand;
+}
+static void op_jcc(I8080* cpu, uint8_t opcode, uint16_t operand) {
+	if (condition(cpu, opcode)) {
+		cpu->pc = operand;
+	}
+}
+static void op_call(I8080* cpu, uint8_t opcode, uint16_t operand) {
+	push(cpu, cpu->pc);
+	cpu->pc = operand;
+}
+static void op_ccc(I8080* cpu, uint8_t opcode, uint16_t operand) {
+	if (condition(cpu, opcode)) {
+		push(cpu, cpu->pc);
+		cpu->pc = operand;
+		cpu->cycles += 6;
+	}
+}
+static void op_ret(I8080* cpu, uint8_t opcode, uint16_t operand) {
+	cpu->pc = pop(cpu);
+}
+static void op_rcc(I8080* cpu, uint8_t opcode, uint16_t operand) {
+	if (condition(cpu, opcode)) {
+		cpu->pc = pop(cpu);
+		cpu->cycles += 6;
+	}
+}
+static void op_rst(I8080* cpu, uint8_t opcode, uint16_t operand) {
+	push(cpu, cpu->pc);
+	cpu->pc = opcode & 0x38;
+}
+static void op_push(I8080* cpu, uint8_t opcode, uint16_t operand) {
+	if (RP(opcode) == 3) {
+		push(cpu, (REG(REG_A) << 8) | get_psw(cpu));
+	}
+	else {
+		push(cpu, get_rp(cpu, RP(opcode)));
+	}
+}
+static void op_pop(I8080* cpu, uint8_t opcode, uint16_t operand) {
+	uint16_t value = pop(cpu);
+	if (RP(opcode) == 3) {
+		REG(REG_A) = value >> 8;
+		set_psw(cpu, value & 0xFF);
+	}
+	else {
+		set_rp(cpu, RP(opcode), value);
+	}
+}
+static void op_xthl(I8080* cpu, uint8_t opcode, uint16_t operand) {
+	uint16_t value = cpu->read_byte(cpu->sp) | (cpu->read_byte(cpu->sp + 1) << 8);
+	cpu->write_byte(cpu->sp, REG(REG_L));
+	cpu->write_byte(cpu->sp + 1, REG(REG_H));
+	set_rp(cpu, 2, value);
+}
+static void op_xchg(I8080* cpu, uint8_t opcode, uint16_t operand) {
+	uint16_t de = get_rp(cpu, 1);
+	set_rp(cpu, 1, get_hl(cpu));
+	set_rp(cpu, 2, de);
+}
+static void op_pchl(I8080* cpu, uint8_t opcode, uint16_t operand) {
+	cpu->pc = get_hl(cpu);
+}
+static void op_sphl(I8080* cpu, uint8_t opcode, uint16_t operand) {
+	cpu->sp = get_hl(cpu);
+}
+
+#define NOP        { op_nop,     1,  4, 0 }
+#define MOV        { op_mov,     1,  5, 0 }
+#define MOV_M      { op_mov,     1,  7, 0 }
+#define MOV_TO_M   { op_mov,     1,  7, CPU_OP_STORE }
+#define MVI        { op_mvi,     2,  7, 0 }
+#define MVI_M      { op_mvi,     2, 10, CPU_OP_STORE }
+#define INR        { op_inr,     1,  5, 0 }
+#define INR_M      { op_inr,     1, 10, CPU_OP_STORE }
+#define DCR        { op_dcr,     1,  5, 0 }
+#define DCR_M      { op_dcr,     1, 10, CPU_OP_STORE }
+#define ALU(op)     { op_##op,       1,  4, 0 }
+#define ALU_M(op)   { op_##op,       1,  7, 0 }
+#define ALU_IMM(op) { op_##op##_imm, 2,  7, 0 }
+#define LXI        { op_lxi,     3, 10, 0 }
+#define INX        { op_inx,     1,  5, 0 }
+#define DCX        { op_dcx,     1,  5, 0 }
+#define DAD        { op_dad,     1, 10, 0 }
+#define STAX       { op_stax,    1,  7, CPU_OP_STORE }
+#define LDAX       { op_ldax,    1,  7, 0 }
+#define JMP        { op_jmp,     3, 10, CPU_OP_BRANCH }
+#define JCC        { op_jcc,     3, 10, CPU_OP_BRANCH }
+#define CALL       { op_call,    3, 17, CPU_OP_BRANCH | CPU_OP_STORE }
+#define CCC        { op_ccc,     3, 11, CPU_OP_BRANCH | CPU_OP_STORE }
+#define RET        { op_ret,     1, 10, CPU_OP_BRANCH }
+#define RCC        { op_rcc,     1,  5, CPU_OP_BRANCH }
+#define RST        { op_rst,     1, 11, CPU_OP_BRANCH | CPU_OP_STORE }
+#define PUSH       { op_push,    1, 11, CPU_OP_STORE }
+#define POP        { op_pop,     1, 10, 0 }
+#define HLT        { NULL,       1,  7, CPU_OP_CPU }
+#define EI_DI      { NULL,       1,  4, CPU_OP_CPU }
+#define IO         { NULL,       2, 10, CPU_OP_IO }
+
+#define MOV_ROW    MOV, MOV, MOV, MOV, MOV, MOV, MOV_M, MOV
+#define ALU_ROW(op) ALU(op), ALU(op), ALU(op), ALU(op), ALU(op), ALU(op), ALU_M(op), ALU(op)
+
+const CPU_OP_INFO cpu_ops[256] = {
+	/* 00 */ NOP, LXI, STAX, INX, INR, DCR, MVI, { op_rlc, 1, 4, 0 },
+	/* 08 */ NOP, DAD, LDAX, DCX, INR, DCR, MVI, { op_rrc, 1, 4, 0 },
+	/* 10 */ NOP, LXI, STAX, INX, INR, DCR, MVI, { op_ral, 1, 4, 0 },
+	/* 18 */ NOP, DAD, LDAX, DCX, INR, DCR, MVI, { op_rar, 1, 4, 0 },
+	/* 20 */ NOP, LXI, { op_shld, 3, 16, CPU_OP_STORE }, INX, INR, DCR, MVI, { op_daa, 1, 4, 0 },
+	/* 28 */ NOP, DAD, { op_lhld, 3, 16, 0 }, DCX, INR, DCR, MVI, { op_cma, 1, 4, 0 },
+	/* 30 */ NOP, LXI, { op_sta, 3, 13, CPU_OP_STORE }, INX, INR_M, DCR_M, MVI_M, { op_stc, 1, 4, 0 },
+	/* 38 */ NOP, DAD, { op_lda, 3, 13, 0 }, DCX, INR, DCR, MVI, { op_cmc, 1, 4, 0 },
+	/* 40 */ MOV_ROW,
+	/* 48 */ MOV_ROW,
+	/* 50 */ MOV_ROW,
+	/* 58 */ MOV_ROW,
+	/* 60 */ MOV_ROW,
+	/* 68 */ MOV_ROW,
+	/* 70 */ MOV_TO_M, MOV_TO_M, MOV_TO_M, MOV_TO_M, MOV_TO_M, MOV_TO_M, HLT, MOV_TO_M,
+	/* 78 */ MOV_ROW,
+	/* 80 */ ALU_ROW(add),
+	/* 88 */ ALU_ROW(adc),
+	/* 90 */ ALU_ROW(sub),
+	/* 98 */ ALU_ROW(sbb),
+	/* A0 */ ALU_ROW(ana),
+	/* A8 */ ALU_ROW(xra),
+	/* B0 */ ALU_ROW(ora),
+	/* B8 */ ALU_ROW(cmp),
+	/* C0 */ RCC, POP, JCC, JMP, CCC, PUSH, ALU_IMM(add), RST,
+	/* C8 */ RCC, RET, JCC, JMP, CCC, CALL, ALU_IMM(adc), RST,
+	/* D0 */ RCC, POP, JCC, IO, CCC, PUSH, ALU_IMM(sub), RST,
+	/* D8 */ RCC, RET, JCC, IO, CCC, CALL, ALU_IMM(sbb), RST,
+	/* E0 */ RCC, POP, JCC, { op_xthl, 1, 18, CPU_OP_STORE }, CCC, PUSH, ALU_IMM(ana), RST,
+	/* E8 */ RCC, { op_pchl, 1, 5, CPU_OP_BRANCH }, JCC, { op_xchg, 1, 4, 0 }, CCC, CALL, ALU_IMM(xra), RST,
+	/* F0 */ RCC, POP, JCC, EI_DI, CCC, PUSH, ALU_IMM(ora), RST,
+	/* F8 */ RCC, { op_sphl, 1, 5, 0 }, JCC, EI_DI, CCC, CALL, ALU_IMM(cmp), RST,
+};
@@ -0,0 +1,30 @@
+/* cpu_ops.h
+ * i8080 instruction semantics for translated and predecoded execution
+ * Github: https:\\github.com\tommojphillips
+ */
+
+#ifndef CPU_OPS_H
+#define CPU_OPS_H
+
+#include <stdint.h>
+
+#include "i8080.h"
+
+/* execute one instruction; pc has already been advanced past it. */
+typedef void(*CPU_OP)(I8080* cpu, uint8_t opcode, uint16_t operand);
+
+#define CPU_OP_BRANCH 0x01 // may change pc
+#define CPU_OP_STORE  0x02 // may write memory
+#define CPU_OP_IO     0x04 // IN/OUT; must run in the interpreter
+#define CPU_OP_CPU    0x08 // HLT/EI/DI; must run in the interpreter
+
+typedef struct {
+	CPU_OP op;      // semantics, or NULL if the instruction must run in the interpreter
+	uint8_t length; // instruction length in bytes
+	uint8_t cycles; // cycles; conditional CALL/RET add their extra cycles themselves
+	uint8_t flags;  // CPU_OP_*
+} CPU_OP_INFO;
+
+extern const CPU_OP_INFO cpu_ops[256];
+
+#endif
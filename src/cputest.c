@@ -0,0 +1,517 @@
+/* cputest.c
+ * 8080 exerciser harness
+ * Github: https:\\github.com\tommojphillips
+ */
+
+ /* Runs CP/M .COM cpu exercisers (8080PRE, TST8080, CPUTEST, 8080EXM) on the machine without a disk,
+	checks what they print and how many cycles they take, and reports one JSON line per run:
+
+	{"name":"TST8080","engine":"jit","status":"ok","instructions":0,"cycles":0,"expected_cycles":0,"wall_s":0.000,"ips":0,"mhz":0.00}
+
+	The program is loaded at 0100h in 64K of RAM with a minimal CP/M underneath it: 0000h is OUT 00h
+	(warm boot; the run ends) and 0005h is OUT 01h, RET (BDOS). Function 2 prints E and function 9 prints
+	the $ terminated string at DE. This is the layout other 8080 emulators publish their cycle totals
+	for, so the totals of the known exercisers are checked exactly.
+
+	status is "ok" when the program finished, printed its pass message and nothing that looks like a
+	failure (8080EXM prints ERROR with the expected and found CRC), and took the expected cycles when
+	they are known. Otherwise "fail", or "timeout" when the time limit was hit.
+	With more than one engine every engine must also agree with the first on instructions and cycles.
+
+	Options
+		-e<engine>   interp, predecode, jit or all; may be given more than once (default interp)
+		-l<seconds>  wall-clock time limit per run (default 600)
+		-j<file>     append the results to <file> instead of printing them
+		-v           echo what the programs print
+		-x<states>   compare every cpu_ops handler with the core's i8080_execute on <states> random
+		             machine states per opcode, then run any programs given
+
+	The comparison checks what the predecode engine and the JIT's handler calls run against the core
+	instruction by instruction: registers, flags, pc, sp, cycles and every memory write. It needs no
+	program files.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "altair8800.h"
+#include "cpu_ops.h"
+#include "i8080.h"
+#include "io.h"
+#include "jit.h"
+#include "memmap.h"
+#include "timing.h"
+#include "file.h"
+
+#define CPUTEST_TIME_LIMIT 600   // seconds per run
+#define CPUTEST_OUTPUT     0x4000 // program output kept for the checks
+#define CPUTEST_ENGINES    3
+#define CPUTEST_LOAD       0x0100
+#define PORT_WARM_BOOT     0x00
+#define PORT_BDOS          0x01
+#define COMPARE_WRITES     4      // memory writes one instruction can make
+
+typedef struct {
+	const char* name;  // file name without the extension
+	const char* pass;  // printed on success
+	uint64_t cycles;   // total cycles, or 0 if not known
+} EXERCISER;
+
+static const EXERCISER exercisers[] = {
+	{ "8080PRE", "Preliminary tests complete", 7817ULL },
+	{ "TST8080", "CPU IS OPERATIONAL",         4924ULL },
+	{ "CPUTEST", "CPU TESTS OK",               255653383ULL },
+	{ "8080EXM", "Tests complete",             23803381171ULL },
+};
+
+static const char* failures[] = { "ERROR", "FAILED", "FAIL " };
+
+typedef struct {
+	ALTAIR8800* altair;
+	char output[CPUTEST_OUTPUT];
+	uint32_t len;
+	int echo;
+	int finished; // the program jumped to 0000h
+} CPUTEST;
+
+static void print(CPUTEST* test, char ch) {
+	if (test->len < CPUTEST_OUTPUT - 1) {
+		test->output[test->len++] = ch;
+		test->output[test->len] = '\0';
+	}
+	if (test->echo) {
+		putchar(ch);
+	}
+}
+static void out_warm_boot(void* context, uint8_t port, uint8_t value) {
+	/* stop after this instruction; halting skips the rest of the frame as idle time */
+	CPUTEST* test = (CPUTEST*)context;
+	test->finished = 1;
+	test->altair->cpu.flags.halt = 1;
+	test->altair->running = 0;
+}
+static void out_bdos(void* context, uint8_t port, uint8_t value) {
+	CPUTEST* test = (CPUTEST*)context;
+	I8080* cpu = &test->altair->cpu;
+	switch (cpu->registers[REG_C]) {
+		case 2:
+			print(test, (char)cpu->registers[REG_E]);
+			break;
+		case 9: {
+			uint16_t address = (cpu->registers[REG_D] << 8) | cpu->registers[REG_E];
+			for (uint32_t i = 0; i < 0x10000; ++i, ++address) {
+				char ch = (char)memmap_read(&test->altair->memmap, address);
+				if (ch == '$') {
+					break;
+				}
+				print(test, ch);
+			}
+		} break;
+	}
+}
+
+static const char* base_name(const char* path, char* name, size_t size) {
+	/* TST8080 from dir/tst8080.com */
+	const char* start = path;
+	for (const char* p = path; *p != '\0'; ++p) {
+		if (*p == '/' || *p == '\\') {
+			start = p + 1;
+		}
+	}
+	size_t len = 0;
+	while (start[len] != '\0' && start[len] != '.' && len < size - 1) {
+		char ch = start[len];
+		name[len++] = (ch >= 'a' && ch <= 'z') ? ch - 0x20 : ch;
+	}
+	name[len] = '\0';
+	return name;
+}
+static const EXERCISER* find_exerciser(const char* name) {
+	for (size_t i = 0; i < sizeof(exercisers) / sizeof(exercisers[0]); ++i) {
+		if (strcmp(exercisers[i].name, name) == 0) {
+			return &exercisers[i];
+		}
+	}
+	return NULL;
+}
+
+typedef struct {
+	uint16_t pc;            // where the instruction is
+	uint8_t code[3];        // the instruction
+	uint32_t seed;          // the rest of memory is a hash of the address and the seed
+	uint16_t address[COMPARE_WRITES];
+	uint8_t value[COMPARE_WRITES];
+	uint32_t writes;
+	uint32_t overflow;      // writes past COMPARE_WRITES
+} COMPARE_MEMORY;
+
+/* the core's memory callbacks take no context */
+static COMPARE_MEMORY* compare_memory;
+
+static uint32_t random_next(uint32_t* state) {
+	/* xorshift32 */
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+static uint8_t compare_read(uint16_t address) {
+	COMPARE_MEMORY* m = compare_memory;
+	for (uint32_t i = m->writes; i > 0; --i) {
+		if (m->address[i - 1] == address) {
+			return m->value[i - 1];
+		}
+	}
+	uint16_t offset = (uint16_t)(address - m->pc);
+	if (offset < 3) {
+		return m->code[offset];
+	}
+	uint32_t x = (address * 0x9E3779B1u) ^ m->seed;
+	return (uint8_t)(x ^ (x >> 15) ^ (x >> 24));
+}
+static void compare_write(uint16_t address, uint8_t value) {
+	COMPARE_MEMORY* m = compare_memory;
+	if (m->writes >= COMPARE_WRITES) {
+		m->overflow++;
+		return;
+	}
+	m->address[m->writes] = address;
+	m->value[m->writes] = value;
+	m->writes++;
+}
+static uint8_t compare_read_io(uint8_t port) {
+	return 0xFF;
+}
+static void compare_write_io(uint8_t port, uint8_t value) {
+
+}
+
+static int written(const COMPARE_MEMORY* m, uint16_t address, uint8_t* value) {
+	/* the last value written to address */
+	for (uint32_t i = m->writes; i > 0; --i) {
+		if (m->address[i - 1] == address) {
+			*value = m->value[i - 1];
+			return 1;
+		}
+	}
+	return 0;
+}
+static int same_writes(const COMPARE_MEMORY* a, const COMPARE_MEMORY* b) {
+	/* memory ends up the same; the order of the writes does not matter */
+	for (uint32_t i = 0; i < a->writes; ++i) {
+		uint8_t va = 0;
+		uint8_t vb = 0;
+		written(a, a->address[i], &va);
+		if (!written(b, a->address[i], &vb) || va != vb) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static const char* compare_state(const I8080* a, const I8080* b, const COMPARE_MEMORY* ma, const COMPARE_MEMORY* mb) {
+	/* what differs, or NULL; registers[6] is not an 8080 register */
+	static const char* names[8] = { "B", "C", "D", "E", "H", "L", NULL, "A" };
+	for (int r = 0; r < 8; ++r) {
+		if (names[r] != NULL && a->registers[r] != b->registers[r]) {
+			return names[r];
+		}
+	}
+	if (a->pc != b->pc) return "pc";
+	if (a->sp != b->sp) return "sp";
+	if (a->cycles != b->cycles) return "cycles";
+	if (a->flags.c != b->flags.c) return "carry";
+	if (a->flags.p != b->flags.p) return "parity";
+	if (a->flags.ac != b->flags.ac) return "aux carry";
+	if (a->flags.z != b->flags.z) return "zero";
+	if (a->flags.s != b->flags.s) return "sign";
+	if (ma->overflow != mb->overflow || !same_writes(ma, mb) || !same_writes(mb, ma)) return "memory writes";
+	return NULL;
+}
+
+static int compare_ops(uint32_t states) {
+	/* run each handler and i8080_execute from the same random state and compare the results */
+	uint32_t random = 0x8080;
+	uint32_t compared = 0;
+	uint32_t failed_opcodes = 0;
+	COMPARE_MEMORY core_memory;
+	COMPARE_MEMORY ops_memory;
+
+	for (int opcode = 0; opcode < 256; ++opcode) {
+		const CPU_OP_INFO* info = &cpu_ops[opcode];
+		if (info->op == NULL) {
+			continue; // always runs in the interpreter
+		}
+		uint32_t mismatches = 0;
+		const char* first = NULL;
+		for (uint32_t i = 0; i < states; ++i) {
+			I8080 start;
+			memset(&start, 0, sizeof(start));
+			i8080_init(&start);
+			start.read_byte = compare_read;
+			start.write_byte = compare_write;
+			start.read_io = compare_read_io;
+			start.write_io = compare_write_io;
+			for (int r = 0; r < 8; ++r) {
+				start.registers[r] = (uint8_t)random_next(&random);
+			}
+			uint32_t x = random_next(&random);
+			start.pc = (uint16_t)x;
+			start.sp = (uint16_t)(x >> 16);
+			x = random_next(&random);
+			start.flags.c = x & 1;
+			start.flags.p = (x >> 1) & 1;
+			start.flags.ac = (x >> 2) & 1;
+			start.flags.z = (x >> 3) & 1;
+			start.flags.s = (x >> 4) & 1;
+			start.cycles = 0;
+
+			memset(&core_memory, 0, sizeof(core_memory));
+			core_memory.pc = start.pc;
+			core_memory.seed = random_next(&random);
+			core_memory.code[0] = (uint8_t)opcode;
+			x = random_next(&random);
+			core_memory.code[1] = (uint8_t)x;
+			core_memory.code[2] = (uint8_t)(x >> 8);
+			ops_memory = core_memory;
+
+			I8080 core = start;
+			compare_memory = &core_memory;
+			i8080_execute(&core);
+
+			I8080 ops = start;
+			uint16_t operand = 0;
+			if (info->length == 2) {
+				operand = ops_memory.code[1];
+			}
+			else if (info->length == 3) {
+				operand = ops_memory.code[1] | (ops_memory.code[2] << 8);
+			}
+			compare_memory = &ops_memory;
+			ops.pc = (uint16_t)(start.pc + info->length);
+			ops.cycles += info->cycles;
+			info->op(&ops, (uint8_t)opcode, operand);
+
+			const char* differs = compare_state(&core, &ops, &core_memory, &ops_memory);
+			if (differs != NULL) {
+				if (first == NULL) {
+					first = differs;
+				}
+				mismatches++;
+			}
+			compared++;
+		}
+		if (mismatches != 0) {
+			printf("Error: opcode %02X: %s differs from the core in %u of %u states\n", opcode, first, mismatches, states);
+			failed_opcodes++;
+		}
+	}
+	printf("{\"name\":\"cpu_ops\",\"status\":\"%s\",\"states\":%u,\"failed_opcodes\":%u}\n",
+		failed_opcodes == 0 ? "ok" : "fail", compared, failed_opcodes);
+	return failed_opcodes != 0;
+}
+
+static const char* engine_name(int engine) {
+	switch (engine) {
+		case ENGINE_JIT:
+			return "jit";
+		case ENGINE_PREDECODE:
+			return "predecode";
+		default:
+			return "interp";
+	}
+}
+
+typedef struct {
+	const char* status;
+	uint64_t instructions;
+	uint64_t cycles;
+} RESULT;
+
+static RESULT run(const char* path, int engine, uint64_t time_limit, int echo, FILE* out) {
+	RESULT result = { "fail", 0, 0 };
+	char name[64];
+	base_name(path, name, sizeof(name));
+	const EXERCISER* known = find_exerciser(name);
+
+	CPUTEST* test = (CPUTEST*)calloc(1, sizeof(CPUTEST));
+	ALTAIR8800* altair = altair8800_create();
+	if (test == NULL || altair == NULL) {
+		free(test);
+		altair8800_destroy(altair);
+		return result;
+	}
+	test->altair = altair;
+	test->echo = echo;
+	altair->timing.multiplier = TIMING_TURBO;
+	if (altair8800_set_engine(altair, engine) != 0) {
+		altair8800_destroy(altair);
+		free(test);
+		return result;
+	}
+
+	uint32_t size = 0;
+	if (read_file_into_buffer(path, altair->memory, 0x10000, CPUTEST_LOAD, &size, 0) != 0) {
+		altair8800_destroy(altair);
+		free(test);
+		return result;
+	}
+	static const uint8_t cpm[8] = { 0xD3, PORT_WARM_BOOT, 0x00, 0x00, 0x00, 0xD3, PORT_BDOS, 0xC9 };
+	memcpy(altair->memory, cpm, sizeof(cpm));
+	/* port 01 is also the terminal's DBL error output; the BDOS trap takes it over */
+	io_unregister(&altair->io, PORT_WARM_BOOT);
+	io_unregister(&altair->io, PORT_BDOS);
+	io_register_write(&altair->io, PORT_WARM_BOOT, out_warm_boot, test);
+	io_register_write(&altair->io, PORT_BDOS, out_bdos, test);
+	altair->cpu.pc = CPUTEST_LOAD;
+
+	uint64_t start = timing_now();
+	uint64_t elapsed = 0;
+	while (altair->running && elapsed < time_limit) {
+		altair8800_step(altair);
+		elapsed = timing_now() - start;
+	}
+	if (echo) {
+		putchar('\n');
+	}
+
+	result.instructions = altair->instructions;
+	result.cycles = altair->timing.total_cycles - altair->idle.skipped;
+	if (!test->finished) {
+		result.status = "timeout";
+	}
+	else {
+		int passed = 1;
+		for (size_t i = 0; i < sizeof(failures) / sizeof(failures[0]); ++i) {
+			if (strstr(test->output, failures[i]) != NULL) {
+				passed = 0;
+			}
+		}
+		if (known != NULL && (strstr(test->output, known->pass) == NULL || result.cycles != known->cycles)) {
+			passed = 0;
+		}
+		result.status = passed ? "ok" : "fail";
+	}
+
+	double wall = elapsed / 1000000.0;
+	fprintf(out, "{\"name\":\"%s\",\"engine\":\"%s\",\"status\":\"%s\",\"instructions\":%llu,\"cycles\":%llu,\"expected_cycles\":%llu,\"wall_s\":%.3f,\"ips\":%.0f,\"mhz\":%.2f}\n",
+		name, engine_name(engine), result.status, (unsigned long long)result.instructions, (unsigned long long)result.cycles,
+		(unsigned long long)(known != NULL ? known->cycles : 0), wall,
+		wall > 0 ? result.instructions / wall : 0.0, wall > 0 ? result.cycles / wall / 1000000.0 : 0.0);
+	fflush(out);
+
+	altair8800_destroy(altair);
+	free(test);
+	return result;
+}
+
+int main(int argc, char** argv) {
+	int engines[CPUTEST_ENGINES];
+	int engine_count = 0;
+	uint64_t time_limit = CPUTEST_TIME_LIMIT * 1000000ULL;
+	const char* json = NULL;
+	int echo = 0;
+	int programs = 0;
+	uint32_t compare = 0;
+
+	for (int i = 1; i < argc; ++i) {
+		const char* arg = argv[i];
+		if (strncmp("-e", arg, 2) == 0) {
+			int add[CPUTEST_ENGINES];
+			int add_count = 0;
+			if (strcmp("all", arg + 2) == 0) {
+				add[add_count++] = ENGINE_INTERPRETER;
+				add[add_count++] = ENGINE_PREDECODE;
+				if (JIT_SUPPORTED) {
+					add[add_count++] = ENGINE_JIT;
+				}
+			}
+			else if (strcmp("jit", arg + 2) == 0) {
+				add[add_count++] = ENGINE_JIT;
+			}
+			else if (strcmp("predecode", arg + 2) == 0) {
+				add[add_count++] = ENGINE_PREDECODE;
+			}
+			else {
+				add[add_count++] = ENGINE_INTERPRETER;
+			}
+			for (int j = 0; j < add_count; ++j) {
+				int seen = 0;
+				for (int k = 0; k < engine_count; ++k) {
+					seen |= engines[k] == add[j];
+				}
+				if (!seen) {
+					engines[engine_count++] = add[j];
+				}
+			}
+		}
+		else if (strncmp("-l", arg, 2) == 0) {
+			time_limit = strtoull(arg + 2, NULL, 10) * 1000000ULL;
+		}
+		else if (strncmp("-j", arg, 2) == 0) {
+			json = arg + 2;
+		}
+		else if (strcmp("-v", arg) == 0) {
+			echo = 1;
+		}
+		else if (strncmp("-x", arg, 2) == 0) {
+			compare = strtoul(arg + 2, NULL, 10);
+		}
+		else if (arg[0] == '-') {
+			printf("Error: unknown option: %s\n", arg);
+			return 1;
+		}
+		else {
+			programs++;
+		}
+	}
+	if (programs == 0 && compare == 0) {
+		printf("usage: %s [-e<engine>] [-l<seconds>] [-j<file>] [-v] [-x<states>] <program.com> ...\n", argv[0]);
+		return 1;
+	}
+	if (engine_count == 0) {
+		engines[engine_count++] = ENGINE_INTERPRETER;
+	}
+
+	FILE* out = stdout;
+	if (json != NULL) {
+		fopen_s(&out, json, "ab");
+		if (out == NULL) {
+			printf("Failed to open result file: %s\n", json);
+			out = stdout;
+		}
+	}
+
+	int status = 0;
+	if (compare != 0) {
+		status = compare_ops(compare);
+	}
+	for (int i = 1; i < argc; ++i) {
+		if (argv[i][0] == '-') {
+			continue;
+		}
+		RESULT first = { 0 };
+		for (int j = 0; j < engine_count; ++j) {
+			RESULT result = run(argv[i], engines[j], time_limit, echo, out);
+			if (strcmp(result.status, "ok") != 0) {
+				status = 1;
+			}
+			if (j == 0) {
+				first = result;
+			}
+			else if (result.instructions != first.instructions || result.cycles != first.cycles) {
+				printf("Error: %s: %s disagrees with %s\n", argv[i], engine_name(engines[j]), engine_name(engines[0]));
+				status = 1;
+			}
+		}
+	}
+
+	if (out != stdout) {
+		fclose(out);
+	}
+	return status;
+}
@@ -0,0 +1,559 @@
+/* dcdd_hostdir.c
+ * Host directory disks - 88-DCDD
+ * Github: https:\\github.com\tommojphillips
+ */
+
+ /* -dB:<directory> presents a host directory as an Altair 8" CP/M 2.2 data disk, so job inputs and
+	outputs move without building or unpacking an image.
+
+	The disk is built when it is mounted: every sector is formatted empty, the files are given
+	allocation blocks in name order and the directory is written. No file data is read then; the first
+	time the guest reads or writes a sector of a file, its whole allocation block is read from the host.
+	Host files should not change while the directory is mounted.
+
+	When the disk is unloaded after the guest wrote to it, the files are read back out of the CP/M
+	directory and every file that is new or differs from the host copy is written to the directory.
+	Files the guest erased are left on the host. Only user 0 is used. Host names that do not fit
+	8.3 are skipped; new files get lower case names.
+
+	LAYOUT (77 tracks of 32 sectors of 137 bytes)
+
+		tracks 0-1     reserved for the system; left empty
+		tracks 2-76    CP/M data area: 2K blocks 0-149, 64 directory entries in block 0;
+		               block 1 is also kept for the directory
+
+	CP/M records are skewed onto the physical sectors: skew[record mod 32] on tracks 0-5 and
+	(skew[record mod 32] * 17) mod 32 on tracks 6-76.
+
+	SECTOR FORMAT
+
+		tracks 0-5     0: track | 80h, 1-2: 0, 3-130: data, 131: FFh, 132: checksum of the data
+		tracks 6-76    0: track | 80h, 1: sector * 17 mod 32, 2-3: 0, 4: checksum of the data, 5-6: 0,
+		               7-134: data, 135: FFh
+
+	CP/M pads text files with ^Z (1Ah). A partial last record is padded with 1Ah going in, and
+	trailing 1Ah bytes are trimmed from the last record coming out.
+ */
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#include "dcdd_hostdir.h"
+#include "88_dcdd.h"
+#include "file.h"
+
+#define DCDD_SECTORS       (DCDD_TRACKS_PER_DISK * DCDD_SECTORS_PER_TRACK)
+#define CPM_BLOCK_RECORDS  (DCDD_CPM_BLOCK / DCDD_CPM_RECORD)
+#define CPM_ENTRY_BLOCKS   16  // block pointers per directory entry
+#define CPM_ENTRY_RECORDS  (CPM_ENTRY_BLOCKS * CPM_BLOCK_RECORDS)
+#define CPM_EXTENT_RECORDS 128 // records per logical extent
+#define CPM_ENTRY          32  // bytes per directory entry
+#define CPM_CAPACITY       (DCDD_CPM_BLOCKS * DCDD_CPM_BLOCK)
+#define CPM_EOF            0x1A
+
+#define sector_set(bitmap, i) ((bitmap)[(i) >> 5] & (1u << ((i) & 31)))
+
+typedef struct {
+	char* name;      // host file name
+	uint8_t cpm[11]; // CP/M name and type, space padded
+} HOSTDIR_FILE;
+
+struct HOSTDIR {
+	char* path;     // host directory
+	int writeback;  // write changed files back on unload; cleared when detached
+	HOSTDIR_FILE files[DCDD_CPM_DIR_ENTRIES];
+	uint32_t count;
+	uint8_t owner[DCDD_CPM_BLOCKS]; // file index + 1 that owns the block, or 0
+	uint8_t nth[DCDD_CPM_BLOCKS];   // block number within the file
+	uint32_t pending[DCDD_TRACKS_PER_DISK]; // sectors not read from the host yet; same layout as dirty
+};
+
+static const uint8_t skew[DCDD_SECTORS_PER_TRACK] = {
+	0,  8, 16, 24,  2, 10, 18, 26,  4, 12, 20, 28,  6, 14, 22, 30,
+	1,  9, 17, 25,  3, 11, 19, 27,  5, 13, 21, 29,  7, 15, 23, 31
+};
+
+static uint32_t record_sector(uint32_t record) {
+	/* CP/M record in the data area -> sector on the disk */
+	uint32_t track = DCDD_CPM_RESERVED_TRACKS + record / DCDD_SECTORS_PER_TRACK;
+	uint32_t sector = skew[record % DCDD_SECTORS_PER_TRACK];
+	if (track >= DCDD_CPM_SYSTEM_TRACKS) {
+		sector = (sector * 17) % DCDD_SECTORS_PER_TRACK;
+	}
+	return track * DCDD_SECTORS_PER_TRACK + sector;
+}
+static int sector_record(uint32_t sector, uint32_t* record) {
+	uint32_t track = sector / DCDD_SECTORS_PER_TRACK;
+	if (track < DCDD_CPM_RESERVED_TRACKS) {
+		return 1;
+	}
+	uint32_t first = (track - DCDD_CPM_RESERVED_TRACKS) * DCDD_SECTORS_PER_TRACK;
+	for (uint32_t i = 0; i < DCDD_SECTORS_PER_TRACK; ++i) {
+		if (record_sector(first + i) == sector) {
+			*record = first + i;
+			return 0;
+		}
+	}
+	return 1;
+}
+static uint8_t* sector_data(uint8_t* buffer, uint32_t sector) {
+	uint32_t track = sector / DCDD_SECTORS_PER_TRACK;
+	return buffer + sector * DCDD_BYTES_PER_SECTOR + (track < DCDD_CPM_SYSTEM_TRACKS ? 3 : 7);
+}
+static void format_sector(uint8_t* buffer, uint32_t sector, const uint8_t* data) {
+	uint8_t* s = buffer + sector * DCDD_BYTES_PER_SECTOR;
+	uint32_t track = sector / DCDD_SECTORS_PER_TRACK;
+	uint8_t checksum = 0;
+	for (int i = 0; i < DCDD_CPM_RECORD; ++i) {
+		checksum += data[i];
+	}
+	memset(s, 0, DCDD_BYTES_PER_SECTOR);
+	s[0] = (uint8_t)track | 0x80;
+	if (track < DCDD_CPM_SYSTEM_TRACKS) {
+		memcpy(s + 3, data, DCDD_CPM_RECORD);
+		s[131] = 0xFF;
+		s[132] = checksum;
+	}
+	else {
+		s[1] = (uint8_t)(((sector % DCDD_SECTORS_PER_TRACK) * 17) % DCDD_SECTORS_PER_TRACK);
+		s[4] = checksum;
+		memcpy(s + 7, data, DCDD_CPM_RECORD);
+		s[135] = 0xFF;
+	}
+}
+
+static int cpm_name(const char* name, uint8_t* cpm) {
+	/* host name -> space padded upper case 8.3; returns 1 if it does not fit */
+	const char* dot = strrchr(name, '.');
+	size_t len = dot != NULL ? (size_t)(dot - name) : strlen(name);
+	size_t ext = dot != NULL ? strlen(dot + 1) : 0;
+	if (len == 0 || len > 8 || ext > 3 || (dot != NULL && ext == 0)) {
+		return 1;
+	}
+	memset(cpm, ' ', 11);
+	for (size_t i = 0; i < len + ext; ++i) {
+		char c = i < len ? name[i] : dot[1 + i - len];
+		if (c <= ' ' || c >= 0x7F || strchr("<>.,;:=?*[]", c) != NULL) {
+			return 1;
+		}
+		cpm[i < len ? i : 8 + i - len] = (uint8_t)toupper(c);
+	}
+	return 0;
+}
+static void host_name(const uint8_t* cpm, char* name) {
+	/* 8.3 -> lower case host name; name holds at least 13 bytes */
+	size_t n = 0;
+	int dot = 0;
+	for (int i = 0; i < 11; ++i) {
+		char c = (char)cpm[i];
+		if (c == ' ') {
+			continue;
+		}
+		if (i >= 8 && !dot) {
+			name[n++] = '.';
+			dot = 1;
+		}
+		name[n++] = c <= ' ' || c == '.' || c == '/' || c == '\\' ? '_' : (char)tolower(c);
+	}
+	if (n == 0) {
+		name[n++] = '_';
+	}
+	name[n] = '\0';
+}
+static int join(char* out, const char* dir, const char* name) {
+	int len = snprintf(out, DCDD_HOSTDIR_PATH, "%s/%s", dir, name);
+	return len < 0 || len >= DCDD_HOSTDIR_PATH;
+}
+
+static void fill_block(DISK* d, uint32_t block) {
+	HOSTDIR* h = d->host;
+	uint8_t data[DCDD_CPM_BLOCK];
+	memset(data, DCDD_CPM_EMPTY, sizeof(data));
+
+	if (h->owner[block] != 0) {
+		char path[DCDD_HOSTDIR_PATH];
+		HOSTDIR_FILE* f = &h->files[h->owner[block] - 1];
+		FILE* file = NULL;
+		if (join(path, h->path, f->name) == 0) {
+			fopen_s(&file, path, "rb");
+		}
+		if (file == NULL) {
+			printf("Failed to open host file: %s/%s\n", h->path, f->name);
+		}
+		else {
+			fseek(file, (long)h->nth[block] * DCDD_CPM_BLOCK, SEEK_SET);
+			size_t len = fread(data, 1, DCDD_CPM_BLOCK, file);
+			fclose(file);
+			if (len % DCDD_CPM_RECORD != 0) {
+				memset(data + len, CPM_EOF, DCDD_CPM_RECORD - len % DCDD_CPM_RECORD);
+			}
+		}
+	}
+
+	for (uint32_t i = 0; i < CPM_BLOCK_RECORDS; ++i) {
+		uint32_t sector = record_sector(block * CPM_BLOCK_RECORDS + i);
+		if (sector_set(h->pending, sector)) {
+			format_sector(d->buffer, sector, data + i * DCDD_CPM_RECORD);
+			h->pending[sector >> 5] &= ~(1u << (sector & 31));
+		}
+	}
+}
+void dcdd_fill_sector(DISK* d, uint32_t sector) {
+	if (!sector_set(d->host->pending, sector)) {
+		return;
+	}
+	uint32_t record;
+	if (sector_record(sector, &record) == 0) {
+		fill_block(d, record / CPM_BLOCK_RECORDS);
+	}
+	d->host->pending[sector >> 5] &= ~(1u << (sector & 31));
+}
+void dcdd_fill_hostdir(DISK* d) {
+	if (d->host == NULL) {
+		return;
+	}
+	for (uint32_t i = 0; i < DCDD_SECTORS; ++i) {
+		dcdd_fill_sector(d, i);
+	}
+}
+
+static int add_file(DISK* d, uint8_t* directory, uint32_t* entry, uint32_t* block, const char* name, uint64_t size) {
+	/* give the file directory entries and blocks; returns 1 if it was skipped */
+	HOSTDIR* h = d->host;
+	uint8_t cpm[11];
+	if (cpm_name(name, cpm) != 0) {
+		printf("%s\t-> not an 8.3 name, skipped\n", name);
+		return 1;
+	}
+	for (uint32_t i = 0; i < h->count; ++i) {
+		if (memcmp(h->files[i].cpm, cpm, 11) == 0) {
+			printf("%s\t-> same CP/M name as %s, skipped\n", name, h->files[i].name);
+			return 1;
+		}
+	}
+
+	uint32_t records = (uint32_t)((size + DCDD_CPM_RECORD - 1) / DCDD_CPM_RECORD);
+	uint32_t blocks = (records + CPM_BLOCK_RECORDS - 1) / CPM_BLOCK_RECORDS;
+	uint32_t entries = records == 0 ? 1 : (records + CPM_ENTRY_RECORDS - 1) / CPM_ENTRY_RECORDS;
+	if (size > CPM_CAPACITY || *entry + entries > DCDD_CPM_DIR_ENTRIES || *block + blocks > DCDD_CPM_BLOCKS) {
+		printf("%s\t-> disk full, skipped\n", name);
+		return 1;
+	}
+	HOSTDIR_FILE* f = &h->files[h->count];
+	f->name = strdup(name);
+	if (f->name == NULL) {
+		return 1;
+	}
+	memcpy(f->cpm, cpm, 11);
+	h->count++;
+
+	for (uint32_t k = 0; k < entries; ++k) {
+		uint8_t* e = directory + (*entry)++ * CPM_ENTRY;
+		uint32_t n = records - k * CPM_ENTRY_RECORDS;
+		if (n > CPM_ENTRY_RECORDS) {
+			n = CPM_ENTRY_RECORDS;
+		}
+		/* EX/S2 hold the last logical extent in the entry, RC the records in it */
+		uint32_t last = n == 0 ? 0 : (n - 1) / CPM_EXTENT_RECORDS;
+		uint32_t extent = k * (DCDD_CPM_EXTENT_MASK + 1) + last;
+		memset(e, 0, CPM_ENTRY);
+		memcpy(e + 1, cpm, 11);
+		e[12] = extent & 0x1F;
+		e[14] = (uint8_t)(extent >> 5);
+		e[15] = (uint8_t)(n - last * CPM_EXTENT_RECORDS);
+		for (uint32_t i = 0; i < CPM_ENTRY_BLOCKS && k * CPM_ENTRY_BLOCKS + i < blocks; ++i) {
+			uint32_t b = *block + k * CPM_ENTRY_BLOCKS + i;
+			e[16 + i] = (uint8_t)b;
+			h->owner[b] = (uint8_t)h->count;
+			h->nth[b] = (uint8_t)(k * CPM_ENTRY_BLOCKS + i);
+			for (uint32_t r = 0; r < CPM_BLOCK_RECORDS; ++r) {
+				uint32_t sector = record_sector(b * CPM_BLOCK_RECORDS + r);
+				h->pending[sector >> 5] |= 1u << (sector & 31);
+			}
+		}
+	}
+	*block += blocks;
+	return 0;
+}
+
+static int compare_names(const void* a, const void* b) {
+	return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+#ifdef _WIN32
+
+int dcdd_is_directory(const char* path) {
+	return 0;
+}
+static int scan(DISK* d, uint8_t* directory) {
+	printf("Error: directory disks need a POSIX host\n");
+	return 1;
+}
+
+#else
+
+int dcdd_is_directory(const char* path) {
+	struct stat info;
+	return stat(path, &info) == 0 && S_ISDIR(info.st_mode);
+}
+static int scan(DISK* d, uint8_t* directory) {
+	/* lay the regular files in the directory out in name order, so the image is the same every mount */
+	DIR* dir = opendir(d->host->path);
+	if (dir == NULL) {
+		printf("Failed to open directory: %s\n", d->host->path);
+		return 1;
+	}
+	char** names = NULL;
+	size_t count = 0;
+	size_t size = 0;
+	struct dirent* ent;
+	while ((ent = readdir(dir)) != NULL) {
+		if (ent->d_name[0] == '.') {
+			continue;
+		}
+		if (count == size) {
+			size = size == 0 ? 64 : size * 2;
+			char** grown = (char**)realloc(names, size * sizeof(char*));
+			if (grown == NULL) {
+				break;
+			}
+			names = grown;
+		}
+		names[count] = strdup(ent->d_name);
+		if (names[count] != NULL) {
+			count++;
+		}
+	}
+	closedir(dir);
+	if (count > 0) {
+		qsort(names, count, sizeof(char*), compare_names);
+	}
+
+	uint32_t entry = 0;
+	uint32_t block = DCDD_CPM_DIR_BLOCKS;
+	for (size_t i = 0; i < count; ++i) {
+		char path[DCDD_HOSTDIR_PATH];
+		struct stat info;
+		if (join(path, d->host->path, names[i]) == 0 && stat(path, &info) == 0 && S_ISREG(info.st_mode)) {
+			add_file(d, directory, &entry, &block, names[i], (uint64_t)info.st_size);
+		}
+		free(names[i]);
+	}
+	free(names);
+	return 0;
+}
+
+#endif
+
+int dcdd_load_hostdir(DCDD* dcdd, uint8_t disk, const char* path) {
+	DISK* d = &dcdd->disks[disk];
+	size_t len = strlen(path) + 1;
+	d->filename = (char*)malloc(len);
+	d->buffer = (uint8_t*)malloc(DCDD_DISK_SIZE);
+	d->host = (HOSTDIR*)calloc(1, sizeof(HOSTDIR));
+	if (d->filename == NULL || d->buffer == NULL || d->host == NULL) {
+		printf("Failed to allocate disk buffer: %s\n", path);
+		dcdd_unload_disk(dcdd, disk);
+		return 1;
+	}
+	memcpy(d->filename, path, len);
+	d->host->path = d->filename;
+	d->host->writeback = 1;
+	memset(d->dirty, 0, sizeof(d->dirty));
+	d->dirty_count = 0;
+
+	/* a freshly formatted disk */
+	uint8_t empty[DCDD_CPM_RECORD];
+	memset(empty, DCDD_CPM_EMPTY, sizeof(empty));
+	for (uint32_t i = 0; i < DCDD_SECTORS; ++i) {
+		format_sector(d->buffer, i, empty);
+	}
+
+	uint8_t directory[DCDD_CPM_DIR_ENTRIES * CPM_ENTRY];
+	memset(directory, DCDD_CPM_EMPTY, sizeof(directory));
+	if (scan(d, directory) != 0) {
+		dcdd_unload_disk(dcdd, disk);
+		return 1;
+	}
+	for (uint32_t i = 0; i < sizeof(directory) / DCDD_CPM_RECORD; ++i) {
+		format_sector(d->buffer, record_sector(i), directory + i * DCDD_CPM_RECORD);
+	}
+	return 0;
+}
+
+static int changed(const char* path, const uint8_t* data, uint32_t len) {
+	/* does the host file differ from <data> once both are padded to a whole record */
+	FILE* file = NULL;
+	fopen_s(&file, path, "rb");
+	if (file == NULL) {
+		return 1;
+	}
+	uint8_t buffer[DCDD_CPM_RECORD];
+	uint32_t pos = 0;
+	size_t n;
+	int differs = 0;
+	while (!differs && (n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+		if (n < sizeof(buffer)) {
+			memset(buffer + n, CPM_EOF, sizeof(buffer) - n);
+		}
+		differs = pos + DCDD_CPM_RECORD > len || memcmp(buffer, data + pos, DCDD_CPM_RECORD) != 0;
+		pos += DCDD_CPM_RECORD;
+	}
+	fclose(file);
+	return differs || pos != len;
+}
+static int write_file(const char* path, const uint8_t* data, uint32_t len) {
+	char tmp[DCDD_HOSTDIR_PATH];
+	if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp)) {
+		return 1;
+	}
+	FILE* file = NULL;
+	fopen_s(&file, tmp, "wb");
+	if (file == NULL) {
+		printf("Failed to open host file: %s\n", tmp);
+		return 1;
+	}
+	if (fwrite(data, 1, len, file) != len || fflush(file) != 0) {
+		printf("Failed to write host file: %s\n", tmp);
+		fclose(file);
+		remove(tmp);
+		return 1;
+	}
+	fclose(file);
+#ifdef _WIN32
+	remove(path);
+#endif
+	if (rename(tmp, path) != 0) {
+		printf("Failed to replace host file: %s\n", path);
+		remove(tmp);
+		return 1;
+	}
+	return 0;
+}
+
+static int write_files(DISK* d, uint8_t disk, const char* path) {
+	dcdd_fill_hostdir(d);
+
+	uint8_t directory[DCDD_CPM_DIR_ENTRIES * CPM_ENTRY];
+	for (uint32_t i = 0; i < sizeof(directory) / DCDD_CPM_RECORD; ++i) {
+		memcpy(directory + i * DCDD_CPM_RECORD, sector_data(d->buffer, record_sector(i)), DCDD_CPM_RECORD);
+	}
+	uint8_t* data = (uint8_t*)malloc(CPM_CAPACITY);
+	if (data == NULL) {
+		return 1;
+	}
+
+	int status = 0;
+	uint8_t done[DCDD_CPM_DIR_ENTRIES] = { 0 };
+	for (uint32_t i = 0; i < DCDD_CPM_DIR_ENTRIES; ++i) {
+		uint8_t* e = directory + i * CPM_ENTRY;
+		if (e[0] != 0 || done[i]) {
+			continue;
+		}
+		uint8_t cpm[11];
+		for (int c = 0; c < 11; ++c) {
+			cpm[c] = e[1 + c] & 0x7F; // drop the attribute bits
+		}
+
+		/* gather every extent of the file */
+		uint32_t records = 0;
+		memset(data, 0, CPM_CAPACITY);
+		for (uint32_t j = i; j < DCDD_CPM_DIR_ENTRIES; ++j) {
+			uint8_t* x = directory + j * CPM_ENTRY;
+			int same = x[0] == 0;
+			for (int c = 0; c < 11 && same; ++c) {
+				same = (x[1 + c] & 0x7F) == cpm[c];
+			}
+			if (!same) {
+				continue;
+			}
+			done[j] = 1;
+			uint32_t extent = ((x[14] & 0x3F) << 5) | (x[12] & 0x1F);
+			uint32_t k = extent / (DCDD_CPM_EXTENT_MASK + 1);
+			uint32_t n = (extent & DCDD_CPM_EXTENT_MASK) * CPM_EXTENT_RECORDS + (x[15] > CPM_EXTENT_RECORDS ? CPM_EXTENT_RECORDS : x[15]);
+			if (k * CPM_ENTRY_RECORDS + n > records) {
+				records = k * CPM_ENTRY_RECORDS + n;
+			}
+			for (uint32_t b = 0; b < CPM_ENTRY_BLOCKS; ++b) {
+				uint32_t block = x[16 + b];
+				uint32_t first = (k * CPM_ENTRY_BLOCKS + b) * CPM_BLOCK_RECORDS;
+				if (block == 0 || block >= DCDD_CPM_BLOCKS || (first + CPM_BLOCK_RECORDS) * DCDD_CPM_RECORD > CPM_CAPACITY) {
+					continue;
+				}
+				for (uint32_t r = 0; r < CPM_BLOCK_RECORDS; ++r) {
+					memcpy(data + (first + r) * DCDD_CPM_RECORD, sector_data(d->buffer, record_sector(block * CPM_BLOCK_RECORDS + r)), DCDD_CPM_RECORD);
+				}
+			}
+		}
+		if (records * DCDD_CPM_RECORD > CPM_CAPACITY) {
+			records = CPM_CAPACITY / DCDD_CPM_RECORD;
+		}
+
+		/* keep the host name the file came in with */
+		char name[16];
+		host_name(cpm, name);
+		for (uint32_t f = 0; d->host != NULL && f < d->host->count; ++f) {
+			if (memcmp(d->host->files[f].cpm, cpm, 11) == 0) {
+				snprintf(name, sizeof(name), "%s", d->host->files[f].name);
+				break;
+			}
+		}
+		char file[DCDD_HOSTDIR_PATH];
+		if (join(file, path, name) != 0) {
+			status = 1;
+			continue;
+		}
+
+		uint32_t len = records * DCDD_CPM_RECORD;
+		if (!changed(file, data, len)) {
+			continue;
+		}
+		while (len > 0 && len > (records - 1) * DCDD_CPM_RECORD && data[len - 1] == CPM_EOF) {
+			len--;
+		}
+		if (write_file(file, data, len) != 0) {
+			status = 1;
+			continue;
+		}
+		printf("%s\t<- %c:\n", file, 'A' + disk);
+	}
+	free(data);
+	return status;
+}
+
+void dcdd_unload_hostdir(DCDD* dcdd, uint8_t disk) {
+	DISK* d = &dcdd->disks[disk];
+	HOSTDIR* h = d->host;
+	if (h->writeback && d->dirty_count != 0 && d->buffer != NULL) {
+		write_files(d, disk, h->path);
+	}
+	for (uint32_t i = 0; i < h->count; ++i) {
+		free(h->files[i].name);
+	}
+	free(h);
+	d->host = NULL;
+}
+void dcdd_detach_hostdir(DCDD* dcdd, uint8_t disk) {
+	/* the guest's writes stay on the disk; nothing goes back to the directory */
+	dcdd->disks[disk].host->writeback = 0;
+}
+int dcdd_export_files(DCDD* dcdd, uint8_t disk, const char* path) {
+	DISK* d = &dcdd->disks[disk];
+	if (d->buffer == NULL) {
+		printf("Error: no disk in %c:\n", 'A' + disk);
+		return 1;
+	}
+	return write_files(d, disk, path);
+}
@@ -0,0 +1,37 @@
+/* dcdd_hostdir.h
+ * Host directory disks - 88-DCDD
+ * Github: https:\\github.com\tommojphillips
+ */
+
+#ifndef DCDD_HOSTDIR_H
+#define DCDD_HOSTDIR_H
+
+#include <stdint.h>
+
+#include "88_dcdd.h"
+
+#define DCDD_CPM_RESERVED_TRACKS 2    // tracks before the CP/M data area (the system)
+#define DCDD_CPM_SYSTEM_TRACKS   6    // tracks in the system sector format; the rest use the data format
+#define DCDD_CPM_RECORD          128  // bytes per CP/M record
+#define DCDD_CPM_BLOCK           2048 // bytes per allocation block
+#define DCDD_CPM_BLOCKS          150  // allocation blocks in the data area (DSM + 1)
+#define DCDD_CPM_DIR_BLOCKS      2    // blocks reserved for the directory (AL0)
+#define DCDD_CPM_DIR_ENTRIES     64   // directory entries (DRM + 1)
+#define DCDD_CPM_EXTENT_MASK     1    // EXM; 2K blocks, 8 bit block pointers
+#define DCDD_CPM_EMPTY           0xE5 // formatted data and empty directory entries
+
+#define DCDD_HOSTDIR_PATH        1024 // longest host file path
+
+int dcdd_is_directory(const char* path);
+int dcdd_load_hostdir(DCDD* dcdd, uint8_t disk, const char* path);
+void dcdd_unload_hostdir(DCDD* dcdd, uint8_t disk);
+void dcdd_detach_hostdir(DCDD* dcdd, uint8_t disk);
+
+/* read the host file data behind a sector the first time it is used */
+void dcdd_fill_sector(DISK* disk, uint32_t sector);
+void dcdd_fill_hostdir(DISK* disk);
+
+/* write the files on the CP/M disk in <disk> to the directory <path> */
+int dcdd_export_files(DCDD* dcdd, uint8_t disk, const char* path);
+
+#endif
@@ -0,0 +1,424 @@
+/* dcdd_overlay.c
+ * Copy on write overlay disks - 88-DCDD
+ * Github: https:\\github.com\tommojphillips
+ */
+
+ /* An overlay mount, -dA:<base>,<delta>, never writes the base image. The base is mapped private
+	(copy on write) where the host allows it, so every machine in the process that mounts the same base
+	shares its pages until it writes a sector. Written sectors are appended to the delta file
+	on every flush; with an empty <delta> they are kept in memory only.
+
+	DELTA FILE (little endian)
+
+		magic       char[4]  "A88D"
+		version     u16
+		sector size u16      137
+		base hash   u64      FNV-1a of the base image the delta applies to
+		then records of: sector u16, data[137]
+
+	A later record for a sector replaces an earlier one. A short record at the end (the emulator
+	died mid-append) is ignored. The delta is compacted to one record per sector when it is loaded.
+	A delta made from a different base is refused.
+
+	COMMANDS (script and server, see dcdd_overlay_command)
+
+		discard <X>         drop the delta; the disk is the base again
+		commit <X>          write the delta into the base image (through the journal) and empty it.
+		                    Other machines on the same base see the committed sectors they have not
+		                    written themselves, so commit only while they are stopped.
+		delta <X> <file>    write the delta, compacted, to <file>
+ */
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "dcdd_overlay.h"
+#include "88_dcdd.h"
+#include "file.h"
+#include "snapshot.h"
+
+#define DCDD_SECTORS   (DCDD_TRACKS_PER_DISK * DCDD_SECTORS_PER_TRACK)
+#define DCDD_DELTA_TMP ".tmp"
+
+#define sector_set(bitmap, i) ((bitmap)[(i) >> 5] & (1u << ((i) & 31)))
+
+static int map_base(DISK* d) {
+	d->mapped = 0;
+#ifndef _WIN32
+	int fd = open(d->base, O_RDONLY);
+	if (fd < 0) {
+		printf("Failed to open disk file: %s\n", d->base);
+		return 1;
+	}
+	struct stat info;
+	if (fstat(fd, &info) == 0 && info.st_size >= DCDD_DISK_SIZE) {
+		void* map = mmap(NULL, DCDD_DISK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		if (map != MAP_FAILED) {
+			close(fd);
+			d->buffer = (uint8_t*)map;
+			d->mapped = 1;
+			return 0;
+		}
+	}
+	close(fd);
+#endif
+
+	/* a short image, or no private mappings; keep a copy */
+	FILE* file = NULL;
+	fopen_s(&file, d->base, "rb");
+	if (file == NULL) {
+		printf("Failed to open disk file: %s\n", d->base);
+		return 1;
+	}
+	d->buffer = (uint8_t*)malloc(DCDD_DISK_SIZE);
+	if (d->buffer == NULL) {
+		printf("Failed to allocate disk buffer: %s\n", d->base);
+		fclose(file);
+		return 1;
+	}
+	memset(d->buffer, 0, DCDD_DISK_SIZE);
+	fread(d->buffer, 1, DCDD_DISK_SIZE, file);
+	fclose(file);
+	return 0;
+}
+static void unmap_base(DISK* d) {
+#ifndef _WIN32
+	if (d->mapped) {
+		munmap(d->buffer, DCDD_DISK_SIZE);
+		d->buffer = NULL;
+		d->mapped = 0;
+		return;
+	}
+#endif
+	free(d->buffer);
+	d->buffer = NULL;
+}
+
+static const char* delta_name(DISK* d) {
+	return strchr(d->filename, ',') + 1;
+}
+
+static int write_delta(DISK* d, const char* filename) {
+	/* header, then one record for every sector that differs from the base */
+	FILE* file = NULL;
+	fopen_s(&file, filename, "wb");
+	if (file == NULL) {
+		printf("Failed to open disk delta: %s\n", filename);
+		return 1;
+	}
+
+	uint8_t header[DCDD_DELTA_HEADER];
+	memcpy(header, DCDD_DELTA_MAGIC, 4);
+	header[4] = DCDD_DELTA_VERSION & 0xFF;
+	header[5] = DCDD_DELTA_VERSION >> 8;
+	header[6] = DCDD_BYTES_PER_SECTOR & 0xFF;
+	header[7] = DCDD_BYTES_PER_SECTOR >> 8;
+	for (int i = 0; i < 8; ++i) {
+		header[8 + i] = (uint8_t)(d->base_hash >> (i * 8));
+	}
+	fwrite(header, 1, DCDD_DELTA_HEADER, file);
+
+	for (uint16_t i = 0; i < DCDD_SECTORS; ++i) {
+		if (sector_set(d->delta, i) || sector_set(d->dirty, i)) {
+			uint8_t record[2] = { i & 0xFF, i >> 8 };
+			fwrite(record, 1, 2, file);
+			fwrite(d->buffer + i * DCDD_BYTES_PER_SECTOR, 1, DCDD_BYTES_PER_SECTOR, file);
+		}
+	}
+	if (fflush(file) != 0) {
+		printf("Failed to write disk delta: %s\n", filename);
+		fclose(file);
+		return 1;
+	}
+	fclose(file);
+	return 0;
+}
+
+static int read_delta(DISK* d, FILE* file) {
+	/* apply the records to the buffer; returns 1 if the delta is not for this base */
+	uint8_t header[DCDD_DELTA_HEADER];
+	size_t len = fread(header, 1, DCDD_DELTA_HEADER, file);
+	if (len == 0) {
+		/* new, empty delta */
+		return 0;
+	}
+	uint64_t hash = 0;
+	for (int i = 0; i < 8 && len == DCDD_DELTA_HEADER; ++i) {
+		hash |= (uint64_t)header[8 + i] << (i * 8);
+	}
+	if (len != DCDD_DELTA_HEADER || memcmp(header, DCDD_DELTA_MAGIC, 4) != 0 ||
+		(header[4] | (header[5] << 8)) != DCDD_DELTA_VERSION ||
+		(header[6] | (header[7] << 8)) != DCDD_BYTES_PER_SECTOR || hash != d->base_hash) {
+		return 1;
+	}
+
+	uint8_t record[2];
+	uint8_t data[DCDD_BYTES_PER_SECTOR];
+	while (fread(record, 1, 2, file) == 2 && fread(data, 1, DCDD_BYTES_PER_SECTOR, file) == DCDD_BYTES_PER_SECTOR) {
+		uint16_t sector = record[0] | (record[1] << 8);
+		if (sector >= DCDD_SECTORS) {
+			break;
+		}
+		memcpy(d->buffer + sector * DCDD_BYTES_PER_SECTOR, data, DCDD_BYTES_PER_SECTOR);
+		d->delta[sector >> 5] |= 1u << (sector & 31);
+	}
+	return 0;
+}
+
+static int restart_delta(DISK* d) {
+	/* rewrite the delta file compacted and reopen it for appending */
+	const char* name = delta_name(d);
+	if (d->file != NULL) {
+		fclose(d->file);
+		d->file = NULL;
+	}
+
+	size_t len = strlen(name);
+	char* tmp = (char*)malloc(len + sizeof(DCDD_DELTA_TMP));
+	if (tmp == NULL) {
+		return 1;
+	}
+	memcpy(tmp, name, len);
+	memcpy(tmp + len, DCDD_DELTA_TMP, sizeof(DCDD_DELTA_TMP));
+	if (write_delta(d, tmp) != 0) {
+		remove(tmp);
+		free(tmp);
+		return 1;
+	}
+#ifdef _WIN32
+	remove(name);
+#endif
+	if (rename(tmp, name) != 0) {
+		printf("Failed to replace disk delta: %s\n", name);
+		remove(tmp);
+		free(tmp);
+		return 1;
+	}
+	free(tmp);
+
+	fopen_s(&d->file, name, "ab");
+	if (d->file == NULL) {
+		printf("Failed to open disk delta: %s\n", name);
+		return 1;
+	}
+	for (int i = 0; i < DCDD_TRACKS_PER_DISK; ++i) {
+		d->delta[i] |= d->dirty[i];
+	}
+	memset(d->dirty, 0, sizeof(d->dirty));
+	d->dirty_count = 0;
+	return 0;
+}
+
+int dcdd_load_overlay(DCDD* dcdd, uint8_t disk, const char* spec) {
+	DISK* d = &dcdd->disks[disk];
+	const char* comma = strchr(spec, ',');
+	size_t len = strlen(spec) + 1;
+	size_t base_len = comma - spec;
+	d->filename = (char*)malloc(len);
+	d->base = (char*)malloc(base_len + 1);
+	if (d->filename == NULL || d->base == NULL) {
+		printf("Failed to allocate disk buffer: %s\n", spec);
+		dcdd_unload_disk(dcdd, disk);
+		return 1;
+	}
+	memcpy(d->filename, spec, len);
+	memcpy(d->base, spec, base_len);
+	d->base[base_len] = '\0';
+	memset(d->dirty, 0, sizeof(d->dirty));
+	memset(d->delta, 0, sizeof(d->delta));
+	d->dirty_count = 0;
+
+	if (map_base(d) != 0) {
+		dcdd_unload_disk(dcdd, disk);
+		return 1;
+	}
+	d->base_hash = snapshot_hash(d->buffer, DCDD_DISK_SIZE);
+
+	const char* delta = comma + 1;
+	if (delta[0] == '\0') {
+		/* the delta lives in memory */
+		return 0;
+	}
+
+	FILE* file = NULL;
+	fopen_s(&file, delta, "rb");
+	if (file != NULL) {
+		int status = read_delta(d, file);
+		fclose(file);
+		if (status != 0) {
+			printf("Error: %s is not a delta of %s\n", delta, d->base);
+			dcdd_unload_disk(dcdd, disk);
+			return 1;
+		}
+	}
+	if (restart_delta(d) != 0) {
+		dcdd_unload_disk(dcdd, disk);
+		return 1;
+	}
+	return 0;
+}
+void dcdd_unload_overlay(DCDD* dcdd, uint8_t disk) {
+	/* the delta was flushed and closed by dcdd_unload_disk */
+	DISK* d = &dcdd->disks[disk];
+	unmap_base(d);
+	free(d->base);
+	d->base = NULL;
+	d->base_hash = 0;
+	memset(d->delta, 0, sizeof(d->delta));
+}
+int dcdd_flush_overlay(DCDD* dcdd, uint8_t disk) {
+	DISK* d = &dcdd->disks[disk];
+	if (d->dirty_count == 0 || d->file == NULL) {
+		return 0;
+	}
+
+	for (uint16_t i = 0; i < DCDD_SECTORS; ++i) {
+		if (sector_set(d->dirty, i)) {
+			uint8_t record[2] = { i & 0xFF, i >> 8 };
+			fwrite(record, 1, 2, d->file);
+			fwrite(d->buffer + i * DCDD_BYTES_PER_SECTOR, 1, DCDD_BYTES_PER_SECTOR, d->file);
+		}
+	}
+	if (fflush(d->file) != 0) {
+		/* keep the sectors dirty; they are appended again next time */
+		printf("Failed to write disk delta: %s\n", delta_name(d));
+		return 1;
+	}
+
+	for (int i = 0; i < DCDD_TRACKS_PER_DISK; ++i) {
+		d->delta[i] |= d->dirty[i];
+	}
+	memset(d->dirty, 0, sizeof(d->dirty));
+	d->dirty_count = 0;
+	return 0;
+}
+
+static DISK* overlay(DCDD* dcdd, uint8_t disk) {
+	DISK* d = &dcdd->disks[disk];
+	if (d->base == NULL || d->buffer == NULL) {
+		printf("Error: %c: is not an overlay disk\n", 'A' + disk);
+		return NULL;
+	}
+	return d;
+}
+
+int dcdd_discard_overlay(DCDD* dcdd, uint8_t disk) {
+	DISK* d = overlay(dcdd, disk);
+	if (d == NULL) {
+		return 1;
+	}
+	unmap_base(d);
+	memset(d->dirty, 0, sizeof(d->dirty));
+	memset(d->delta, 0, sizeof(d->delta));
+	d->dirty_count = 0;
+	if (map_base(d) != 0) {
+		dcdd_unload_disk(dcdd, disk);
+		return 1;
+	}
+	d->base_hash = snapshot_hash(d->buffer, DCDD_DISK_SIZE);
+	if (d->file != NULL) {
+		return restart_delta(d);
+	}
+	return 0;
+}
+int dcdd_commit_overlay(DCDD* dcdd, uint8_t disk) {
+	DISK* d = overlay(dcdd, disk);
+	if (d == NULL) {
+		return 1;
+	}
+
+	uint32_t sectors[DCDD_TRACKS_PER_DISK];
+	uint32_t any = 0;
+	for (int i = 0; i < DCDD_TRACKS_PER_DISK; ++i) {
+		sectors[i] = d->delta[i] | d->dirty[i];
+		any |= sectors[i];
+	}
+	if (any == 0) {
+		return 0;
+	}
+
+	FILE* image = NULL;
+	fopen_s(&image, d->base, "r+b");
+	if (image == NULL) {
+		printf("Failed to open disk file: %s\n", d->base);
+		return 1;
+	}
+	int status = dcdd_write_image(d->base, image, d->buffer, sectors);
+	fclose(image);
+	if (status != 0) {
+		return 1;
+	}
+
+	/* the base now holds the delta */
+	d->base_hash = snapshot_hash(d->buffer, DCDD_DISK_SIZE);
+	memset(d->dirty, 0, sizeof(d->dirty));
+	memset(d->delta, 0, sizeof(d->delta));
+	d->dirty_count = 0;
+	if (d->file != NULL) {
+		return restart_delta(d);
+	}
+	return 0;
+}
+int dcdd_export_overlay(DCDD* dcdd, uint8_t disk, const char* filename) {
+	DISK* d = overlay(dcdd, disk);
+	if (d == NULL) {
+		return 1;
+	}
+	return write_delta(d, filename);
+}
+
+int dcdd_overlay_command(DCDD* dcdd, const char* command) {
+	/* "discard <X>", "commit <X>" or "delta <X> <file>" */
+	const char* arg = strchr(command, ' ');
+	if (arg == NULL) {
+		printf("Error: no drive: %s\n", command);
+		return 1;
+	}
+	while (*arg == ' ') {
+		++arg;
+	}
+	uint8_t disk;
+	if (arg[0] >= 'A' && arg[0] <= 'P') {
+		disk = arg[0] - 'A';
+	}
+	else if (arg[0] >= 'a' && arg[0] <= 'p') {
+		disk = arg[0] - 'a';
+	}
+	else {
+		printf("Error: bad drive: %s\n", command);
+		return 1;
+	}
+
+	if (strncmp(command, "discard ", 8) == 0) {
+		return dcdd_discard_overlay(dcdd, disk);
+	}
+	if (strncmp(command, "commit ", 7) == 0) {
+		return dcdd_commit_overlay(dcdd, disk);
+	}
+	if (strncmp(command, "delta ", 6) == 0) {
+		const char* filename = arg + 1;
+		while (*filename == ' ' || *filename == ':') {
+			++filename;
+		}
+		if (*filename == '\0') {
+			printf("Error: no delta file: %s\n", command);
+			return 1;
+		}
+		return dcdd_export_overlay(dcdd, disk, filename);
+	}
+	printf("Error: unknown disk command: %s\n", command);
+	return 1;
+}
@@ -0,0 +1,26 @@
+/* dcdd_overlay.h
+ * Copy on write overlay disks - 88-DCDD
+ * Github: https:\\github.com\tommojphillips
+ */
+
+#ifndef DCDD_OVERLAY_H
+#define DCDD_OVERLAY_H
+
+#include <stdint.h>
+
+#include "88_dcdd.h"
+
+#define DCDD_DELTA_MAGIC   "A88D"
+#define DCDD_DELTA_VERSION 1
+#define DCDD_DELTA_HEADER  16 // magic, version u16, sector size u16, base hash u64
+
+int dcdd_load_overlay(DCDD* dcdd, uint8_t disk, const char* spec);
+void dcdd_unload_overlay(DCDD* dcdd, uint8_t disk);
+int dcdd_flush_overlay(DCDD* dcdd, uint8_t disk);
+
+int dcdd_discard_overlay(DCDD* dcdd, uint8_t disk);
+int dcdd_commit_overlay(DCDD* dcdd, uint8_t disk);
+int dcdd_export_overlay(DCDD* dcdd, uint8_t disk, const char* filename);
+int dcdd_overlay_command(DCDD* dcdd, const char* command);
+
+#endif
@@ -0,0 +1,179 @@
+/* dcdd_trap.c
+ * High-level disk trap - 88-DCDD
+ * Github: https:\\github.com\tommojphillips
+ */
+
+ /* Guest disk routines move a sector one byte per IN/OUT. When the CPU is about to enter a known
+  * sector loop, the trap does the work of the loop in one go and leaves the loop to run its final
+  * iteration natively. The final iteration sets A and the flags exactly as the real loop would, so the
+  * trap only has to fix up HL, the loop counter, the disk and the cycle count.
+  *
+  * Loops are recognised by code signature, not address, so relocated code (the DBL copies itself to 4C00)
+  * and BIOS builds for different memory sizes match.
+  *
+  * - SECTOR SEEK (DBL, CP/M BIOS)
+  *		loop:	IN 09h / RAR / JC loop / ANI 1Fh / CMP B / JNZ loop
+  *
+  * - SECTOR READ, 2 BYTES PER ITERATION (DBL)
+  *		loop:	IN 08h / ORA A / JM loop / IN 0Ah / MOV M,A / INX H / DCR E / JZ exit / DCR E / IN 0Ah / MOV M,A / INX H / JNZ loop
+  *
+  * - SECTOR READ (CP/M BIOS)
+  *		loop:	IN 08h / ORA A / JM loop / IN 0Ah / MOV M,A / INX H / DCR r / JNZ loop
+  *
+  * - SECTOR WRITE (CP/M BIOS)
+  *		loop:	IN 08h / RRC / JC loop / MOV A,M / OUT 0Ah / INX H / DCR r / JNZ loop
+  */
+
+#include <stdint.h>
+
+#include "dcdd_trap.h"
+#include "i8080.h"
+#include "88_dcdd.h"
+
+#define OP_IN  0xDB
+#define ANY    0x100 // any byte
+#define PC_LO  0x101 // low byte of the loop address
+#define PC_HI  0x102 // high byte of the loop address
+#define DCR_R  0x103 // DCR B, DCR C, DCR D or DCR E
+
+#define SEEK_CYCLES       45 // cycles per sector seek iteration
+#define READ_PAIR_CYCLES  98 // cycles per 2 byte read iteration
+#define READ_CYCLES       61 // cycles per read iteration
+#define WRITE_CYCLES      61 // cycles per write iteration
+
+static const uint16_t sector_seek[] = {
+	0xDB, PORT_DCDD_SECTOR, 0x1F, 0xDA, PC_LO, PC_HI, 0xE6, 0x1F, 0xB8, 0xC2, PC_LO, PC_HI
+};
+static const uint16_t sector_read_pair[] = {
+	0xDB, PORT_DCDD_STATUS, 0xB7, 0xFA, PC_LO, PC_HI, 0xDB, PORT_DCDD_DATA, 0x77, 0x23, 0x1D, 0xCA, ANY, ANY,
+	0x1D, 0xDB, PORT_DCDD_DATA, 0x77, 0x23, 0xC2, PC_LO, PC_HI
+};
+static const uint16_t sector_read[] = {
+	0xDB, PORT_DCDD_STATUS, 0xB7, 0xFA, PC_LO, PC_HI, 0xDB, PORT_DCDD_DATA, 0x77, 0x23, DCR_R, 0xC2, PC_LO, PC_HI
+};
+static const uint16_t sector_write[] = {
+	0xDB, PORT_DCDD_STATUS, 0x0F, 0xDA, PC_LO, PC_HI, 0x7E, 0xD3, PORT_DCDD_DATA, 0x23, DCR_R, 0xC2, PC_LO, PC_HI
+};
+
+#define match(cpu, pattern) match_pattern(cpu, pattern, sizeof(pattern) / sizeof(pattern[0]))
+
+static int match_pattern(I8080* cpu, const uint16_t* pattern, int len) {
+	for (int i = 0; i < len; ++i) {
+		uint8_t v = cpu->read_byte(cpu->pc + i);
+		switch (pattern[i]) {
+			case ANY:
+				break;
+			case PC_LO:
+				if (v != (cpu->pc & 0xFF)) return 0;
+				break;
+			case PC_HI:
+				if (v != (cpu->pc >> 8)) return 0;
+				break;
+			case DCR_R:
+				if (v != 0x05 && v != 0x0D && v != 0x15 && v != 0x1D) return 0;
+				break;
+			default:
+				if (v != pattern[i]) return 0;
+				break;
+		}
+	}
+	return 1;
+}
+
+static uint8_t* dcr_register(I8080* cpu, uint8_t opcode) {
+	static const uint8_t regs[] = { REG_B, REG_C, REG_D, REG_E };
+	return &cpu->registers[regs[(opcode >> 3) & 0x03]];
+}
+static uint16_t get_hl(I8080* cpu) {
+	return (cpu->registers[REG_H] << 8) | cpu->registers[REG_L];
+}
+static void set_hl(I8080* cpu, uint16_t value) {
+	cpu->registers[REG_H] = value >> 8;
+	cpu->registers[REG_L] = value & 0xFF;
+}
+
+static int trap_sector_seek(I8080* cpu, DISK* disk) {
+	uint8_t wanted = cpu->registers[REG_B];
+	if (wanted >= DCDD_SECTORS_PER_TRACK) {
+		return 0;
+	}
+
+	/* position the disk one sector before the wanted sector; the next IN 09h reads it. */
+	uint8_t n = (wanted - (uint8_t)(disk->sector + 1)) & (DCDD_SECTORS_PER_TRACK - 1);
+	if (n == 0) {
+		return 0;
+	}
+	disk->sector = (wanted - 1) & (DCDD_SECTORS_PER_TRACK - 1);
+	disk->index = 0;
+	cpu->cycles += n * SEEK_CYCLES;
+	return 1;
+}
+static int trap_sector_read(I8080* cpu, DCDD* dcdd, uint8_t* counter, uint16_t n, uint32_t cycles) {
+	uint16_t hl = get_hl(cpu);
+	for (uint16_t i = 0; i < n; ++i) {
+		cpu->write_byte(hl++, dcdd_read(dcdd));
+	}
+	set_hl(cpu, hl);
+	*counter -= (uint8_t)n;
+	cpu->cycles += cycles;
+	return 1;
+}
+static int trap_sector_write(I8080* cpu, DCDD* dcdd, uint8_t* counter, uint16_t n) {
+	uint16_t hl = get_hl(cpu);
+	for (uint16_t i = 0; i < n; ++i) {
+		dcdd_write(dcdd, cpu->read_byte(hl++));
+	}
+	set_hl(cpu, hl);
+	*counter -= (uint8_t)n;
+	cpu->cycles += n * WRITE_CYCLES;
+	return 1;
+}
+
+int dcdd_trap(I8080* cpu, DCDD* dcdd) {
+	if (cpu->read_byte(cpu->pc) != OP_IN) {
+		return 0;
+	}
+
+	if (dcdd->selector & DCDD_SELECTOR_DRV_SELECT) {
+		return 0;
+	}
+
+	DISK* disk = &dcdd->disks[dcdd->selector];
+	if (disk->buffer == NULL || (disk->status & DCDD_STATUS_HEAD_LOADED)) {
+		return 0;
+	}
+
+	if (!dcdd->rotate && match(cpu, sector_seek)) {
+		/* with rotation timing the seek waits on the clock like the real drive */
+		return trap_sector_seek(cpu, disk);
+	}
+
+	if (match(cpu, sector_read_pair)) {
+		/* E counts down by 2 per iteration; leave the last iteration to the cpu. */
+		uint8_t* e = &cpu->registers[REG_E];
+		if ((disk->status & DCDD_STATUS_READ_READY) || (*e & 1) || *e < 4) {
+			return 0;
+		}
+		return trap_sector_read(cpu, dcdd, e, *e - 2, ((*e - 2) >> 1) * READ_PAIR_CYCLES);
+	}
+
+	if (match(cpu, sector_read)) {
+		uint8_t* r = dcr_register(cpu, cpu->read_byte(cpu->pc + 10));
+		uint16_t n = (*r == 0 ? 0x100 : *r) - 1;
+		if ((disk->status & DCDD_STATUS_READ_READY) || n == 0) {
+			return 0;
+		}
+		return trap_sector_read(cpu, dcdd, r, n, n * READ_CYCLES);
+	}
+
+	if (match(cpu, sector_write)) {
+		uint8_t* r = dcr_register(cpu, cpu->read_byte(cpu->pc + 10));
+		uint16_t n = (*r == 0 ? 0x100 : *r) - 1;
+		if ((disk->status & DCDD_STATUS_WRITE_READY) || n == 0) {
+			return 0;
+		}
+		return trap_sector_write(cpu, dcdd, r, n);
+	}
+
+	return 0;
+}
@@ -0,0 +1,16 @@
+/* dcdd_trap.h
+ * High-level disk trap - 88-DCDD
+ * Github: https:\\github.com\tommojphillips
+ */
+
+#ifndef DCDD_TRAP_H
+#define DCDD_TRAP_H
+
+#include <stdint.h>
+
+#include "i8080.h"
+#include "88_dcdd.h"
+
+int dcdd_trap(I8080* cpu, DCDD* dcdd);
+
+#endif
@@ -0,0 +1,163 @@
+/* evloop.c
+ * Single threaded event loop that multiplexes many machines
+ * Github: https:\\github.com\tommojphillips
+ */
+
+ /* Every machine runs nonblocking: altair8800_step runs one frame and sets machine->resume
+	to when the next frame is due instead of sleeping. The loop steps each machine that is due,
+	then sleeps until the earliest resume.
+
+	A machine that is idle waiting for input sets machine->waiting_input. Its console descriptor
+	is then armed (one shot) with epoll, so input wakes it straight away instead of at the next poll.
+	Descriptors epoll refuses, such as regular files, are served by the resume timer alone.
+	On hosts without epoll the loop sleeps at most EVLOOP_IDLE between rounds. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef __linux__
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#endif
+
+#include "evloop.h"
+#include "altair8800.h"
+#include "timing.h"
+
+typedef struct {
+	int fd;          // descriptor last armed, or -1
+	int unpollable;  // fd can not be waited on
+	uint64_t start;
+} EVLOOP_SLOT;
+
+#ifdef __linux__
+static void evloop_arm(int ep, EVLOOP_SLOT* slot, uint32_t index, int fd) {
+	if (fd != slot->fd) {
+		if (slot->fd >= 0) {
+			epoll_ctl(ep, EPOLL_CTL_DEL, slot->fd, NULL);
+		}
+		slot->fd = fd;
+		slot->unpollable = 0;
+	}
+	if (fd < 0 || slot->unpollable) {
+		return;
+	}
+
+	struct epoll_event event = { 0 };
+	event.events = EPOLLIN | EPOLLONESHOT;
+	event.data.u32 = index;
+	if (epoll_ctl(ep, EPOLL_CTL_MOD, fd, &event) == 0) {
+		return;
+	}
+	/* first use, or the descriptor was closed and its number reused */
+	if (epoll_ctl(ep, EPOLL_CTL_ADD, fd, &event) != 0) {
+		slot->unpollable = 1;
+	}
+}
+#endif
+
+int evloop_run(POOL_JOB* jobs, uint32_t count, uint64_t time_limit) {
+	EVLOOP_SLOT* slots = (EVLOOP_SLOT*)calloc(count > 0 ? count : 1, sizeof(EVLOOP_SLOT));
+	if (slots == NULL) {
+		return 1;
+	}
+#ifdef __linux__
+	int ep = epoll_create1(EPOLL_CLOEXEC);
+	if (ep < 0) {
+		printf("Error: could not create the event loop\n");
+		free(slots);
+		return 1;
+	}
+	struct epoll_event events[EVLOOP_EVENTS];
+#endif
+
+	uint32_t active = 0;
+	uint64_t now = timing_now();
+	for (uint32_t i = 0; i < count; ++i) {
+		slots[i].fd = -1;
+		slots[i].start = now;
+		if (jobs[i].machine == NULL) {
+			jobs[i].status = POOL_JOB_SKIPPED;
+			continue;
+		}
+		jobs[i].status = POOL_JOB_OK;
+		jobs[i].machine->nonblocking = 1;
+		jobs[i].machine->resume = 0;
+		++active;
+	}
+
+	while (active > 0) {
+		int ran = 0;
+		uint64_t next = UINT64_MAX;
+		for (uint32_t i = 0; i < count; ++i) {
+			ALTAIR8800* machine = jobs[i].machine;
+			if (machine == NULL || !machine->nonblocking) {
+				continue;
+			}
+
+			now = timing_now();
+			if (machine->resume <= now) {
+				altair8800_step(machine);
+				ran = 1;
+				now = timing_now();
+			}
+
+			uint64_t elapsed = now - slots[i].start;
+			int timeout = time_limit != 0 && elapsed >= time_limit;
+			if (!machine->running || timeout) {
+				jobs[i].status = timeout ? POOL_JOB_TIMEOUT : POOL_JOB_OK;
+				jobs[i].elapsed = elapsed;
+				machine->nonblocking = 0;
+#ifdef __linux__
+				evloop_arm(ep, &slots[i], i, -1);
+#endif
+				--active;
+				continue;
+			}
+
+#ifdef __linux__
+			if (machine->waiting_input) {
+				evloop_arm(ep, &slots[i], i, machine->console.fd);
+			}
+#endif
+			if (machine->resume < next) {
+				next = machine->resume;
+			}
+			if (time_limit != 0 && slots[i].start + time_limit < next) {
+				next = slots[i].start + time_limit;
+			}
+		}
+		if (active == 0) {
+			break;
+		}
+
+		now = timing_now();
+		uint64_t wait = ran || next <= now ? 0 : next - now;
+#ifdef __linux__
+		/* round up so a due frame is never woken early */
+		int timeout_ms = (int)((wait + 999) / 1000);
+		int n = epoll_wait(ep, events, EVLOOP_EVENTS, timeout_ms);
+		for (int e = 0; e < n; ++e) {
+			ALTAIR8800* machine = jobs[events[e].data.u32].machine;
+			if (machine != NULL && machine->waiting_input) {
+				machine->resume = 0;
+			}
+		}
+#else
+		if (wait > EVLOOP_IDLE) {
+			wait = EVLOOP_IDLE;
+		}
+		if (wait != 0) {
+			timing_sleep(wait);
+		}
+#endif
+	}
+
+#ifdef __linux__
+	close(ep);
+#endif
+	free(slots);
+	return 0;
+}
@@ -0,0 +1,22 @@
+/* evloop.h
+ * Single threaded event loop that multiplexes many machines
+ * Github: https:\\github.com\tommojphillips
+ */
+
+#ifndef EVLOOP_H
+#define EVLOOP_H
+
+#include <stdint.h>
+
+#include "pool.h"
+
+#define EVLOOP_EVENTS 64    // events taken per wait
+#define EVLOOP_IDLE   1000  // longest wait (us) when a machine can not be waited on
+
+/* Run every job to completion on the calling thread.
+ * A machine is stepped when its frame is due, or early when input arrives on its console descriptor.
+ * time_limit is a per job wall-clock limit in microseconds (0 = none).
+ * returns 0 on success, 1 if the event loop could not be created */
+int evloop_run(POOL_JOB* jobs, uint32_t count, uint64_t time_limit);
+
+#endif
@@ -6,6 +6,14 @@
 #define FILE_UTIL_H
 
 #include <stdint.h>
+#include <stdio.h>
+
+#ifndef _WIN32
+static inline int fopen_s(FILE** file, const char* filename, const char* mode) {
+	*file = fopen(filename, mode);
+	return *file == NULL;
+}
+#endif
 
 int read_file_into_buffer(const char* filename, void* buff, const uint32_t buff_size, const uint32_t offset, uint32_t* file_size, const uint32_t expected_size);
 
@@ -0,0 +1,47 @@
+/* idle.c
+ * Idle loop detection
+ * Github: https:\\github.com\tommojphillips
+ */
+
+ /* Only reads of status ports (registered with no side effects) are passed in; any other I/O is activity.
+  *
+  * A guest waiting on a device spins on IN status / ANI mask / Jcc. The loop is idle when every poll
+  * happens at the same pc, reads the same value and finds the cpu in the same state, with no memory
+  * changes or OUTs in between. Such a loop is a fixed point; running it longer only burns cycles, so the
+  * machine can skip to the end of the frame and wait for host input instead.
+  *
+  * Loops that count down a timeout while polling change registers every iteration, so they are never
+  * detected and keep their exact timing.
+  */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "idle.h"
+#include "i8080.h"
+
+void idle_init(IDLE* idle) {
+	memset(idle, 0, sizeof(IDLE));
+}
+
+void idle_read_io(IDLE* idle, I8080* cpu, uint8_t port, uint8_t value) {
+	if (idle->count != 0 &&
+		idle->pc == cpu->pc &&
+		idle->sp == cpu->sp &&
+		idle->port == port &&
+		idle->value == value &&
+		memcmp(idle->registers, cpu->registers, sizeof(idle->registers)) == 0) {
+		idle->count++;
+		if (idle->count >= IDLE_THRESHOLD) {
+			idle->detected = 1;
+		}
+	}
+	else {
+		idle->pc = cpu->pc;
+		idle->sp = cpu->sp;
+		idle->port = port;
+		idle->value = value;
+		memcpy(idle->registers, cpu->registers, sizeof(idle->registers));
+		idle->count = 1;
+	}
+}
@@ -0,0 +1,31 @@
+/* idle.h
+ * Idle loop detection
+ * Github: https:\\github.com\tommojphillips
+ */
+
+#ifndef IDLE_H
+#define IDLE_H
+
+#include <stdint.h>
+
+#include "i8080.h"
+
+#define IDLE_THRESHOLD 256 // identical status polls before the cpu is considered idle
+
+typedef struct {
+	uint16_t pc;         // pc of the last status poll
+	uint16_t sp;         // sp at the last status poll
+	uint8_t registers[8]; // registers at the last status poll
+	uint8_t port;        // port of the last status poll
+	uint8_t value;       // value of the last status poll
+	uint32_t count;      // number of identical status polls
+	int detected;        // cpu is spinning on a status port
+	uint64_t skipped;    // cycles skipped while idle
+} IDLE;
+
+void idle_init(IDLE* idle);
+void idle_read_io(IDLE* idle, I8080* cpu, uint8_t port, uint8_t value);
+
+#define idle_activity(idle) ((idle)->count = 0)
+
+#endif
@@ -0,0 +1,80 @@
+/* io.c
+ * I/O port dispatch
+ * Github: https:\\github.com\tommojphillips
+ */
+
+ /* Each of the 256 ports has its own read and write handler and context, so an IN or OUT is a
+  * single indexed call no matter how many boards are installed. Devices register their ports at init;
+  * unregistered ports read 0xFF and ignore writes. A port belongs to the device (context) that
+  * registered it; a second device asking for it is refused.
+  */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "io.h"
+
+#ifdef _DEBUG
+#define dbg_err(x, ...) printf(x, __VA_ARGS__)
+#else
+#define dbg_err(x, ...)
+#endif
+
+static uint8_t undefined_read(void* context, uint8_t port) {
+	dbg_err("Reading from undefined port: %02X\n", port);
+	return 0xFF;
+}
+static void undefined_write(void* context, uint8_t port, uint8_t value) {
+	dbg_err("Writing to undefined port: %02X = %02X\n", port, value);
+}
+
+void io_init(IO* io) {
+	for (int i = 0; i < 256; ++i) {
+		io_unregister(io, i);
+	}
+}
+int io_register_read(IO* io, uint8_t port, IO_READ read, void* context, uint8_t status) {
+	IO_PORT* p = &io->ports[port];
+	if (p->read != undefined_read && p->read_context != context) {
+		printf("Error: port %02X is already in use\n", port);
+		return 1;
+	}
+	p->read = read;
+	p->read_context = context;
+	p->status = status;
+	return 0;
+}
+int io_register_write(IO* io, uint8_t port, IO_WRITE write, void* context) {
+	IO_PORT* p = &io->ports[port];
+	if (p->write != undefined_write && p->write_context != context) {
+		printf("Error: port %02X is already in use\n", port);
+		return 1;
+	}
+	p->write = write;
+	p->write_context = context;
+	return 0;
+}
+int io_available(IO* io, uint8_t port, void* context) {
+	IO_PORT* p = &io->ports[port];
+	return (p->read == undefined_read || p->read_context == context) &&
+		(p->write == undefined_write || p->write_context == context);
+}
+void io_release(IO* io, uint8_t port, void* context) {
+	IO_PORT* p = &io->ports[port];
+	if (p->read != undefined_read && p->read_context == context) {
+		p->read = undefined_read;
+		p->read_context = NULL;
+		p->status = 0;
+	}
+	if (p->write != undefined_write && p->write_context == context) {
+		p->write = undefined_write;
+		p->write_context = NULL;
+	}
+}
+void io_unregister(IO* io, uint8_t port) {
+	io->ports[port].read = undefined_read;
+	io->ports[port].write = undefined_write;
+	io->ports[port].read_context = NULL;
+	io->ports[port].write_context = NULL;
+	io->ports[port].status = 0;
+}
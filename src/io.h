@@ -0,0 +1,41 @@
+/* io.h
+ * I/O port dispatch
+ * Github: https:\\github.com\tommojphillips
+ */
+
+#ifndef IO_H
+#define IO_H
+
+#include <stdint.h>
+
+typedef uint8_t(*IO_READ)(void* context, uint8_t port);
+typedef void(*IO_WRITE)(void* context, uint8_t port, uint8_t value);
+
+typedef struct {
+	IO_READ read;
+	IO_WRITE write;
+	void* read_context;
+	void* write_context;
+	uint8_t status; // reading the port has no side effects
+} IO_PORT;
+
+typedef struct {
+	IO_PORT ports[256];
+} IO;
+
+void io_init(IO* io);
+/* claim a port for a device; returns 1, leaving the port as it is, if another device has it */
+int io_register_read(IO* io, uint8_t port, IO_READ read, void* context, uint8_t status);
+int io_register_write(IO* io, uint8_t port, IO_WRITE write, void* context);
+
+/* the port is free, or already belongs to <context> */
+int io_available(IO* io, uint8_t port, void* context);
+
+/* give up what <context> registered on the port; another device's handlers stay */
+void io_release(IO* io, uint8_t port, void* context);
+void io_unregister(IO* io, uint8_t port);
+
+#define io_read(io, port) ((io)->ports[port].read((io)->ports[port].read_context, port))
+#define io_write(io, port, value) ((io)->ports[port].write((io)->ports[port].write_context, port, value))
+
+#endif
@@ -0,0 +1,625 @@
+/* jit.c
+ * x86-64 block translator for the i8080
+ * Github: https:\\github.com\tommojphillips
+ */
+
+ /* Guest code is translated one basic block at a time, starting at the current pc and ending
+  * at the first branch, at an instruction the translator leaves to the interpreter (IN, OUT,
+  * HLT, EI, DI), or after JIT_BLOCK_MAX instructions. Register moves and immediates are emitted
+  * as native stores into the I8080 struct, MOV r,M and MOV M,r call the core's read_byte and
+  * write_byte directly; everything else calls the cpu_ops handler with the
+  * opcode and operand already decoded. When the core keeps its flags in PSW bit order (probed at
+  * init), ALU, INR/DCR, rotates and conditional jumps are emitted inline too, taking the flags
+  * from lahf. A block returns the cycles and instructions it ran, so cycle counting stays exact
+  * at every block exit. jit_execute chains blocks through a per-address table until the frame's
+  * cycle budget is spent or it reaches an instruction left to the interpreter.
+  *
+  * RAM pages holding translated code are write protected through the memory map. A guest write
+  * to a protected page that lands on a translated byte drops every block that starts in that page
+  * or the page before it, puts the page back to plain RAM and, if a block is running, makes it
+  * exit after the store. Writes to data sharing a page with code just go through. Remapping a page
+  * (bank switching) drops its blocks the same way, through the memory map's remap callback.
+  */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "jit.h"
+#include "cpu_ops.h"
+#include "i8080.h"
+#include "memmap.h"
+
+#if JIT_SUPPORTED
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#ifdef _DEBUG
+#define dbg_err(x, ...) printf(x, __VA_ARGS__)
+#else
+#define dbg_err(x, ...)
+#endif
+
+#define JIT_NO_BLOCK     ((uint8_t*)1) // the instruction at this address runs in the interpreter
+#define JIT_ENTRY_CODE   16  // emit_prologue; 13 bytes
+#define JIT_INSN_CODE    80  // worst case host code for one instruction; MOV M,r is 31 bytes plus the 38 byte store check
+#define JIT_EXIT_CODE    32  // emit_set_pc and emit_return; 27 bytes
+#define JIT_BLOCK_CODE   (JIT_ENTRY_CODE + JIT_BLOCK_MAX * JIT_INSN_CODE + JIT_EXIT_CODE) // worst case host code for one block
+
+#define REG_OFFSET(r)    (offsetof(I8080, registers) + (r))
+#define PC_OFFSET        offsetof(I8080, pc)
+#define SP_OFFSET        offsetof(I8080, sp)
+#define FLAGS_OFFSET     offsetof(I8080, flags)
+
+/* the emitted code stores registers as bytes and pc, sp as words */
+typedef char jit_check_registers[(sizeof(((I8080*)0)->registers[0]) == 1) ? 1 : -1];
+typedef char jit_check_pc[(sizeof(((I8080*)0)->pc) == 2) ? 1 : -1];
+typedef char jit_check_sp[(sizeof(((I8080*)0)->sp) == 2) ? 1 : -1];
+
+/* jit_translate flushes when less than one block is left */
+typedef char jit_check_block[(JIT_BLOCK_CODE < JIT_CODE_SIZE) ? 1 : -1];
+
+/* 8080 flag bits in the PSW; lahf produces the same layout */
+#define FLAG_C  0x01
+#define FLAG_P  0x04
+#define FLAG_AC 0x10
+#define FLAG_Z  0x40
+#define FLAG_S  0x80
+#define FLAG_ALL (FLAG_S | FLAG_Z | FLAG_AC | FLAG_P | FLAG_C)
+
+/* x86 8 bit register numbers */
+#define X86_AL 0
+#define X86_CL 1
+#define X86_AH 4
+
+/* block(cpu, jit) returns cycles in the low word and instructions in the high word */
+typedef uint64_t(*JIT_BLOCK)(I8080* cpu, JIT* jit);
+#define JIT_RESULT(cycles, count) ((uint64_t)(cycles) | ((uint64_t)(count) << 32))
+
+#ifdef _WIN32
+#define FRAME_SIZE 0x28 // shadow space + alignment
+#else
+#define FRAME_SIZE 0x08 // alignment
+#endif
+
+static const uint8_t reg_index[8] = { REG_B, REG_C, REG_D, REG_E, REG_H, REG_L, 0, REG_A };
+
+static void emit8(uint8_t** p, uint8_t value) {
+	*(*p)++ = value;
+}
+static void emit16(uint8_t** p, uint16_t value) {
+	emit8(p, value & 0xFF);
+	emit8(p, value >> 8);
+}
+static void emit32(uint8_t** p, uint32_t value) {
+	emit16(p, value & 0xFFFF);
+	emit16(p, value >> 16);
+}
+static void emit64(uint8_t** p, uint64_t value) {
+	emit32(p, value & 0xFFFFFFFF);
+	emit32(p, value >> 32);
+}
+
+/* op [rbx+offset] with reg in the modrm reg field */
+static void emit_rbx(uint8_t** p, uint8_t op, uint8_t reg, uint32_t offset) {
+	emit8(p, op);
+	emit8(p, 0x83 | (reg << 3));
+	emit32(p, offset);
+}
+
+static void emit_prologue(uint8_t** p) {
+	emit8(p, 0x53);                              // push rbx
+	emit8(p, 0x41); emit8(p, 0x54);              // push r12
+	emit8(p, 0x48); emit8(p, 0x83); emit8(p, 0xEC); emit8(p, FRAME_SIZE); // sub rsp, FRAME_SIZE
+#ifdef _WIN32
+	emit8(p, 0x48); emit8(p, 0x89); emit8(p, 0xCB); // mov rbx, rcx
+	emit8(p, 0x49); emit8(p, 0x89); emit8(p, 0xD4); // mov r12, rdx
+#else
+	emit8(p, 0x48); emit8(p, 0x89); emit8(p, 0xFB); // mov rbx, rdi
+	emit8(p, 0x49); emit8(p, 0x89); emit8(p, 0xF4); // mov r12, rsi
+#endif
+}
+static void emit_return(uint8_t** p, uint32_t cycles, uint32_t count) {
+	emit8(p, 0x48); emit8(p, 0xB8); emit64(p, JIT_RESULT(cycles, count)); // mov rax, result
+	emit8(p, 0x48); emit8(p, 0x83); emit8(p, 0xC4); emit8(p, FRAME_SIZE); // add rsp, FRAME_SIZE
+	emit8(p, 0x41); emit8(p, 0x5C);              // pop r12
+	emit8(p, 0x5B);                              // pop rbx
+	emit8(p, 0xC3);                              // ret
+}
+static void emit_set_pc(uint8_t** p, uint16_t pc) {
+	emit8(p, 0x66); emit8(p, 0xC7); emit8(p, 0x83); emit32(p, PC_OFFSET); emit16(p, pc); // mov word [rbx+pc], imm16
+}
+static void emit_set_reg(uint8_t** p, uint8_t r, uint8_t value) {
+	emit8(p, 0xC6); emit8(p, 0x83); emit32(p, REG_OFFSET(r)); emit8(p, value); // mov byte [rbx+r], imm8
+}
+static void emit_hl_address(uint8_t** p) {
+	emit8(p, 0x0F); emit_rbx(p, 0xB6, X86_AL, REG_OFFSET(REG_H)); // movzx eax, byte H
+	emit8(p, 0xC1); emit8(p, 0xE0); emit8(p, 0x08);            // shl eax, 8
+	emit_rbx(p, 0x8A, X86_AL, REG_OFFSET(REG_L));              // mov al, L
+#ifdef _WIN32
+	emit8(p, 0x89); emit8(p, 0xC1);                            // mov ecx, eax
+#else
+	emit8(p, 0x89); emit8(p, 0xC7);                            // mov edi, eax
+#endif
+}
+static void emit_read_hl(uint8_t** p, uint8_t dst) {
+	emit_hl_address(p);
+	emit_rbx(p, 0xFF, 2, offsetof(I8080, read_byte));          // call [rbx+read_byte]
+	emit_rbx(p, 0x88, X86_AL, REG_OFFSET(dst));                // mov byte dst, al
+}
+static void emit_write_hl(uint8_t** p, uint8_t src) {
+	emit_hl_address(p);
+#ifdef _WIN32
+	emit8(p, 0x0F); emit_rbx(p, 0xB6, 2, REG_OFFSET(src));     // movzx edx, byte src
+#else
+	emit8(p, 0x0F); emit_rbx(p, 0xB6, 6, REG_OFFSET(src));     // movzx esi, byte src
+#endif
+	emit_rbx(p, 0xFF, 2, offsetof(I8080, write_byte));         // call [rbx+write_byte]
+}
+static void emit_merge_flags(uint8_t** p, uint8_t mask) {
+	/* flags = (flags & ~mask) | (ah & mask) */
+	emit8(p, 0x80); emit8(p, 0xE4); emit8(p, mask);             // and ah, mask
+	emit_rbx(p, 0x80, 4, FLAGS_OFFSET); emit8(p, (uint8_t)~mask); // and byte [rbx+flags], ~mask
+	emit_rbx(p, 0x08, X86_AH, FLAGS_OFFSET);                   // or byte [rbx+flags], ah
+}
+static void emit_load_carry(uint8_t** p) {
+	emit_rbx(p, 0x8A, X86_CL, FLAGS_OFFSET);                   // mov cl, byte [rbx+flags]
+	emit8(p, 0xD0); emit8(p, 0xE9);                            // shr cl, 1
+}
+static void emit_store_carry(uint8_t** p) {
+	emit8(p, 0x0F); emit8(p, 0x92); emit8(p, 0xC1);            // setc cl
+	emit_rbx(p, 0x80, 4, FLAGS_OFFSET); emit8(p, (uint8_t)~FLAG_C); // and byte [rbx+flags], ~C
+	emit_rbx(p, 0x08, X86_CL, FLAGS_OFFSET);                   // or byte [rbx+flags], cl
+}
+static void emit_alu(uint8_t** p, uint8_t operation, int immediate, uint8_t value) {
+	/* ADD ADC SUB SBB ANA XRA ORA CMP; x86 op al, r/m8 and op al, imm8 */
+	static const uint8_t op_rm[8] = { 0x02, 0x12, 0x2A, 0x1A, 0x22, 0x32, 0x0A, 0x3A };
+	static const uint8_t op_imm[8] = { 0x04, 0x14, 0x2C, 0x1C, 0x24, 0x34, 0x0C, 0x3C };
+
+	if (operation == 4) {
+		/* ANA sets AC from bit 3 of (A | value) */
+		emit_rbx(p, 0x8A, X86_CL, REG_OFFSET(REG_A));          // mov cl, A
+		if (immediate) {
+			emit8(p, 0x80); emit8(p, 0xC9); emit8(p, value);   // or cl, imm8
+		}
+		else {
+			emit_rbx(p, 0x0A, X86_CL, REG_OFFSET(value));      // or cl, r
+		}
+		emit8(p, 0xD0); emit8(p, 0xE1);                        // shl cl, 1
+		emit8(p, 0x80); emit8(p, 0xE1); emit8(p, FLAG_AC);     // and cl, AC
+	}
+	else if (operation == 1 || operation == 3) {
+		emit_load_carry(p);
+	}
+	emit_rbx(p, 0x8A, X86_AL, REG_OFFSET(REG_A));              // mov al, A
+	if (immediate) {
+		emit8(p, op_imm[operation]); emit8(p, value);          // op al, imm8
+	}
+	else {
+		emit_rbx(p, op_rm[operation], X86_AL, REG_OFFSET(value)); // op al, r
+	}
+	emit8(p, 0x9F);                                            // lahf
+	if (operation != 7) {
+		emit_rbx(p, 0x88, X86_AL, REG_OFFSET(REG_A));          // mov A, al
+	}
+	switch (operation) {
+		case 2: case 3: case 7:
+			/* the 8080 sets AC when there is no borrow out of bit 3 */
+			emit8(p, 0x80); emit8(p, 0xF4); emit8(p, FLAG_AC); // xor ah, AC
+			break;
+		case 4:
+			emit8(p, 0x80); emit8(p, 0xE4); emit8(p, FLAG_S | FLAG_Z | FLAG_P); // and ah, S Z P
+			emit8(p, 0x08); emit8(p, 0xCC);                    // or ah, cl
+			break;
+		case 5: case 6:
+			emit8(p, 0x80); emit8(p, 0xE4); emit8(p, FLAG_S | FLAG_Z | FLAG_P); // and ah, S Z P
+			break;
+	}
+	emit_merge_flags(p, FLAG_ALL);
+}
+
+static void emit_call_op(uint8_t** p, CPU_OP op, uint8_t opcode, uint16_t operand) {
+#ifdef _WIN32
+	emit8(p, 0x48); emit8(p, 0x89); emit8(p, 0xD9); // mov rcx, rbx
+	emit8(p, 0xBA); emit32(p, opcode);             // mov edx, opcode
+	emit8(p, 0x41); emit8(p, 0xB8); emit32(p, operand); // mov r8d, operand
+#else
+	emit8(p, 0x48); emit8(p, 0x89); emit8(p, 0xDF); // mov rdi, rbx
+	emit8(p, 0xBE); emit32(p, opcode);             // mov esi, opcode
+	emit8(p, 0xBA); emit32(p, operand);            // mov edx, operand
+#endif
+	emit8(p, 0x48); emit8(p, 0xB8); emit64(p, (uint64_t)(uintptr_t)op); // mov rax, op
+	emit8(p, 0xFF); emit8(p, 0xD0);              // call rax
+}
+static void emit_check_invalidated(uint8_t** p, uint16_t pc, uint32_t cycles, uint32_t count) {
+	uint8_t* branch;
+	emit8(p, 0x41); emit8(p, 0x80); emit8(p, 0xBC); emit8(p, 0x24);
+	emit32(p, offsetof(JIT, invalidated)); emit8(p, 0x00); // cmp byte [r12+invalidated], 0
+	emit8(p, 0x74); branch = (*p)++;             // jz skip
+	emit_set_pc(p, pc);
+	emit_return(p, cycles, count);
+	*branch = (uint8_t)(*p - branch - 1);        // skip:
+}
+
+/* emit native code for the instruction; returns 0 to leave it to the cpu_ops handler */
+static int emit_native(JIT* jit, uint8_t** p, uint8_t opcode, uint16_t operand, uint16_t next) {
+	uint8_t dst = (opcode >> 3) & 0x07;
+	uint8_t src = opcode & 0x07;
+	uint8_t rp = (opcode >> 4) & 0x03;
+
+	if ((opcode & 0xC0) == 0x40 && dst != 6 && src != 6) {
+		emit_rbx(p, 0x8A, X86_AL, REG_OFFSET(reg_index[src])); // MOV r,r
+		emit_rbx(p, 0x88, X86_AL, REG_OFFSET(reg_index[dst]));
+		return 1;
+	}
+	if ((opcode & 0xC0) == 0x40 && dst != 6 && src == 6) {
+		emit_read_hl(p, reg_index[dst]);                     // MOV r,M
+		return 1;
+	}
+	if ((opcode & 0xC0) == 0x40 && dst == 6 && src != 6) {
+		emit_write_hl(p, reg_index[src]);                    // MOV M,r
+		return 1;
+	}
+	if ((opcode & 0xC7) == 0x06 && dst != 6) {
+		emit_set_reg(p, reg_index[dst], (uint8_t)operand);  // MVI r
+		return 1;
+	}
+	if ((opcode & 0xCF) == 0x01 && rp != 3) {
+		emit_set_reg(p, reg_index[rp * 2], operand >> 8);   // LXI B/D/H
+		emit_set_reg(p, reg_index[rp * 2 + 1], operand & 0xFF);
+		return 1;
+	}
+	if ((opcode & 0xC7) == 0x03) {
+		/* INX/DCX; no flags */
+		int dcx = opcode & 0x08;
+		if (rp == 3) {
+			emit8(p, 0x66); emit_rbx(p, 0x83, dcx ? 5 : 0, SP_OFFSET); emit8(p, 1); // add/sub word [rbx+sp], 1
+		}
+		else {
+			emit_rbx(p, 0x80, dcx ? 5 : 0, REG_OFFSET(reg_index[rp * 2 + 1])); emit8(p, 1); // add/sub byte lo, 1
+			emit_rbx(p, 0x80, dcx ? 3 : 2, REG_OFFSET(reg_index[rp * 2])); emit8(p, 0);     // adc/sbb byte hi, 0
+		}
+		return 1;
+	}
+	if (opcode == 0x2F) {
+		emit_rbx(p, 0xF6, 2, REG_OFFSET(REG_A));             // CMA; not byte A
+		return 1;
+	}
+	if (opcode == 0xEB) {
+		for (int i = 0; i < 2; ++i) {                        // XCHG
+			emit_rbx(p, 0x8A, X86_AL, REG_OFFSET(reg_index[2 + i]));
+			emit_rbx(p, 0x8A, X86_CL, REG_OFFSET(reg_index[4 + i]));
+			emit_rbx(p, 0x88, X86_AL, REG_OFFSET(reg_index[4 + i]));
+			emit_rbx(p, 0x88, X86_CL, REG_OFFSET(reg_index[2 + i]));
+		}
+		return 1;
+	}
+	if (opcode == 0xC3 || opcode == 0xCB) {
+		emit_set_pc(p, operand);                             // JMP
+		return 1;
+	}
+
+	if (!jit->native_flags) {
+		return 0;
+	}
+
+	if ((opcode & 0xC0) == 0x80 && src != 6) {
+		emit_alu(p, dst, 0, reg_index[src]);                 // ALU r
+		return 1;
+	}
+	if ((opcode & 0xC7) == 0xC6) {
+		emit_alu(p, dst, 1, (uint8_t)operand);               // ALU imm
+		return 1;
+	}
+	if ((opcode & 0xC6) == 0x04 && dst != 6) {
+		/* INR/DCR; carry unaffected, AC inverted for DCR */
+		emit_rbx(p, 0xFE, opcode & 1, REG_OFFSET(reg_index[dst])); // inc/dec byte r
+		emit8(p, 0x9F);                                      // lahf
+		if (opcode & 1) {
+			emit8(p, 0x80); emit8(p, 0xF4); emit8(p, FLAG_AC); // xor ah, AC
+		}
+		emit_merge_flags(p, FLAG_S | FLAG_Z | FLAG_AC | FLAG_P);
+		return 1;
+	}
+	if ((opcode & 0xE7) == 0x07) {
+		/* RLC RRC RAL RAR; rol ror rcl rcr al, 1 */
+		static const uint8_t rotate[4] = { 0xC0, 0xC8, 0xD0, 0xD8 };
+		if (opcode & 0x10) {
+			emit_load_carry(p);
+		}
+		emit_rbx(p, 0x8A, X86_AL, REG_OFFSET(REG_A));
+		emit8(p, 0xD0); emit8(p, rotate[dst]);
+		emit_rbx(p, 0x88, X86_AL, REG_OFFSET(REG_A));
+		emit_store_carry(p);
+		return 1;
+	}
+	if (opcode == 0x37 || opcode == 0x3F) {
+		emit_rbx(p, 0x80, opcode == 0x37 ? 1 : 6, FLAGS_OFFSET); emit8(p, FLAG_C); // STC or / CMC xor
+		return 1;
+	}
+	if ((opcode & 0xC7) == 0xC2) {
+		/* Jcc; fall through to next unless the condition holds */
+		static const uint8_t mask[4] = { FLAG_Z, FLAG_C, FLAG_P, FLAG_S };
+		emit_set_pc(p, next);
+		emit_rbx(p, 0xF6, 0, FLAGS_OFFSET); emit8(p, mask[dst >> 1]); // test byte [rbx+flags], mask
+		emit8(p, (dst & 1) ? 0x74 : 0x75); emit8(p, 9);      // jz/jnz over the next store
+		emit_set_pc(p, operand);
+		return 1;
+	}
+	return 0;
+}
+
+static void jit_drop_page(JIT* jit, uint8_t page) {
+	/* blocks are short enough to reach at most one page past the one they start in. code_map
+	 * bits left in the page before stay set; at worst they cause an extra invalidation. */
+	memset(&jit->code_map[page * MEMMAP_PAGE_SIZE], 0, MEMMAP_PAGE_SIZE);
+	memset(&jit->blocks[page * MEMMAP_PAGE_SIZE], 0, MEMMAP_PAGE_SIZE * sizeof(uint8_t*));
+	if (page > 0) {
+		memset(&jit->blocks[(page - 1) * MEMMAP_PAGE_SIZE], 0, MEMMAP_PAGE_SIZE * sizeof(uint8_t*));
+	}
+	jit->entries[page] = 0;
+	jit->invalidated = 1;
+	jit->invalidations++;
+}
+static void jit_code_write(void* context, uint16_t address, uint8_t value) {
+	JIT* jit = (JIT*)context;
+	uint8_t page = address >> 8;
+	PAGE* p = &jit->map->pages[page];
+
+	if (!jit->code_map[address]) {
+		p->ptr[address & 0xFF] = value;
+		return;
+	}
+
+	/* back to plain RAM; the page is protected again when it is next translated */
+	jit->protected[page] = 0;
+	p->flags = PAGE_RAM;
+	p->read = NULL;
+	p->write = NULL;
+	p->context = NULL;
+	p->ptr[address & 0xFF] = value;
+	jit_drop_page(jit, page);
+}
+static void jit_remap(void* context, uint8_t page) {
+	/* the page shows other memory now; the new mapping has already replaced any protection */
+	JIT* jit = (JIT*)context;
+	if (!jit->protected[page] && !jit->entries[page]) {
+		return;
+	}
+	jit->protected[page] = 0;
+	jit_drop_page(jit, page);
+}
+static void jit_protect(JIT* jit, uint8_t page) {
+	PAGE* p = &jit->map->pages[page];
+	if (jit->protected[page] || p->flags != PAGE_RAM) {
+		return; // ROM can't change; MMIO pages are never translated
+	}
+	jit->protected[page] = 1;
+	p->flags = PAGE_READ | PAGE_MMIO;
+	p->write = jit_code_write;
+	p->context = jit;
+}
+
+static uint8_t* jit_translate(JIT* jit, I8080* cpu, uint16_t pc) {
+	if (JIT_CODE_SIZE - jit->code_used < JIT_BLOCK_CODE) {
+		jit_flush(jit);
+	}
+
+	uint8_t* start = jit->code + jit->code_used;
+	uint8_t* p = start;
+	uint32_t address = pc;
+	uint32_t cycles = 0;
+	uint32_t count = 0;
+	int branch = 0;
+
+	emit_prologue(&p);
+	while (count < JIT_BLOCK_MAX && !branch) {
+		/* JIT_BLOCK_CODE is free past start; end the block early rather than run past it */
+		if ((uint32_t)(p - start) + JIT_INSN_CODE + JIT_EXIT_CODE > JIT_BLOCK_CODE) {
+			break;
+		}
+		uint8_t* insn = p;
+		uint8_t opcode = memmap_read(jit->map, address);
+		const CPU_OP_INFO* info = &cpu_ops[opcode];
+		if (info->op == NULL || address + info->length > 0x10000) {
+			break;
+		}
+		if (!(jit->map->pages[address >> 8].flags & PAGE_READ) ||
+			!(jit->map->pages[(address + info->length - 1) >> 8].flags & PAGE_READ)) {
+			break; // only translate code in RAM or ROM
+		}
+
+		uint16_t operand = 0;
+		if (info->length == 2) {
+			operand = memmap_read(jit->map, address + 1);
+		}
+		else if (info->length == 3) {
+			operand = memmap_read(jit->map, address + 1) | (memmap_read(jit->map, address + 2) << 8);
+		}
+		uint16_t next = (uint16_t)(address + info->length);
+
+		cycles += info->cycles;
+		count++;
+
+		if (info->flags & CPU_OP_BRANCH) {
+			branch = 1;
+		}
+		if (!emit_native(jit, &p, opcode, operand, next)) {
+			if (branch) {
+				/* the handler sees pc past the instruction, as the interpreter does */
+				emit_set_pc(&p, next);
+			}
+			emit_call_op(&p, info->op, opcode, operand);
+		}
+		if (!branch && (info->flags & CPU_OP_STORE)) {
+			emit_check_invalidated(&p, next, cycles, count);
+		}
+		if (p - insn > JIT_INSN_CODE) {
+			dbg_err("JIT: opcode %02X emitted %d bytes; JIT_INSN_CODE is %d\n", opcode, (int)(p - insn), JIT_INSN_CODE);
+		}
+		address += info->length;
+	}
+
+	jit->entries[pc >> 8] = 1;
+	if (count == 0) {
+		jit->blocks[pc] = JIT_NO_BLOCK;
+		return NULL;
+	}
+	if (!branch) {
+		emit_set_pc(&p, (uint16_t)address);
+	}
+	emit_return(&p, cycles, count);
+
+	memset(&jit->code_map[pc], 1, address - pc);
+	for (uint32_t page = pc >> 8; page <= ((address - 1) >> 8); ++page) {
+		jit_protect(jit, (uint8_t)page);
+	}
+	jit->code_used += (uint32_t)(p - start);
+	jit->blocks[pc] = start;
+	jit->translated++;
+	return start;
+}
+
+static int jit_probe_flag(uint8_t bit, int c, int p, int ac, int z, int s) {
+	I8080 cpu;
+	memset(&cpu, 0, sizeof(I8080));
+	cpu.flags.c = c;
+	cpu.flags.p = p;
+	cpu.flags.ac = ac;
+	cpu.flags.z = z;
+	cpu.flags.s = s;
+	return ((uint8_t*)&cpu)[FLAGS_OFFSET] == bit;
+}
+static int jit_probe_flags() {
+	/* inline flag code works on the first byte of the flags struct, if it is laid out as the PSW */
+	return jit_probe_flag(FLAG_C, 1, 0, 0, 0, 0) &&
+		jit_probe_flag(FLAG_P, 0, 1, 0, 0, 0) &&
+		jit_probe_flag(FLAG_AC, 0, 0, 1, 0, 0) &&
+		jit_probe_flag(FLAG_Z, 0, 0, 0, 1, 0) &&
+		jit_probe_flag(FLAG_S, 0, 0, 0, 0, 1);
+}
+
+int jit_init(JIT* jit, MEMMAP* map) {
+	memset(jit, 0, sizeof(JIT));
+	jit->map = map;
+	jit->native_flags = jit_probe_flags();
+
+	jit->blocks = (uint8_t**)calloc(0x10000, sizeof(uint8_t*));
+	jit->code_map = (uint8_t*)calloc(0x10000, sizeof(uint8_t));
+	if (jit->blocks == NULL || jit->code_map == NULL) {
+		dbg_err("Failed to allocate JIT block table\n");
+		free(jit->blocks);
+		free(jit->code_map);
+		jit->blocks = NULL;
+		jit->code_map = NULL;
+		return 1;
+	}
+
+#ifdef _WIN32
+	jit->code = (uint8_t*)VirtualAlloc(NULL, JIT_CODE_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+#else
+	jit->code = (uint8_t*)mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (jit->code == MAP_FAILED) {
+		jit->code = NULL;
+	}
+#endif
+	if (jit->code == NULL) {
+		printf("Failed to allocate executable memory for the JIT\n");
+		free(jit->blocks);
+		free(jit->code_map);
+		jit->blocks = NULL;
+		jit->code_map = NULL;
+		return 1;
+	}
+	map->remap = jit_remap;
+	map->remap_context = jit;
+	return 0;
+}
+void jit_destroy(JIT* jit) {
+	if (jit->map != NULL && jit->map->remap_context == jit) {
+		jit->map->remap = NULL;
+		jit->map->remap_context = NULL;
+	}
+	if (jit->code != NULL) {
+		jit_flush(jit);
+#ifdef _WIN32
+		VirtualFree(jit->code, 0, MEM_RELEASE);
+#else
+		munmap(jit->code, JIT_CODE_SIZE);
+#endif
+		jit->code = NULL;
+	}
+	if (jit->blocks != NULL) {
+		free(jit->blocks);
+		jit->blocks = NULL;
+	}
+	if (jit->code_map != NULL) {
+		free(jit->code_map);
+		jit->code_map = NULL;
+	}
+}
+void jit_flush(JIT* jit) {
+	for (uint32_t i = 0; i < MEMMAP_PAGES; ++i) {
+		if (jit->protected[i]) {
+			PAGE* p = &jit->map->pages[i];
+			p->flags = PAGE_RAM;
+			p->write = NULL;
+			p->context = NULL;
+			jit->protected[i] = 0;
+		}
+	}
+	memset(jit->blocks, 0, 0x10000 * sizeof(uint8_t*));
+	memset(jit->code_map, 0, 0x10000);
+	memset(jit->entries, 0, MEMMAP_PAGES);
+	jit->code_used = 0;
+	jit->flushes++;
+}
+uint32_t jit_execute(JIT* jit, I8080* cpu, uint32_t cycles) {
+	/* run blocks until the cycle budget is spent or the next instruction needs the interpreter */
+	uint32_t count = 0;
+	if (cpu->flags.halt) {
+		return 0;
+	}
+	while (cpu->cycles < cycles) {
+		uint8_t* block = jit->blocks[cpu->pc];
+		if (block == JIT_NO_BLOCK) {
+			break;
+		}
+		if (block == NULL) {
+			block = jit_translate(jit, cpu, cpu->pc);
+			if (block == NULL) {
+				break;
+			}
+		}
+		jit->invalidated = 0;
+		uint64_t result = ((JIT_BLOCK)block)(cpu, jit);
+		cpu->cycles += (uint32_t)(result & 0xFFFFFFFF);
+		count += (uint32_t)(result >> 32);
+	}
+	return count;
+}
+
+#else
+
+int jit_init(JIT* jit, MEMMAP* map) {
+	memset(jit, 0, sizeof(JIT));
+	printf("The JIT is only supported on x86-64 hosts\n");
+	return 1;
+}
+void jit_destroy(JIT* jit) {
+
+}
+void jit_flush(JIT* jit) {
+
+}
+uint32_t jit_execute(JIT* jit, I8080* cpu, uint32_t cycles) {
+	return 0;
+}
+
+#endif
@@ -0,0 +1,43 @@
+/* jit.h
+ * x86-64 block translator for the i8080
+ * Github: https:\\github.com\tommojphillips
+ */
+
+#ifndef JIT_H
+#define JIT_H
+
+#include <stdint.h>
+
+#include "i8080.h"
+#include "memmap.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define JIT_SUPPORTED 1
+#else
+#define JIT_SUPPORTED 0
+#endif
+
+#define JIT_CODE_SIZE  0x400000 // host code buffer; flushed when full
+#define JIT_BLOCK_MAX  32       // guest instructions per block
+
+typedef struct {
+	uint8_t* code;          // executable host code buffer
+	uint32_t code_used;     // bytes of the buffer in use
+	uint8_t** blocks;       // host code for each guest address
+	uint8_t* code_map;      // guest bytes that belong to a translated block
+	uint8_t protected[MEMMAP_PAGES]; // RAM pages write protected because they hold translated code
+	uint8_t entries[MEMMAP_PAGES];   // pages with addresses in blocks; dropped when the page is remapped
+	MEMMAP* map;
+	uint8_t invalidated;    // a guest write hit translated code; the running block exits early
+	int native_flags;       // the core keeps its flags in PSW bit order; flag setting ops are emitted inline
+	uint64_t translated;    // blocks translated
+	uint64_t invalidations; // pages invalidated by guest writes
+	uint64_t flushes;       // times the code buffer filled up
+} JIT;
+
+int jit_init(JIT* jit, MEMMAP* map);
+void jit_destroy(JIT* jit);
+void jit_flush(JIT* jit);
+uint32_t jit_execute(JIT* jit, I8080* cpu, uint32_t cycles);
+
+#endif
@@ -0,0 +1,168 @@
+/* job_main.c
+ * Submit a job to the fork server
+ * Github: https:\\github.com\tommojphillips
+ */
+
+ /* Sends one job to altair-server, copies the guest output to stdout
+	and the status line to stderr. Exits with the job's exit code.
+
+	Usage: altair-job -u<socket> -i<script> [options]
+		-u<socket>        unix socket of the server
+		-i<script>        console script for the job
+		-d<drive>:<file>  mount <file> in <drive> for this job, eg -dB:data.dsk or a directory, -dB:inputs
+		-x<drive>:<file>  write the image in <drive> to <file> when the job ends, or its files if <file> is a directory
+		-v<drive>:<file>  write the delta of the overlay disk in <drive> to <file> when the job ends
+		-l<seconds>       wall-clock time limit for this job
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "server.h"
+
+#ifdef _WIN32
+
+int main(int argc, char** argv) {
+	printf("Error: the fork server needs fork() and unix sockets\n");
+	return 1;
+}
+
+#else
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+static int read_all(int fd, void* data, size_t len) {
+	uint8_t* p = (uint8_t*)data;
+	while (len > 0) {
+		ssize_t n = read(fd, p, len);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return 1;
+		}
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static char* read_script(const char* filename, size_t* len) {
+	FILE* file = fopen(filename, "rb");
+	if (file == NULL) {
+		printf("Failed to open script file: %s\n", filename);
+		return NULL;
+	}
+	char* script = (char*)malloc(SERVER_SCRIPT_MAX);
+	if (script != NULL) {
+		*len = fread(script, 1, SERVER_SCRIPT_MAX, file);
+	}
+	fclose(file);
+	return script;
+}
+
+int main(int argc, char** argv) {
+	const char* path = NULL;
+	const char* script_file = NULL;
+
+	/* disk, export, delta and limit lines go out as they are given */
+	char request[SERVER_LINE * 8] = { 0 };
+	size_t request_len = 0;
+	for (int i = 1; i < argc; ++i) {
+		const char* arg = argv[i];
+		const char* line = NULL;
+		if (strncmp("-u", arg, 2) == 0) {
+			path = arg + 2;
+		}
+		else if (strncmp("-i", arg, 2) == 0) {
+			script_file = arg + 2;
+		}
+		else if (strncmp("-d", arg, 2) == 0 && arg[2] != '\0' && arg[3] == ':') {
+			line = "disk";
+		}
+		else if (strncmp("-x", arg, 2) == 0 && arg[2] != '\0' && arg[3] == ':') {
+			line = "export";
+		}
+		else if (strncmp("-v", arg, 2) == 0 && arg[2] != '\0' && arg[3] == ':') {
+			line = "delta";
+		}
+		else if (strncmp("-l", arg, 2) == 0) {
+			request_len += snprintf(request + request_len, sizeof(request) - request_len, "limit %s\n", arg + 2);
+		}
+		else {
+			printf("Unknown option: %s\n", arg);
+			return 1;
+		}
+		if (line != NULL) {
+			request_len += snprintf(request + request_len, sizeof(request) - request_len, "%s %c %s\n", line, arg[2], arg + 4);
+		}
+		if (request_len >= sizeof(request)) {
+			printf("Error: too many options\n");
+			return 1;
+		}
+	}
+	if (path == NULL || script_file == NULL) {
+		printf("Usage: altair-job -u<socket> -i<script> [-d<drive>:<file>] [-x<drive>:<file>] [-v<drive>:<file>] [-l<seconds>]\n");
+		return 1;
+	}
+
+	size_t script_len = 0;
+	char* script = read_script(script_file, &script_len);
+	if (script == NULL) {
+		return 1;
+	}
+
+	struct sockaddr_un addr = { 0 };
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+		printf("Error: could not connect to %s\n", path);
+		free(script);
+		return 1;
+	}
+
+	FILE* out = fdopen(fd, "r+b");
+	fprintf(out, "%sscript %zu\n", request, script_len);
+	fwrite(script, 1, script_len, out);
+	fprintf(out, "run\n");
+	fflush(out);
+	free(script);
+
+	int exit_code = 1;
+	uint8_t header[5];
+	char* payload = NULL;
+	while (read_all(fd, header, sizeof(header)) == 0) {
+		uint32_t len = header[1] | (header[2] << 8) | (header[3] << 16) | ((uint32_t)header[4] << 24);
+		char* grown = (char*)realloc(payload, len + 1);
+		if (grown == NULL || read_all(fd, grown, len) != 0) {
+			payload = grown;
+			break;
+		}
+		payload = grown;
+		payload[len] = '\0';
+		if (header[0] == SERVER_FRAME_OUTPUT) {
+			/* pass it on as it arrives; the job may run for a long time */
+			fwrite(payload, 1, len, stdout);
+			fflush(stdout);
+		}
+		else if (header[0] == SERVER_FRAME_STATUS) {
+			fflush(stdout);
+			fputs(payload, stderr);
+			const char* exit_field = strstr(payload, "\"exit\":");
+			if (exit_field != NULL) {
+				exit_code = atoi(exit_field + 7);
+			}
+		}
+	}
+	free(payload);
+	fclose(out);
+	return exit_code;
+}
+
+#endif
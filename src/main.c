@@ -3,91 +3,46 @@
  */
 
 #include <stdio.h>
-#include <string.h>
-#include <windows.h>
+#include <signal.h>
 
-#include "i8080.h"
 #include "altair8800.h"
-#include "file.h"
-
-void clear_console_mode(uint32_t mode_mask) {
-	DWORD mode = 0;
-	HANDLE input_handle = GetStdHandle(STD_INPUT_HANDLE);
-	GetConsoleMode(input_handle, &mode);
-	mode &= ~mode_mask;
-	SetConsoleMode(input_handle, mode);
+#include "args.h"
+#include "console.h"
+#include "trace.h"
+
+#ifdef SIGUSR1
+/* kill -USR1 <pid> dumps the trace ring without stopping the machine */
+static volatile sig_atomic_t trace_requested = 0;
+static void on_trace_signal(int sig) {
+	trace_requested = 1;
 }
+#endif
 
-void args(int argc, char** argv) {
-	const char* filename = NULL;
-	uint32_t offset = 0;
-	for (int i = 1; i < argc; ++i) {
-		size_t len = strlen(argv[i]);
-		for (size_t j = 0; j < len;) {
-			const char* arg = argv[i] + j;
-
-			if (strncmp("-o", arg, 2) == 0) {
-				offset = strtol(arg + 2, NULL, 16);
-				altair.cpu.pc = offset & 0xFFFF;
-				break;
-			}
-
-			if (strncmp("-r", arg, 2) == 0) {
-				altair.ram_size = strtol(arg + 2, NULL, 16) & 0xFFFF;
-				printf("%04X\t-> RAMTOP\n", altair.ram_size);
-				break;
-			}
-
-			if (strncmp("-p", arg, 2) == 0) {
-				clear_console_mode(ENABLE_PROCESSED_INPUT);
-				break;
-			}
-
-			if (strncmp("-d", arg, 2) == 0) {
-				arg += 2; 
-				uint8_t disk = 0; 
-				if (arg[1] == ':') {
-					if ((arg[0] >= 'A' && arg[0] <= 'Z')) {
-						disk = arg[0] - 'A';
-					}
-					else if (arg[0] >= 'a' && arg[0] <= 'z') {
-						disk = arg[0] - 'a';
-					}
-					else {
-						disk = strtol(arg, NULL, 10) & 0xFF;
-					}
-					arg += 2;
-					disk &= 0xF; // map disk A-P (0-15)
-				}
-
-				if (altair.dcdd.disks[disk].file != NULL) {
-					fclose(altair.dcdd.disks[disk].file);
-				}
-				altair.dcdd.disks[disk].file = NULL;
-				fopen_s(&altair.dcdd.disks[disk].file, arg, "r+b");
-				if (altair.dcdd.disks[disk].file == NULL) {
-					printf("Failed to open disk file: %s\n", arg);
-				}
-				else {
-					printf("%c:\t-> %s\n", 'A'+disk, arg);
-				}
-				break;
+int main(int argc, char** argv) {
+	ALTAIR8800* altair = altair8800_create();
+	if (altair == NULL) {
+		return 1;
+	}
+	console_destroy(&altair->console);
+	console_init_host(&altair->console, 0);
+	args(altair, argc, argv, NULL);
+#ifdef SIGUSR1
+	signal(SIGUSR1, on_trace_signal);
+#endif
+	while (altair->running) {
+		altair8800_step(altair);
+#ifdef SIGUSR1
+		if (trace_requested) {
+			trace_requested = 0;
+			if (altair->trace.filename != NULL) {
+				trace_dump(&altair->trace, altair->trace.filename);
 			}
-
-			uint32_t file_size = 0;
-			read_file_into_buffer(arg, altair.memory, 0x10000, offset, &file_size, 0);
-			offset += file_size;
-			break;
 		}
+#endif
 	}
-}
-
-int main(int argc, char** argv) {
-	altair8800_init();
-	args(argc, argv);
-	while (altair.running) {
-		altair8800_update();
+	if (altair->timing.multiplier == TIMING_TURBO) {
+		printf("\n%.2f Mhz\n", timing_mhz(&altair->timing));
 	}
-	altair8800_destroy();
+	altair8800_destroy(altair);
 	return 0;
 }
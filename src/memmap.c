@@ -0,0 +1,88 @@
+/* memmap.c
+ * Memory map - 256 pages of 256 bytes
+ * Github: https:\\github.com\tommojphillips
+ */
+
+ /* Every page carries a host pointer and access flags. RAM and ROM accesses go straight through
+  * the pointer; only MMIO pages go through handlers. Unmapped pages read as a floating bus (0xFF)
+  * and ignore writes.
+  *
+  * ptr points at the start of the page, so banking a page is a pointer swap.
+  *
+  * Each page has a generation counter that is bumped whenever the page is remapped or written
+  * through the memory path. Anything cached from guest memory compares it to see if it is stale.
+  * A cache keyed by guest address instead (the JIT) sets the remap callback to hear about remaps.
+  */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "memmap.h"
+
+#define page_range(address, size, first, last) \
+	uint32_t first = (address) >> 8; \
+	uint32_t last = ((uint32_t)(address) + (size) + MEMMAP_PAGE_SIZE - 1) >> 8; \
+	if (last > MEMMAP_PAGES) last = MEMMAP_PAGES
+
+void memmap_init(MEMMAP* map) {
+	memmap_unmap(map, 0, MEMMAP_PAGES * MEMMAP_PAGE_SIZE);
+}
+void memmap_map(MEMMAP* map, uint16_t address, uint32_t size, uint8_t* ptr, uint8_t flags) {
+	/* ptr is the host memory for address; pages are mapped whole */
+	page_range(address, size, first, last);
+	ptr -= address & 0xFF;
+	for (uint32_t i = first; i < last; ++i) {
+		map->pages[i].ptr = ptr + (i - first) * MEMMAP_PAGE_SIZE;
+		map->pages[i].flags = flags;
+		map->pages[i].read = NULL;
+		map->pages[i].write = NULL;
+		map->pages[i].context = NULL;
+		map->pages[i].generation++;
+		if (map->remap != NULL) {
+			map->remap(map->remap_context, (uint8_t)i);
+		}
+	}
+}
+void memmap_map_mmio(MEMMAP* map, uint16_t address, uint32_t size, MMIO_READ read, MMIO_WRITE write, void* context) {
+	page_range(address, size, first, last);
+	for (uint32_t i = first; i < last; ++i) {
+		map->pages[i].ptr = NULL;
+		map->pages[i].flags = PAGE_MMIO;
+		map->pages[i].read = read;
+		map->pages[i].write = write;
+		map->pages[i].context = context;
+		map->pages[i].generation++;
+		if (map->remap != NULL) {
+			map->remap(map->remap_context, (uint8_t)i);
+		}
+	}
+}
+void memmap_unmap(MEMMAP* map, uint16_t address, uint32_t size) {
+	page_range(address, size, first, last);
+	for (uint32_t i = first; i < last; ++i) {
+		map->pages[i].ptr = NULL;
+		map->pages[i].flags = PAGE_UNMAPPED;
+		map->pages[i].read = NULL;
+		map->pages[i].write = NULL;
+		map->pages[i].context = NULL;
+		map->pages[i].generation++;
+		if (map->remap != NULL) {
+			map->remap(map->remap_context, (uint8_t)i);
+		}
+	}
+}
+
+uint8_t memmap_read_slow(MEMMAP* map, uint16_t address) {
+	PAGE* page = &map->pages[address >> 8];
+	if ((page->flags & PAGE_MMIO) && page->read != NULL) {
+		return page->read(page->context, address);
+	}
+	return 0xFF;
+}
+void memmap_write_slow(MEMMAP* map, uint16_t address, uint8_t value) {
+	PAGE* page = &map->pages[address >> 8];
+	if ((page->flags & PAGE_MMIO) && page->write != NULL) {
+		page->generation++;
+		page->write(page->context, address, value);
+	}
+}
@@ -0,0 +1,71 @@
+/* memmap.h
+ * Memory map - 256 pages of 256 bytes
+ * Github: https:\\github.com\tommojphillips
+ */
+
+#ifndef MEMMAP_H
+#define MEMMAP_H
+
+#include <stdint.h>
+
+#define MEMMAP_PAGE_SIZE 0x100
+#define MEMMAP_PAGES     0x100
+
+#define PAGE_READ        0x01 // page can be read through ptr
+#define PAGE_WRITE       0x02 // page can be written through ptr
+#define PAGE_MMIO        0x04 // accesses not allowed through ptr go to the page handlers
+
+#define PAGE_RAM         (PAGE_READ | PAGE_WRITE)
+#define PAGE_ROM         (PAGE_READ)
+#define PAGE_UNMAPPED    0x00
+
+typedef uint8_t(*MMIO_READ)(void* context, uint16_t address);
+typedef void(*MMIO_WRITE)(void* context, uint16_t address, uint8_t value);
+typedef void(*MEMMAP_REMAP)(void* context, uint8_t page);
+
+typedef struct {
+	uint8_t* ptr;     // host memory for the page
+	uint8_t flags;    // PAGE_*
+	MMIO_READ read;   // PAGE_MMIO read handler
+	MMIO_WRITE write; // PAGE_MMIO write handler
+	void* context;    // PAGE_MMIO handler context
+	uint32_t generation; // bumped when the page is remapped or written; lets decoded code go stale
+} PAGE;
+
+typedef struct {
+	PAGE pages[MEMMAP_PAGES];
+	MEMMAP_REMAP remap;  // told about every page that is remapped, or NULL
+	void* remap_context;
+} MEMMAP;
+
+void memmap_init(MEMMAP* map);
+void memmap_map(MEMMAP* map, uint16_t address, uint32_t size, uint8_t* ptr, uint8_t flags);
+void memmap_map_mmio(MEMMAP* map, uint16_t address, uint32_t size, MMIO_READ read, MMIO_WRITE write, void* context);
+void memmap_unmap(MEMMAP* map, uint16_t address, uint32_t size);
+
+uint8_t memmap_read_slow(MEMMAP* map, uint16_t address);
+void memmap_write_slow(MEMMAP* map, uint16_t address, uint8_t value);
+
+/* direct pointer for an address, or NULL if the page is not directly readable */
+#define memmap_ptr(map, address) (((map)->pages[(address) >> 8].flags & PAGE_READ) ? \
+	(map)->pages[(address) >> 8].ptr + ((address) & 0xFF) : NULL)
+
+static inline uint8_t memmap_read(MEMMAP* map, uint16_t address) {
+	PAGE* page = &map->pages[address >> 8];
+	if (page->flags & PAGE_READ) {
+		return page->ptr[address & 0xFF];
+	}
+	return memmap_read_slow(map, address);
+}
+static inline void memmap_write(MEMMAP* map, uint16_t address, uint8_t value) {
+	PAGE* page = &map->pages[address >> 8];
+	if (page->flags & PAGE_WRITE) {
+		page->ptr[address & 0xFF] = value;
+		page->generation++;
+	}
+	else {
+		memmap_write_slow(map, address, value);
+	}
+}
+
+#endif
@@ -0,0 +1,320 @@
+/* metrics.c
+ * Machine metrics export
+ * Github: https:\\github.com\tommojphillips
+ */
+
+ /* Counters a collector can scrape to tell whether a machine is busy, spinning on a device or waiting on
+	I/O: instructions and cycles executed, idle cycles skipped, frames and the paced frames that finished
+	late, IN and OUT per port, sectors read and written and head steps per drive, and bytes received and
+	transmitted on each SIO port.
+
+	The counters are plain integers bumped by the thread stepping the machine, and the same thread renders
+	and publishes them between frames, so nothing is shared and nothing is locked. Counting is one
+	increment per IN, OUT, sector or byte. IN loops handled by the disk trap (-f) count as sectors, not INs.
+
+	Every period the counters are rendered, as Prometheus text or, when the target ends in .json, one JSON
+	object, and published to
+
+		<path>       written to <path>.tmp and renamed over <path>, so a reader never sees half a file
+		             (eg the node_exporter textfile collector)
+		unix:<path>  a listening unix socket; every connection is sent the last rendered metrics and closed.
+		             Connections are answered at the device poll rate, not once per period.
+
+	mips and mhz are rates over the last period; everything else counts from the start of the machine.
+ */
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L // strdup
+#endif
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "metrics.h"
+#include "88_sio.h"
+#include "88_dcdd.h"
+#include "timing.h"
+#include "idle.h"
+#include "file.h"
+
+#ifdef _WIN32
+
+static int socket_open(METRICS* metrics, const char* path) {
+	printf("Error: metrics sockets need a POSIX host\n");
+	return 1;
+}
+static void socket_close(METRICS* metrics) {
+}
+static void socket_publish(METRICS* metrics) {
+}
+
+#else
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#ifdef MSG_NOSIGNAL
+#define METRICS_SEND_FLAGS MSG_NOSIGNAL // a scraper hanging up must not kill the emulator
+#else
+#define METRICS_SEND_FLAGS 0
+#endif
+
+static int socket_open(METRICS* metrics, const char* path) {
+	struct sockaddr_un addr = { 0 };
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		printf("Error: socket path is too long: %s\n", path);
+		return 1;
+	}
+	strcpy(addr.sun_path, path);
+	metrics->listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (metrics->listener < 0) {
+		printf("Error: could not create socket\n");
+		return 1;
+	}
+	unlink(path);
+	if (bind(metrics->listener, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(metrics->listener, 8) != 0) {
+		printf("Error: could not listen on %s\n", path);
+		close(metrics->listener);
+		metrics->listener = -1;
+		return 1;
+	}
+	fcntl(metrics->listener, F_SETFL, fcntl(metrics->listener, F_GETFL, 0) | O_NONBLOCK);
+	return 0;
+}
+static void socket_close(METRICS* metrics) {
+	if (metrics->listener >= 0) {
+		close(metrics->listener);
+		unlink(metrics->target);
+		metrics->listener = -1;
+	}
+}
+static void socket_publish(METRICS* metrics) {
+	/* answer everyone who has connected; a slow reader gets what fits */
+	int client;
+	while ((client = accept(metrics->listener, NULL, NULL)) >= 0) {
+		fcntl(client, F_SETFL, fcntl(client, F_GETFL, 0) | O_NONBLOCK);
+		if (send(client, metrics->text, metrics->len, METRICS_SEND_FLAGS) < 0) {
+			/* gone already */
+		}
+		close(client);
+	}
+}
+
+#endif
+
+static void put(METRICS* metrics, const char* format, ...) {
+	if (metrics->len >= METRICS_TEXT_SIZE) {
+		return;
+	}
+	va_list args;
+	va_start(args, format);
+	int n = vsnprintf(metrics->text + metrics->len, METRICS_TEXT_SIZE - metrics->len, format, args);
+	va_end(args);
+	if (n > 0) {
+		metrics->len += n;
+		if (metrics->len >= METRICS_TEXT_SIZE) {
+			metrics->len = METRICS_TEXT_SIZE - 1;
+		}
+	}
+}
+static void put_family(METRICS* metrics, const char* name, const char* type, const char* help) {
+	put(metrics, "# HELP altair_%s %s\n# TYPE altair_%s %s\n", name, help, name, type);
+}
+
+static int drive_used(DISK* disk) {
+	return disk->buffer != NULL || disk->reads != 0 || disk->writes != 0 || disk->steps != 0;
+}
+
+static void render_prometheus(METRICS* metrics, uint64_t instructions, uint64_t cycles, uint64_t idle_cycles,
+	double mips, double mhz, TIMING* timing, SIO* sio, SIO* sio_b, DCDD* dcdd) {
+	put_family(metrics, "instructions_total", "counter", "Instructions executed.");
+	put(metrics, "altair_instructions_total %llu\n", (unsigned long long)instructions);
+	put_family(metrics, "cycles_total", "counter", "CPU cycles executed.");
+	put(metrics, "altair_cycles_total %llu\n", (unsigned long long)cycles);
+	put_family(metrics, "idle_cycles_total", "counter", "CPU cycles skipped while the guest waited on a device.");
+	put(metrics, "altair_idle_cycles_total %llu\n", (unsigned long long)idle_cycles);
+	put_family(metrics, "mips", "gauge", "Million instructions per second over the last period.");
+	put(metrics, "altair_mips %.3f\n", mips);
+	put_family(metrics, "mhz", "gauge", "Effective CPU clock over the last period.");
+	put(metrics, "altair_mhz %.3f\n", mhz);
+	put_family(metrics, "frames_total", "counter", "Frames run.");
+	put(metrics, "altair_frames_total %llu\n", (unsigned long long)timing->frames);
+	put_family(metrics, "frame_overruns_total", "counter", "Paced frames that finished after their real time deadline.");
+	put(metrics, "altair_frame_overruns_total %llu\n", (unsigned long long)timing->overruns);
+
+	put_family(metrics, "io_in_total", "counter", "IN instructions per port.");
+	for (int i = 0; i < 256; ++i) {
+		if (metrics->in[i] != 0) {
+			put(metrics, "altair_io_in_total{port=\"%02X\"} %llu\n", i, (unsigned long long)metrics->in[i]);
+		}
+	}
+	put_family(metrics, "io_out_total", "counter", "OUT instructions per port.");
+	for (int i = 0; i < 256; ++i) {
+		if (metrics->out[i] != 0) {
+			put(metrics, "altair_io_out_total{port=\"%02X\"} %llu\n", i, (unsigned long long)metrics->out[i]);
+		}
+	}
+
+	put_family(metrics, "disk_sectors_read_total", "counter", "Sectors read per drive.");
+	for (int i = 0; i < DCDD_MAX_DISKS; ++i) {
+		if (drive_used(&dcdd->disks[i])) {
+			put(metrics, "altair_disk_sectors_read_total{drive=\"%c\"} %llu\n", 'A' + i, (unsigned long long)dcdd->disks[i].reads);
+		}
+	}
+	put_family(metrics, "disk_sectors_written_total", "counter", "Sectors written per drive.");
+	for (int i = 0; i < DCDD_MAX_DISKS; ++i) {
+		if (drive_used(&dcdd->disks[i])) {
+			put(metrics, "altair_disk_sectors_written_total{drive=\"%c\"} %llu\n", 'A' + i, (unsigned long long)dcdd->disks[i].writes);
+		}
+	}
+	put_family(metrics, "disk_seeks_total", "counter", "Head steps per drive.");
+	for (int i = 0; i < DCDD_MAX_DISKS; ++i) {
+		if (drive_used(&dcdd->disks[i])) {
+			put(metrics, "altair_disk_seeks_total{drive=\"%c\"} %llu\n", 'A' + i, (unsigned long long)dcdd->disks[i].steps);
+		}
+	}
+
+	put_family(metrics, "sio_rx_bytes_total", "counter", "Bytes the guest read from an SIO port.");
+	put(metrics, "altair_sio_rx_bytes_total{port=\"A\"} %llu\n", (unsigned long long)sio->rx_bytes);
+	put(metrics, "altair_sio_rx_bytes_total{port=\"B\"} %llu\n", (unsigned long long)sio_b->rx_bytes);
+	put_family(metrics, "sio_tx_bytes_total", "counter", "Bytes the guest wrote to an SIO port.");
+	put(metrics, "altair_sio_tx_bytes_total{port=\"A\"} %llu\n", (unsigned long long)sio->tx_bytes);
+	put(metrics, "altair_sio_tx_bytes_total{port=\"B\"} %llu\n", (unsigned long long)sio_b->tx_bytes);
+}
+
+static void render_json(METRICS* metrics, uint64_t instructions, uint64_t cycles, uint64_t idle_cycles,
+	double mips, double mhz, TIMING* timing, SIO* sio, SIO* sio_b, DCDD* dcdd) {
+	put(metrics, "{\"instructions\":%llu,\"cycles\":%llu,\"idle_cycles\":%llu,\"mips\":%.3f,\"mhz\":%.3f,\"frames\":%llu,\"frame_overruns\":%llu",
+		(unsigned long long)instructions, (unsigned long long)cycles, (unsigned long long)idle_cycles, mips, mhz,
+		(unsigned long long)timing->frames, (unsigned long long)timing->overruns);
+
+	const char* separator = "";
+	put(metrics, ",\"io_in\":{");
+	for (int i = 0; i < 256; ++i) {
+		if (metrics->in[i] != 0) {
+			put(metrics, "%s\"%02X\":%llu", separator, i, (unsigned long long)metrics->in[i]);
+			separator = ",";
+		}
+	}
+	separator = "";
+	put(metrics, "},\"io_out\":{");
+	for (int i = 0; i < 256; ++i) {
+		if (metrics->out[i] != 0) {
+			put(metrics, "%s\"%02X\":%llu", separator, i, (unsigned long long)metrics->out[i]);
+			separator = ",";
+		}
+	}
+	separator = "";
+	put(metrics, "},\"disks\":{");
+	for (int i = 0; i < DCDD_MAX_DISKS; ++i) {
+		DISK* disk = &dcdd->disks[i];
+		if (drive_used(disk)) {
+			put(metrics, "%s\"%c\":{\"sectors_read\":%llu,\"sectors_written\":%llu,\"seeks\":%llu}", separator, 'A' + i,
+				(unsigned long long)disk->reads, (unsigned long long)disk->writes, (unsigned long long)disk->steps);
+			separator = ",";
+		}
+	}
+	put(metrics, "},\"sio\":{\"A\":{\"rx_bytes\":%llu,\"tx_bytes\":%llu},\"B\":{\"rx_bytes\":%llu,\"tx_bytes\":%llu}}}\n",
+		(unsigned long long)sio->rx_bytes, (unsigned long long)sio->tx_bytes,
+		(unsigned long long)sio_b->rx_bytes, (unsigned long long)sio_b->tx_bytes);
+}
+
+static void file_publish(METRICS* metrics) {
+	char tmp[FILENAME_MAX];
+	snprintf(tmp, sizeof(tmp), "%s.tmp", metrics->target);
+	FILE* file = NULL;
+	fopen_s(&file, tmp, "wb");
+	if (file == NULL) {
+		return;
+	}
+	size_t written = fwrite(metrics->text, 1, metrics->len, file);
+	fclose(file);
+	if (written != metrics->len) {
+		remove(tmp);
+		return;
+	}
+#ifdef _WIN32
+	remove(metrics->target);
+#endif
+	rename(tmp, metrics->target);
+}
+
+void metrics_init(METRICS* metrics) {
+	memset(metrics, 0, sizeof(METRICS));
+	metrics->listener = -1;
+}
+
+int metrics_open(METRICS* metrics, const char* target, uint32_t period) {
+	metrics_close(metrics);
+	int unix_socket = strncmp("unix:", target, 5) == 0;
+	const char* path = unix_socket ? target + 5 : target;
+	size_t len = strlen(path);
+	metrics->text = (char*)malloc(METRICS_TEXT_SIZE);
+	metrics->target = strdup(path);
+	if (metrics->text == NULL || metrics->target == NULL) {
+		printf("Failed to allocate metrics\n");
+		metrics_close(metrics);
+		return 1;
+	}
+	if (unix_socket && socket_open(metrics, path) != 0) {
+		metrics_close(metrics);
+		return 1;
+	}
+	metrics->format = (len >= 5 && strcmp(path + len - 5, ".json") == 0) ? METRICS_JSON : METRICS_PROMETHEUS;
+	metrics->period = (uint64_t)(period != 0 ? period : METRICS_DEFAULT_PERIOD) * 1000000;
+	metrics->last_time = timing_now();
+	metrics->next = metrics->last_time + metrics->period;
+	metrics->len = 0;
+	return 0;
+}
+void metrics_close(METRICS* metrics) {
+	if (metrics->target != NULL) {
+		socket_close(metrics);
+	}
+	free(metrics->target);
+	free(metrics->text);
+	metrics->target = NULL;
+	metrics->text = NULL;
+}
+
+void metrics_update(METRICS* metrics, int force, uint64_t instructions, TIMING* timing, IDLE* idle,
+	SIO* sio, SIO* sio_b, DCDD* dcdd) {
+	if (metrics->target == NULL) {
+		return;
+	}
+	uint64_t now = timing_now();
+	if (metrics->listener >= 0 && metrics->len != 0 && now - metrics->last_accept >= 1000000 / TIMING_POLL_RATE) {
+		/* scrapers are answered at the device poll rate with the last rendered metrics */
+		metrics->last_accept = now;
+		socket_publish(metrics);
+	}
+	if (now < metrics->next && !force && metrics->len != 0) {
+		return;
+	}
+	uint64_t cycles = timing->total_cycles - idle->skipped;
+	uint64_t elapsed = now - metrics->last_time;
+	double mips = elapsed != 0 ? (double)(instructions - metrics->last_instructions) / elapsed : 0.0;
+	double mhz = elapsed != 0 ? (double)(cycles - metrics->last_cycles) / elapsed : 0.0;
+	metrics->last_time = now;
+	metrics->last_instructions = instructions;
+	metrics->last_cycles = cycles;
+	metrics->next = now + metrics->period;
+
+	metrics->len = 0;
+	if (metrics->format == METRICS_JSON) {
+		render_json(metrics, instructions, cycles, idle->skipped, mips, mhz, timing, sio, sio_b, dcdd);
+	}
+	else {
+		render_prometheus(metrics, instructions, cycles, idle->skipped, mips, mhz, timing, sio, sio_b, dcdd);
+	}
+
+	if (metrics->listener < 0) {
+		file_publish(metrics);
+	}
+}
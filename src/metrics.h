@@ -0,0 +1,51 @@
+/* metrics.h
+ * Machine metrics export
+ * Github: https:\\github.com\tommojphillips
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+
+#include "88_sio.h"
+#include "88_dcdd.h"
+#include "timing.h"
+#include "idle.h"
+
+#define METRICS_DEFAULT_PERIOD 1     // seconds between exports
+#define METRICS_TEXT_SIZE      0x8000 // rendered metrics; every port and drive fits
+
+#define METRICS_PROMETHEUS     0
+#define METRICS_JSON           1
+
+typedef struct {
+	uint64_t in[256];        // IN instructions per port
+	uint64_t out[256];       // OUT instructions per port
+
+	char* target;            // file or socket path, or NULL when exporting is off
+	int format;              // METRICS_PROMETHEUS or METRICS_JSON
+	int listener;            // unix socket listening descriptor, or -1 when exporting to a file
+	uint64_t period;         // host time between exports (us)
+	uint64_t next;           // host time of the next export (us)
+	uint64_t last_accept;    // socket: host time connections were last answered (us)
+	uint64_t last_time;      // at the last export; for the rates
+	uint64_t last_instructions;
+	uint64_t last_cycles;
+	char* text;              // last rendered metrics (METRICS_TEXT_SIZE)
+	uint32_t len;
+} METRICS;
+
+void metrics_init(METRICS* metrics);
+int metrics_open(METRICS* metrics, const char* target, uint32_t period);
+void metrics_close(METRICS* metrics);
+
+/* render and publish the counters; cheap to call every frame, it only renders once a period or when forced */
+void metrics_update(METRICS* metrics, int force, uint64_t instructions, TIMING* timing, IDLE* idle,
+	SIO* sio, SIO* sio_b, DCDD* dcdd);
+
+#define metrics_enabled(metrics) ((metrics)->target != NULL)
+#define metrics_in(metrics, port)  ((metrics)->in[port]++)
+#define metrics_out(metrics, port) ((metrics)->out[port]++)
+
+#endif
@@ -0,0 +1,162 @@
+/* pool.c
+ * Thread pool that runs independent machines across host cores
+ * Github: https:\\github.com\tommojphillips
+ */
+
+ /* Each machine is self contained, so workers share nothing but the job index.
+	A worker claims the next job, steps that machine until it stops and claims another.
+	Machines never migrate between threads while running, which keeps the
+	thread local bus pointer in altair8800.c valid for the whole job. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#include "pool.h"
+#include "altair8800.h"
+#include "timing.h"
+
+typedef struct {
+	POOL_JOB* jobs;
+	uint32_t count;
+	uint32_t next;
+	uint64_t time_limit;
+#ifdef _WIN32
+	CRITICAL_SECTION lock;
+#else
+	pthread_mutex_t lock;
+#endif
+} POOL;
+
+static uint32_t pool_claim(POOL* pool) {
+	uint32_t index;
+#ifdef _WIN32
+	EnterCriticalSection(&pool->lock);
+	index = pool->next++;
+	LeaveCriticalSection(&pool->lock);
+#else
+	pthread_mutex_lock(&pool->lock);
+	index = pool->next++;
+	pthread_mutex_unlock(&pool->lock);
+#endif
+	return index;
+}
+
+static void pool_run_job(POOL* pool, POOL_JOB* job) {
+	ALTAIR8800* machine = job->machine;
+	if (machine == NULL) {
+		job->status = POOL_JOB_SKIPPED;
+		return;
+	}
+
+	uint64_t start = timing_now();
+	uint64_t elapsed = 0;
+	job->status = POOL_JOB_OK;
+	while (machine->running) {
+		altair8800_step(machine);
+		elapsed = timing_now() - start;
+		if (pool->time_limit != 0 && elapsed >= pool->time_limit) {
+			job->status = POOL_JOB_TIMEOUT;
+			break;
+		}
+	}
+	job->elapsed = elapsed;
+}
+
+#ifdef _WIN32
+static DWORD WINAPI pool_worker(LPVOID param) {
+#else
+static void* pool_worker(void* param) {
+#endif
+	POOL* pool = (POOL*)param;
+	uint32_t index;
+	while ((index = pool_claim(pool)) < pool->count) {
+		pool_run_job(pool, &pool->jobs[index]);
+	}
+	return 0;
+}
+
+uint32_t pool_cpu_count() {
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
+#else
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (uint32_t)n : 1;
+#endif
+}
+
+int pool_run(POOL_JOB* jobs, uint32_t count, uint32_t threads, uint64_t time_limit) {
+	POOL pool = { 0 };
+	pool.jobs = jobs;
+	pool.count = count;
+	pool.time_limit = time_limit;
+
+	if (threads == 0) {
+		threads = pool_cpu_count();
+	}
+	if (threads > count) {
+		threads = count;
+	}
+	if (threads > POOL_MAX_THREADS) {
+		threads = POOL_MAX_THREADS;
+	}
+	if (threads == 0) {
+		return 0;
+	}
+
+#ifdef _WIN32
+	HANDLE workers[POOL_MAX_THREADS];
+	InitializeCriticalSection(&pool.lock);
+#else
+	pthread_t workers[POOL_MAX_THREADS];
+	pthread_mutex_init(&pool.lock, NULL);
+#endif
+
+	/* the calling thread is a worker too */
+	uint32_t started = 0;
+	for (uint32_t i = 1; i < threads; ++i) {
+#ifdef _WIN32
+		workers[started] = CreateThread(NULL, 0, pool_worker, &pool, 0, NULL);
+		if (workers[started] == NULL) {
+			break;
+		}
+#else
+		if (pthread_create(&workers[started], NULL, pool_worker, &pool) != 0) {
+			break;
+		}
+#endif
+		++started;
+	}
+	int status = 0;
+	if (started + 1 < threads) {
+		printf("Error: started %u of %u pool threads\n", started + 1, threads);
+		status = 1;
+	}
+
+	pool_worker(&pool);
+
+	for (uint32_t i = 0; i < started; ++i) {
+#ifdef _WIN32
+		WaitForSingleObject(workers[i], INFINITE);
+		CloseHandle(workers[i]);
+#else
+		pthread_join(workers[i], NULL);
+#endif
+	}
+
+#ifdef _WIN32
+	DeleteCriticalSection(&pool.lock);
+#else
+	pthread_mutex_destroy(&pool.lock);
+#endif
+	return status;
+}
@@ -0,0 +1,32 @@
+/* pool.h
+ * Thread pool that runs independent machines across host cores
+ * Github: https:\\github.com\tommojphillips
+ */
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdint.h>
+
+#include "altair8800.h"
+
+#define POOL_MAX_THREADS 256
+
+#define POOL_JOB_OK      0 // machine stopped by itself
+#define POOL_JOB_TIMEOUT 1 // time limit reached
+#define POOL_JOB_SKIPPED 2 // machine was NULL
+
+typedef struct {
+	ALTAIR8800* machine;
+	int status;          // POOL_JOB_*
+	uint64_t elapsed;    // wall time in microseconds
+} POOL_JOB;
+
+/* Run every job to completion on up to <threads> worker threads (0 = one per host core).
+ * time_limit is a per job wall-clock limit in microseconds (0 = none).
+ * The calling thread works too. Every job is run even if fewer threads could be started.
+ * returns 0 on success, 1 if some worker threads failed to start */
+int pool_run(POOL_JOB* jobs, uint32_t count, uint32_t threads, uint64_t time_limit);
+uint32_t pool_cpu_count();
+
+#endif
@@ -0,0 +1,268 @@
+/* pool_main.c
+ * Run many independent machines in one process
+ * Github: https:\\github.com\tommojphillips
+ */
+
+ /* Reads a job file where every line is the argument list of one machine,
+	runs all of them on the thread pool and prints one JSON line per job:
+
+	{"job":0,"name":"boot","status":"ok","instructions":0,"cycles":0,"wall_s":0.000,"mhz":0.00}
+
+	Blank lines and lines starting with # are ignored. Arguments may be quoted with "".
+	Every machine starts in turbo with a null console, so give each job a script (-i)
+	and, for guest output, a capture file (-c). Jobs must not share a writable disk image.
+
+	status is "ok" when the machine stopped by itself, "timeout" when the time limit was hit
+	and "error" when the machine could not be created.
+
+	Usage: altair-pool [options] <job file>
+		-j<threads>  worker threads (default one per host core)
+		-l<seconds>  wall-clock time limit per job (default 300, 0 = none)
+		-r<file>     write the results to <file> instead of stdout
+		-e           run every machine on one thread with the event loop (evloop.c) instead of
+		             the thread pool; jobs given -t<speed> wait without holding up the others
+
+	Options per job line (plus all altair options)
+		-n<name>     job name
+		-i<script>   script file; guest output is not echoed
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "altair8800.h"
+#include "args.h"
+#include "console.h"
+#include "timing.h"
+#include "file.h"
+#include "pool.h"
+#include "evloop.h"
+
+#define POOL_TIME_LIMIT 300  // seconds
+#define POOL_LINE_MAX   4096
+#define POOL_ARGS_MAX   64
+
+typedef struct {
+	char line[POOL_LINE_MAX]; // tokens point into this; altair keeps some of them
+	char* argv[POOL_ARGS_MAX];
+	int argc;
+	const char* name;
+} JOB_ARGS;
+
+static JOB_ARGS* current = NULL;
+
+static int job_args(ALTAIR8800* altair, const char* arg) {
+	if (strncmp("-n", arg, 2) == 0) {
+		current->name = arg + 2;
+		return 1;
+	}
+
+	if (strncmp("-i", arg, 2) == 0) {
+		FILE* capture = altair->console.capture;
+		altair->console.capture = NULL;
+		console_destroy(&altair->console);
+		if (console_init_script(&altair->console, arg + 2, 0) != 0) {
+			console_init_null(&altair->console);
+			altair->running = 0;
+		}
+		altair->console.capture = capture;
+		return 1;
+	}
+
+	return 0;
+}
+
+/* split a line into arguments in place; "" groups words */
+static int tokenize(JOB_ARGS* job) {
+	char* p = job->line;
+	job->argv[0] = "altair-pool";
+	job->argc = 1;
+	while (*p != '\0') {
+		while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+			++p;
+		}
+		if (*p == '\0') {
+			break;
+		}
+		if (job->argc == POOL_ARGS_MAX) {
+			return 1;
+		}
+		char* dst = p;
+		job->argv[job->argc++] = dst;
+		int quoted = 0;
+		while (*p != '\0' && (quoted || (*p != ' ' && *p != '\t' && *p != '\r' && *p != '\n'))) {
+			if (*p == '"') {
+				quoted = !quoted;
+				++p;
+				continue;
+			}
+			*dst++ = *p++;
+		}
+		if (*p != '\0') {
+			++p;
+		}
+		*dst = '\0';
+	}
+	return 0;
+}
+
+static JOB_ARGS* read_jobs(const char* filename, uint32_t* count) {
+	FILE* file = NULL;
+	fopen_s(&file, filename, "rb");
+	if (file == NULL) {
+		printf("Failed to open job file: %s\n", filename);
+		return NULL;
+	}
+
+	uint32_t capacity = 16;
+	JOB_ARGS* jobs = (JOB_ARGS*)malloc(capacity * sizeof(JOB_ARGS));
+	if (jobs == NULL) {
+		fclose(file);
+		return NULL;
+	}
+
+	char line[POOL_LINE_MAX];
+	uint32_t n = 0;
+	uint32_t line_number = 0;
+	while (fgets(line, sizeof(line), file) != NULL) {
+		++line_number;
+		const char* p = line;
+		while (*p == ' ' || *p == '\t') {
+			++p;
+		}
+		if (*p == '#' || *p == '\r' || *p == '\n' || *p == '\0') {
+			continue;
+		}
+
+		if (n == capacity) {
+			JOB_ARGS* grown = (JOB_ARGS*)realloc(jobs, capacity * 2 * sizeof(JOB_ARGS));
+			if (grown == NULL) {
+				break;
+			}
+			jobs = grown;
+			capacity *= 2;
+		}
+
+		JOB_ARGS* job = &jobs[n];
+		memcpy(job->line, line, sizeof(line));
+		job->name = NULL;
+		if (tokenize(job) != 0) {
+			printf("Error: too many arguments on line %u of %s\n", line_number, filename);
+			continue;
+		}
+		++n;
+	}
+	fclose(file);
+
+	*count = n;
+	return jobs;
+}
+
+int main(int argc, char** argv) {
+	uint32_t threads = 0;
+	uint64_t time_limit = POOL_TIME_LIMIT * 1000000ULL;
+	const char* job_file = NULL;
+	const char* results = NULL;
+	int event_loop = 0;
+	for (int i = 1; i < argc; ++i) {
+		if (strncmp("-j", argv[i], 2) == 0) {
+			threads = strtol(argv[i] + 2, NULL, 10);
+		}
+		else if (strncmp("-l", argv[i], 2) == 0) {
+			time_limit = strtoull(argv[i] + 2, NULL, 10) * 1000000ULL;
+		}
+		else if (strncmp("-r", argv[i], 2) == 0) {
+			results = argv[i] + 2;
+		}
+		else if (strcmp("-e", argv[i]) == 0) {
+			event_loop = 1;
+		}
+		else {
+			job_file = argv[i];
+		}
+	}
+	if (job_file == NULL) {
+		printf("Usage: altair-pool [-j<threads>] [-l<seconds>] [-r<file>] [-e] <job file>\n");
+		return 1;
+	}
+
+	uint32_t count = 0;
+	JOB_ARGS* job_args_list = read_jobs(job_file, &count);
+	if (job_args_list == NULL) {
+		return 1;
+	}
+
+	POOL_JOB* jobs = (POOL_JOB*)calloc(count > 0 ? count : 1, sizeof(POOL_JOB));
+	if (jobs == NULL) {
+		free(job_args_list);
+		return 1;
+	}
+
+	/* argument parsing loads roms and mounts disks, so it stays on this thread */
+	for (uint32_t i = 0; i < count; ++i) {
+		ALTAIR8800* altair = altair8800_create();
+		if (altair == NULL) {
+			continue;
+		}
+		altair->timing.multiplier = TIMING_TURBO;
+		current = &job_args_list[i];
+		args(altair, current->argc, current->argv, job_args);
+		jobs[i].machine = altair;
+	}
+	current = NULL;
+
+	uint64_t start = timing_now();
+	if (event_loop) {
+		threads = 1;
+		evloop_run(jobs, count, time_limit);
+	}
+	else {
+		pool_run(jobs, count, threads, time_limit);
+	}
+	double total_wall = (timing_now() - start) / 1000000.0;
+
+	FILE* out = stdout;
+	if (results != NULL) {
+		fopen_s(&out, results, "wb");
+		if (out == NULL) {
+			printf("Failed to open result file: %s\n", results);
+			out = stdout;
+		}
+	}
+
+	int status = 0;
+	uint64_t total_instructions = 0;
+	for (uint32_t i = 0; i < count; ++i) {
+		ALTAIR8800* altair = jobs[i].machine;
+		const char* name = job_args_list[i].name != NULL ? job_args_list[i].name : "job";
+		if (altair == NULL) {
+			fprintf(out, "{\"job\":%u,\"name\":\"%s\",\"status\":\"error\"}\n", i, name);
+			status = 1;
+			continue;
+		}
+
+		double wall = jobs[i].elapsed / 1000000.0;
+		uint64_t cycles = altair->timing.total_cycles - altair->idle.skipped;
+		fprintf(out, "{\"job\":%u,\"name\":\"%s\",\"status\":\"%s\",\"instructions\":%llu,\"cycles\":%llu,\"wall_s\":%.3f,\"mhz\":%.2f}\n",
+			i, name, jobs[i].status == POOL_JOB_OK ? "ok" : "timeout",
+			(unsigned long long)altair->instructions, (unsigned long long)cycles, wall,
+			wall > 0 ? cycles / wall / 1000000.0 : 0.0);
+		if (jobs[i].status != POOL_JOB_OK) {
+			status = 1;
+		}
+		total_instructions += altair->instructions;
+		altair8800_destroy(altair);
+	}
+	fprintf(out, "{\"jobs\":%u,\"threads\":%u,\"wall_s\":%.3f,\"ips\":%.0f}\n",
+		count, threads != 0 ? threads : pool_cpu_count(), total_wall,
+		total_wall > 0 ? total_instructions / total_wall : 0.0);
+	if (out != stdout) {
+		fclose(out);
+	}
+
+	free(jobs);
+	free(job_args_list);
+	return status;
+}
@@ -0,0 +1,96 @@
+/* predecode.c
+ * Predecoded instruction cache for the i8080
+ * Github: https:\\github.com\tommojphillips
+ */
+
+ /* Each guest address caches the cpu_ops handler, operand and cycle cost of the instruction that
+  * starts there, along with the generation of its page. An entry is used only while the page
+  * generation still matches, so any write through the memory path or a remap of the page makes
+  * every entry in the page stale, and it is decoded again the next time it runs.
+  *
+  * Instructions without a handler (IN, OUT, HLT, EI, DI), instructions that cross a page and
+  * code outside RAM or ROM are left to the interpreter.
+  */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "predecode.h"
+#include "cpu_ops.h"
+#include "i8080.h"
+#include "memmap.h"
+
+#ifdef _DEBUG
+#define dbg_err(x, ...) printf(x, __VA_ARGS__)
+#else
+#define dbg_err(x, ...)
+#endif
+
+static void predecode_decode(PREDECODE* cache, PREDECODE_ENTRY* entry, uint16_t address) {
+	PAGE* page = &cache->map->pages[address >> 8];
+	uint8_t opcode = page->ptr[address & 0xFF];
+	const CPU_OP_INFO* info = &cpu_ops[opcode];
+
+	entry->op = info->op;
+	entry->generation = page->generation;
+	entry->opcode = opcode;
+	entry->length = info->length;
+	entry->cycles = info->cycles;
+	entry->operand = 0;
+
+	if ((address & 0xFF) + info->length > MEMMAP_PAGE_SIZE) {
+		entry->op = NULL;
+	}
+	else if (info->length == 2) {
+		entry->operand = page->ptr[(address & 0xFF) + 1];
+	}
+	else if (info->length == 3) {
+		entry->operand = page->ptr[(address & 0xFF) + 1] | (page->ptr[(address & 0xFF) + 2] << 8);
+	}
+	cache->decoded++;
+}
+
+int predecode_init(PREDECODE* cache, MEMMAP* map) {
+	cache->map = map;
+	cache->decoded = 0;
+	cache->entries = (PREDECODE_ENTRY*)calloc(0x10000, sizeof(PREDECODE_ENTRY));
+	if (cache->entries == NULL) {
+		dbg_err("Failed to allocate predecode cache\n");
+		return 1;
+	}
+	return 0;
+}
+void predecode_destroy(PREDECODE* cache) {
+	if (cache->entries != NULL) {
+		free(cache->entries);
+		cache->entries = NULL;
+	}
+}
+uint32_t predecode_execute(PREDECODE* cache, I8080* cpu, uint32_t cycles) {
+	/* run cached instructions until the cycle budget is spent or the next instruction needs the interpreter */
+	uint32_t count = 0;
+	if (cpu->flags.halt) {
+		return 0;
+	}
+	while (cpu->cycles < cycles) {
+		uint16_t pc = cpu->pc;
+		PAGE* page = &cache->map->pages[pc >> 8];
+		PREDECODE_ENTRY* entry = &cache->entries[pc];
+		if (entry->length == 0 || entry->generation != page->generation) {
+			if (!(page->flags & PAGE_READ)) {
+				break;
+			}
+			predecode_decode(cache, entry, pc);
+		}
+		if (entry->op == NULL) {
+			break;
+		}
+		cpu->pc = pc + entry->length;
+		cpu->cycles += entry->cycles;
+		entry->op(cpu, entry->opcode, entry->operand);
+		count++;
+	}
+	return count;
+}
@@ -0,0 +1,34 @@
+/* predecode.h
+ * Predecoded instruction cache for the i8080
+ * Github: https:\\github.com\tommojphillips
+ */
+
+#ifndef PREDECODE_H
+#define PREDECODE_H
+
+#include <stdint.h>
+
+#include "i8080.h"
+#include "memmap.h"
+#include "cpu_ops.h"
+
+typedef struct {
+	CPU_OP op;           // handler, or NULL if the instruction runs in the interpreter
+	uint32_t generation; // generation of the page when decoded
+	uint16_t operand;
+	uint8_t opcode;
+	uint8_t length;      // 0 = not decoded
+	uint8_t cycles;
+} PREDECODE_ENTRY;
+
+typedef struct {
+	PREDECODE_ENTRY* entries; // one per guest address
+	MEMMAP* map;
+	uint64_t decoded;         // instructions decoded, including redecodes of stale entries
+} PREDECODE;
+
+int predecode_init(PREDECODE* cache, MEMMAP* map);
+void predecode_destroy(PREDECODE* cache);
+uint32_t predecode_execute(PREDECODE* cache, I8080* cpu, uint32_t cycles);
+
+#endif
@@ -0,0 +1,480 @@
+/* profile.c
+ * Guest code profiler - per address counts and cycles, call graph
+ * Github: https:\\github.com\tommojphillips
+ */
+
+ /* Every instruction is counted; there is no sampling. With the counters in flat 64K arrays an
+	instruction costs two increments, which is cheaper than deciding whether to take a sample.
+
+	CALL, Ccc and RST that are taken push a frame and enter a node of the call tree; a taken RET
+	or Rcc pops back to the frame it returns to. Guest code that returns somewhere else
+	(PUSH H / RET jumps, discarded return addresses) is matched against the expected
+	return addresses further down the stack, or ignored if none match.
+
+	The report is written on exit:
+		<file>         hotspots by cycles with disassembly, functions by cycles, port counts
+		<file>.folded  one line per call path, "A;B;C cycles", for flamegraph.pl and compatibles
+
+	Symbols come from .SYM files (pairs of hex address and name, eg "0100 START")
+	or .PRN listings (the address column of lines that define a "LABEL:").
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "profile.h"
+#include "altair8800.h"
+#include "i8080.h"
+#include "i8080_mnem.h"
+#include "memmap.h"
+#include "cpu_ops.h"
+#include "file.h"
+
+#define PROFILE_ROOT 0
+
+#define IS_CALL(opcode) ((opcode) == 0xCD || ((opcode) & 0xC7) == 0xC4 || ((opcode) & 0xC7) == 0xC7)
+#define IS_RET(opcode)  ((opcode) == 0xC9 || ((opcode) & 0xC7) == 0xC0)
+
+int profile_init(PROFILE* profile) {
+	profile->counts = (uint64_t*)calloc(0x10000, sizeof(uint64_t));
+	profile->cycles = (uint64_t*)calloc(0x10000, sizeof(uint64_t));
+	profile->buckets = (uint32_t*)calloc(PROFILE_BUCKETS, sizeof(uint32_t));
+	profile->node_capacity = 1024;
+	profile->nodes = (PROFILE_NODE*)calloc(profile->node_capacity, sizeof(PROFILE_NODE));
+	if (profile->counts == NULL || profile->cycles == NULL || profile->buckets == NULL || profile->nodes == NULL) {
+		printf("Error: could not allocate the profiler\n");
+		profile_destroy(profile);
+		return 1;
+	}
+	memset(profile->port_in, 0, sizeof(profile->port_in));
+	memset(profile->port_out, 0, sizeof(profile->port_out));
+	profile->node_count = 1;
+	profile->node = PROFILE_ROOT;
+	profile->depth = 0;
+	profile->lost_calls = 0;
+	return 0;
+}
+void profile_destroy(PROFILE* profile) {
+	free(profile->counts);
+	free(profile->cycles);
+	free(profile->buckets);
+	free(profile->nodes);
+	free(profile->symbols);
+	profile->counts = NULL;
+	profile->cycles = NULL;
+	profile->buckets = NULL;
+	profile->nodes = NULL;
+	profile->symbols = NULL;
+	profile->symbol_count = 0;
+}
+
+/* SYMBOLS */
+
+static int add_symbol(PROFILE* profile, uint16_t address, const char* name, size_t len) {
+	if ((profile->symbol_count & 0xFF) == 0) {
+		PROFILE_SYMBOL* grown = (PROFILE_SYMBOL*)realloc(profile->symbols, (profile->symbol_count + 0x100) * sizeof(PROFILE_SYMBOL));
+		if (grown == NULL) {
+			return 1;
+		}
+		profile->symbols = grown;
+	}
+	PROFILE_SYMBOL* symbol = &profile->symbols[profile->symbol_count++];
+	if (len >= PROFILE_SYMBOL_LEN) {
+		len = PROFILE_SYMBOL_LEN - 1;
+	}
+	symbol->address = address;
+	memcpy(symbol->name, name, len);
+	symbol->name[len] = '\0';
+	return 0;
+}
+static int compare_symbols(const void* a, const void* b) {
+	return (int)((const PROFILE_SYMBOL*)a)->address - (int)((const PROFILE_SYMBOL*)b)->address;
+}
+static int is_hex_word(const char* token, size_t len) {
+	if (len != 4) {
+		return 0;
+	}
+	for (size_t i = 0; i < len; ++i) {
+		if (!isxdigit((unsigned char)token[i])) {
+			return 0;
+		}
+	}
+	return 1;
+}
+static int is_name_char(char ch) {
+	return isalnum((unsigned char)ch) || ch == '_' || ch == '$' || ch == '?' || ch == '@' || ch == '.';
+}
+
+static void parse_sym_line(PROFILE* profile, const char* line) {
+	/* "0100 START  0103 LOOP ..." */
+	const char* p = line;
+	for (;;) {
+		while (*p == ' ' || *p == '\t') {
+			++p;
+		}
+		const char* address = p;
+		while (isxdigit((unsigned char)*p)) {
+			++p;
+		}
+		if (!is_hex_word(address, p - address) || (*p != ' ' && *p != '\t')) {
+			return;
+		}
+		while (*p == ' ' || *p == '\t') {
+			++p;
+		}
+		const char* name = p;
+		while (is_name_char(*p)) {
+			++p;
+		}
+		if (p == name) {
+			return;
+		}
+		add_symbol(profile, (uint16_t)strtol(address, NULL, 16), name, p - name);
+	}
+}
+static void parse_prn_line(PROFILE* profile, const char* line) {
+	/* " 0100 C30001  START:  JMP  INIT" */
+	const char* p = line;
+	while (*p == ' ' || *p == '\t') {
+		++p;
+	}
+	const char* address = p;
+	while (isxdigit((unsigned char)*p)) {
+		++p;
+	}
+	if (!is_hex_word(address, p - address) || strstr(line, "EQU") != NULL || strstr(line, "equ") != NULL) {
+		return;
+	}
+	const char* colon = strchr(p, ':');
+	if (colon == NULL || (strchr(p, ';') != NULL && strchr(p, ';') < colon)) {
+		return;
+	}
+	const char* name = colon;
+	while (name > p && is_name_char(name[-1])) {
+		--name;
+	}
+	if (name == colon || isdigit((unsigned char)*name)) {
+		return;
+	}
+	add_symbol(profile, (uint16_t)strtol(address, NULL, 16), name, colon - name);
+}
+
+int profile_load_symbols(PROFILE* profile, const char* filename) {
+	FILE* file = NULL;
+	fopen_s(&file, filename, "rb");
+	if (file == NULL) {
+		printf("Failed to open symbol file: %s\n", filename);
+		return 1;
+	}
+
+	size_t len = strlen(filename);
+	int prn = len >= 4 && (strcmp(filename + len - 4, ".PRN") == 0 || strcmp(filename + len - 4, ".prn") == 0);
+	uint32_t before = profile->symbol_count;
+	char line[256];
+	while (fgets(line, sizeof(line), file) != NULL) {
+		if (prn) {
+			parse_prn_line(profile, line);
+		}
+		else {
+			parse_sym_line(profile, line);
+		}
+	}
+	fclose(file);
+
+	qsort(profile->symbols, profile->symbol_count, sizeof(PROFILE_SYMBOL), compare_symbols);
+	printf("%s\t-> SYMBOLS ( %u )\n", filename, profile->symbol_count - before);
+	return 0;
+}
+
+static const PROFILE_SYMBOL* find_symbol(PROFILE* profile, uint16_t address) {
+	/* closest symbol at or below address */
+	const PROFILE_SYMBOL* found = NULL;
+	uint32_t lo = 0;
+	uint32_t hi = profile->symbol_count;
+	while (lo < hi) {
+		uint32_t mid = (lo + hi) / 2;
+		if (profile->symbols[mid].address <= address) {
+			found = &profile->symbols[mid];
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
+		}
+	}
+	return found;
+}
+static void symbol_name(PROFILE* profile, uint16_t address, char* str, size_t size) {
+	const PROFILE_SYMBOL* symbol = find_symbol(profile, address);
+	if (symbol == NULL) {
+		snprintf(str, size, "%04X", address);
+	}
+	else if (symbol->address == address) {
+		snprintf(str, size, "%s", symbol->name);
+	}
+	else {
+		snprintf(str, size, "%s+%X", symbol->name, address - symbol->address);
+	}
+}
+
+/* CALL TREE */
+
+static uint32_t enter_node(PROFILE* profile, uint32_t parent, uint16_t address) {
+	uint32_t bucket = ((parent * 0x9E3779B1u) ^ address) & (PROFILE_BUCKETS - 1);
+	for (uint32_t i = profile->buckets[bucket]; i != 0; i = profile->nodes[i].next) {
+		if (profile->nodes[i].parent == parent && profile->nodes[i].address == address) {
+			return i;
+		}
+	}
+
+	if (profile->node_count == profile->node_capacity) {
+		PROFILE_NODE* grown = (PROFILE_NODE*)realloc(profile->nodes, profile->node_capacity * 2 * sizeof(PROFILE_NODE));
+		if (grown == NULL) {
+			/* out of memory; charge the callee to the caller */
+			return parent;
+		}
+		profile->nodes = grown;
+		profile->node_capacity *= 2;
+	}
+	uint32_t index = profile->node_count++;
+	PROFILE_NODE* node = &profile->nodes[index];
+	node->parent = parent;
+	node->address = address;
+	node->calls = 0;
+	node->cycles = 0;
+	node->next = profile->buckets[bucket];
+	profile->buckets[bucket] = index;
+	return index;
+}
+
+void profile_execute(PROFILE* profile, I8080* cpu, MEMMAP* map) {
+	uint16_t pc = cpu->pc;
+	uint16_t sp = cpu->sp;
+	uint32_t cycles = cpu->cycles;
+	uint8_t* ptr = memmap_ptr(map, pc);
+	uint8_t opcode = ptr != NULL ? *ptr : 0xFF;
+
+	i8080_execute(cpu);
+
+	cycles = cpu->cycles - cycles;
+	profile->counts[pc]++;
+	profile->cycles[pc] += cycles;
+	profile->nodes[profile->node].cycles += cycles;
+
+	if (IS_CALL(opcode) && cpu->sp == (uint16_t)(sp - 2)) {
+		if (profile->depth == PROFILE_STACK_MAX) {
+			profile->lost_calls++;
+			return;
+		}
+		PROFILE_FRAME* frame = &profile->stack[profile->depth++];
+		frame->ret = (uint16_t)(pc + cpu_ops[opcode].length);
+		frame->node = profile->node;
+		profile->node = enter_node(profile, profile->node, cpu->pc);
+		profile->nodes[profile->node].calls++;
+	}
+	else if (IS_RET(opcode) && cpu->sp == (uint16_t)(sp + 2)) {
+		for (uint32_t i = profile->depth; i > 0; --i) {
+			if (profile->stack[i - 1].ret == cpu->pc) {
+				profile->node = profile->stack[i - 1].node;
+				profile->depth = i - 1;
+				break;
+			}
+		}
+	}
+}
+
+/* REPORT */
+
+/* the disassembler reads through the cpu bus callbacks, which take no context; the map being reported on this thread */
+static THREAD_LOCAL MEMMAP* disasm_map = NULL;
+static uint8_t disasm_read(uint16_t address) {
+	uint8_t* ptr = memmap_ptr(disasm_map, address);
+	return ptr != NULL ? *ptr : 0xFF;
+}
+static void disasm_write(uint16_t address, uint8_t value) {
+
+}
+
+static int compare_desc(uint64_t a, uint64_t b) {
+	return a < b ? 1 : (a > b ? -1 : 0);
+}
+typedef struct {
+	uint32_t pc;
+	uint64_t cycles;
+} HOTSPOT;
+
+static int compare_hotspots(const void* a, const void* b) {
+	const HOTSPOT* x = (const HOTSPOT*)a;
+	const HOTSPOT* y = (const HOTSPOT*)b;
+	int order = compare_desc(x->cycles, y->cycles);
+	return order != 0 ? order : (x->pc < y->pc ? -1 : (x->pc > y->pc));
+}
+
+typedef struct {
+	uint16_t address;
+	uint64_t calls;
+	uint64_t self;
+	uint64_t total;
+} FUNCTION;
+
+static int compare_functions(const void* a, const void* b) {
+	return compare_desc(((const FUNCTION*)a)->total, ((const FUNCTION*)b)->total);
+}
+
+static int write_folded(PROFILE* profile, const char* filename) {
+	FILE* file = NULL;
+	fopen_s(&file, filename, "wb");
+	if (file == NULL) {
+		printf("Error: could not open file: %s\n", filename);
+		return 1;
+	}
+	uint32_t path[PROFILE_STACK_MAX + 1];
+	char name[PROFILE_SYMBOL_LEN + 8];
+	for (uint32_t i = 0; i < profile->node_count; ++i) {
+		if (profile->nodes[i].cycles == 0) {
+			continue;
+		}
+		uint32_t depth = 0;
+		for (uint32_t n = i; n != PROFILE_ROOT && depth < PROFILE_STACK_MAX; n = profile->nodes[n].parent) {
+			path[depth++] = n;
+		}
+		fputs("root", file);
+		while (depth > 0) {
+			symbol_name(profile, profile->nodes[path[--depth]].address, name, sizeof(name));
+			fprintf(file, ";%s", name);
+		}
+		fprintf(file, " %llu\n", (unsigned long long)profile->nodes[i].cycles);
+	}
+	fclose(file);
+	return 0;
+}
+
+int profile_report(PROFILE* profile, MEMMAP* map, const char* filename) {
+	if (!profile_enabled(profile)) {
+		return 1;
+	}
+	FILE* file = NULL;
+	fopen_s(&file, filename, "wb");
+	if (file == NULL) {
+		printf("Error: could not open file: %s\n", filename);
+		return 1;
+	}
+
+	uint64_t total_cycles = 0;
+	uint64_t total_count = 0;
+	for (uint32_t i = 0; i < 0x10000; ++i) {
+		total_cycles += profile->cycles[i];
+		total_count += profile->counts[i];
+	}
+	double percent = total_cycles > 0 ? 100.0 / total_cycles : 0.0;
+	fprintf(file, "%llu instructions, %llu cycles\n\n", (unsigned long long)total_count, (unsigned long long)total_cycles);
+
+	/* hotspots */
+	HOTSPOT* order = (HOTSPOT*)malloc(0x10000 * sizeof(HOTSPOT));
+	if (order == NULL) {
+		fclose(file);
+		return 1;
+	}
+	for (uint32_t i = 0; i < 0x10000; ++i) {
+		order[i].pc = i;
+		order[i].cycles = profile->cycles[i];
+	}
+	qsort(order, 0x10000, sizeof(HOTSPOT), compare_hotspots);
+
+	I8080 cpu;
+	memset(&cpu, 0, sizeof(cpu));
+	cpu.read_byte = disasm_read;
+	cpu.write_byte = disasm_write;
+	disasm_map = map;
+
+	char name[PROFILE_SYMBOL_LEN + 8];
+	char mnem[64];
+	fprintf(file, "HOTSPOTS\n  %14s %6s %12s  %-4s  %-20s %s\n", "cycles", "%", "count", "pc", "symbol", "instruction");
+	for (uint32_t i = 0; i < PROFILE_HOTSPOTS && order[i].cycles != 0; ++i) {
+		uint16_t pc = (uint16_t)order[i].pc;
+		symbol_name(profile, pc, name, sizeof(name));
+		cpu.pc = pc;
+		memset(mnem, 0, sizeof(mnem));
+		i8080_mnem(&cpu, mnem);
+		fprintf(file, "  %14llu %6.2f %12llu  %04X  %-20s %s\n",
+			(unsigned long long)profile->cycles[pc], profile->cycles[pc] * percent, (unsigned long long)profile->counts[pc], pc, name, mnem);
+	}
+	disasm_map = NULL;
+	free(order);
+
+	/* functions; a recursive path is only counted at its outermost call */
+	FUNCTION* functions = (FUNCTION*)calloc(profile->node_count, sizeof(FUNCTION));
+	uint64_t* totals = (uint64_t*)calloc(profile->node_count, sizeof(uint64_t));
+	uint32_t function_count = 0;
+	if (functions != NULL && totals != NULL) {
+		/* children always come after their parent, so a reverse walk sums subtrees */
+		for (uint32_t i = profile->node_count; i-- > 0;) {
+			totals[i] += profile->nodes[i].cycles;
+			if (i != PROFILE_ROOT) {
+				totals[profile->nodes[i].parent] += totals[i];
+			}
+		}
+		for (uint32_t i = 1; i < profile->node_count; ++i) {
+			PROFILE_NODE* node = &profile->nodes[i];
+			int recursive = 0;
+			for (uint32_t n = node->parent; n != PROFILE_ROOT; n = profile->nodes[n].parent) {
+				if (profile->nodes[n].address == node->address) {
+					recursive = 1;
+					break;
+				}
+			}
+			uint32_t f = 0;
+			while (f < function_count && functions[f].address != node->address) {
+				++f;
+			}
+			if (f == function_count) {
+				functions[function_count++].address = node->address;
+			}
+			functions[f].calls += node->calls;
+			functions[f].self += node->cycles;
+			if (!recursive) {
+				functions[f].total += totals[i];
+			}
+		}
+		qsort(functions, function_count, sizeof(FUNCTION), compare_functions);
+
+		fprintf(file, "\nFUNCTIONS\n  %14s %6s %14s %6s %12s  %-4s  %s\n", "total", "%", "self", "%", "calls", "addr", "symbol");
+		for (uint32_t i = 0; i < PROFILE_FUNCTIONS && i < function_count; ++i) {
+			symbol_name(profile, functions[i].address, name, sizeof(name));
+			fprintf(file, "  %14llu %6.2f %14llu %6.2f %12llu  %04X  %s\n",
+				(unsigned long long)functions[i].total, functions[i].total * percent,
+				(unsigned long long)functions[i].self, functions[i].self * percent,
+				(unsigned long long)functions[i].calls, functions[i].address, name);
+		}
+		if (profile->lost_calls != 0) {
+			fprintf(file, "  %llu calls deeper than %u were charged to their caller\n", (unsigned long long)profile->lost_calls, PROFILE_STACK_MAX);
+		}
+	}
+	free(functions);
+	free(totals);
+
+	/* ports */
+	fprintf(file, "\nPORTS\n  %-4s %12s %12s\n", "port", "in", "out");
+	for (uint32_t i = 0; i < 256; ++i) {
+		if (profile->port_in[i] != 0 || profile->port_out[i] != 0) {
+			fprintf(file, "  %02X   %12llu %12llu\n", i, (unsigned long long)profile->port_in[i], (unsigned long long)profile->port_out[i]);
+		}
+	}
+	fclose(file);
+
+	size_t len = strlen(filename);
+	char* folded = (char*)malloc(len + sizeof(".folded"));
+	if (folded == NULL) {
+		return 1;
+	}
+	memcpy(folded, filename, len);
+	memcpy(folded + len, ".folded", sizeof(".folded"));
+	int status = write_folded(profile, folded);
+	if (status == 0) {
+		printf("%s\t<- PROFILE\n%s\t<- COLLAPSED STACKS\n", filename, folded);
+	}
+	free(folded);
+	return status;
+}
@@ -0,0 +1,70 @@
+/* profile.h
+ * Guest code profiler - per address counts and cycles, call graph
+ * Github: https:\\github.com\tommojphillips
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+
+#include "i8080.h"
+#include "memmap.h"
+
+#define PROFILE_HOTSPOTS   40     // addresses in the hotspot report
+#define PROFILE_FUNCTIONS  40     // functions in the call report
+#define PROFILE_STACK_MAX  64     // tracked call depth
+#define PROFILE_BUCKETS    0x4000 // call tree hash buckets; power of two
+#define PROFILE_SYMBOL_LEN 32
+
+typedef struct {
+	uint16_t address;
+	char name[PROFILE_SYMBOL_LEN];
+} PROFILE_SYMBOL;
+
+/* one node per distinct call path */
+typedef struct {
+	uint32_t parent;  // parent node; the root is its own parent
+	uint32_t next;    // next node in the hash bucket, or 0
+	uint16_t address; // called address
+	uint64_t calls;   // times this path was entered
+	uint64_t cycles;  // cycles spent in this path, excluding callees
+} PROFILE_NODE;
+
+typedef struct {
+	uint16_t ret;     // expected return address
+	uint32_t node;    // node to return to
+} PROFILE_FRAME;
+
+typedef struct {
+	uint64_t* counts;  // executions per pc (64K), or NULL when profiling is off
+	uint64_t* cycles;  // cycles per pc (64K)
+	uint64_t port_in[256];
+	uint64_t port_out[256];
+
+	PROFILE_NODE* nodes; // call tree; node 0 is the root
+	uint32_t node_count;
+	uint32_t node_capacity;
+	uint32_t* buckets;   // PROFILE_BUCKETS heads into nodes, or 0
+	uint32_t node;       // current node
+	PROFILE_FRAME stack[PROFILE_STACK_MAX];
+	uint32_t depth;
+	uint64_t lost_calls; // calls not tracked because the stack was full
+
+	PROFILE_SYMBOL* symbols; // sorted by address
+	uint32_t symbol_count;
+
+	const char* filename;  // report written here on exit; collapsed stacks go to <filename>.folded
+} PROFILE;
+
+int profile_init(PROFILE* profile);
+void profile_destroy(PROFILE* profile);
+int profile_load_symbols(PROFILE* profile, const char* filename);
+void profile_execute(PROFILE* profile, I8080* cpu, MEMMAP* map);
+int profile_report(PROFILE* profile, MEMMAP* map, const char* filename);
+
+#define profile_enabled(profile) ((profile)->counts != NULL)
+#define profile_in(profile, port)  ((profile)->port_in[port]++)
+#define profile_out(profile, port) ((profile)->port_out[port]++)
+
+#endif
@@ -0,0 +1,319 @@
+/* replay.c
+ * Deterministic record and replay of external input
+ * Github: https:\\github.com\tommojphillips
+ */
+
+ /* Two runs of the same guest only line up if everything from outside the machine arrives at the same
+	machine cycle. When the console is polled depends on the host (frame pacing, when a key was typed), so
+	a recording logs each input at the cycle it was delivered and playback delivers it at that cycle again,
+	polling the log at the end of every frame instead of the console.
+
+	Inputs are the bytes taken from a console into an SIO receive fifo (port A and B) and the disk commands
+	run at the end of a frame (discard, commit). The front panel switches and the disks mounted at the
+	start are in the header. Every REPLAY_CHECK_FRAMES frames the recording stores a checkpoint: a hash of
+	everything the guest transmitted so far and a hash of memory. Playback compares them and reports the
+	first cycle the runs differ, so a change to the emulator can be checked against a reference log.
+
+	REPLAY LOG (little endian)
+
+		header   magic char[4] "A88R", version u16, start cycle u64, memory hash u64,
+		         front panel switches u8, then for each of the 16 disks: mounted u8; if mounted: image hash u64
+
+		records  type u8, cycles since the previous record (LEB128), then
+		         INPUT A, INPUT B   byte u8
+		         COMMAND            length u8, text
+		         CHECK              output hash u64, memory hash u64
+		         END                the recording stopped
+
+	Hashes are FNV-1a. Playback needs the same ROM, RAM size, disks and SIO and disk options as the
+	recording (-frotate and -vfast change when the guest sees things); the engine and -t do not matter.
+	A log that ends without END (the recorder died) plays up to its last record.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "replay.h"
+#include "88_dcdd.h"
+#include "dcdd_hostdir.h"
+#include "snapshot.h"
+#include "sched.h"
+#include "file.h"
+
+#define RECORD_INPUT_A 0
+#define RECORD_INPUT_B 1
+#define RECORD_COMMAND 2
+#define RECORD_CHECK   3
+#define RECORD_END     4
+
+static void put8(REPLAY* replay, uint8_t value) {
+	fputc(value, replay->file);
+}
+static void put16(REPLAY* replay, uint16_t value) {
+	put8(replay, value & 0xFF);
+	put8(replay, value >> 8);
+}
+static void put64(REPLAY* replay, uint64_t value) {
+	for (int i = 0; i < 8; ++i) {
+		put8(replay, (value >> (i * 8)) & 0xFF);
+	}
+}
+static void put_record(REPLAY* replay, uint8_t type) {
+	/* type and the cycles since the last record, 7 bits a byte */
+	uint64_t now = sched_now(replay->sched);
+	uint64_t delta = now - replay->last;
+	replay->last = now;
+	put8(replay, type);
+	while (delta >= 0x80) {
+		put8(replay, (delta & 0x7F) | 0x80);
+		delta >>= 7;
+	}
+	put8(replay, (uint8_t)delta);
+	replay->records++;
+}
+
+static int get8(REPLAY* replay, uint8_t* value) {
+	int c = fgetc(replay->file);
+	if (c == EOF) {
+		return 1;
+	}
+	*value = (uint8_t)c;
+	return 0;
+}
+static int get16(REPLAY* replay, uint16_t* value) {
+	uint8_t lo, hi;
+	if (get8(replay, &lo) || get8(replay, &hi)) {
+		return 1;
+	}
+	*value = lo | (hi << 8);
+	return 0;
+}
+static int get64(REPLAY* replay, uint64_t* value) {
+	*value = 0;
+	for (int i = 0; i < 8; ++i) {
+		uint8_t b;
+		if (get8(replay, &b)) {
+			return 1;
+		}
+		*value |= (uint64_t)b << (i * 8);
+	}
+	return 0;
+}
+static void next_record(REPLAY* replay) {
+	/* read the next record; a short record ends the log at the last complete one */
+	uint8_t type;
+	uint64_t delta = 0;
+	int error = get8(replay, &type);
+	for (int shift = 0; !error; shift += 7) {
+		uint8_t b;
+		if (get8(replay, &b) || shift > 63) {
+			error = 1;
+			break;
+		}
+		delta |= (uint64_t)(b & 0x7F) << shift;
+		if (!(b & 0x80)) {
+			break;
+		}
+	}
+	if (!error) {
+		switch (type) {
+			case RECORD_INPUT_A:
+			case RECORD_INPUT_B:
+				error = get8(replay, &replay->data);
+				break;
+			case RECORD_COMMAND: {
+				uint8_t len;
+				error = get8(replay, &len) || fread(replay->command, 1, len, replay->file) != len;
+				replay->command[error ? 0 : len] = '\0';
+			} break;
+			case RECORD_CHECK:
+				error = get64(replay, &replay->check_output) || get64(replay, &replay->check_memory);
+				break;
+			case RECORD_END:
+				break;
+			default:
+				printf("Error: bad replay record %02X: %s\n", type, replay->filename);
+				error = 1;
+				break;
+		}
+	}
+	if (error) {
+		replay->type = RECORD_END;
+		replay->when = replay->last;
+		return;
+	}
+	replay->type = type;
+	replay->when = replay->last + delta;
+	replay->last = replay->when;
+}
+static int due(REPLAY* replay, uint8_t type) {
+	return replay->type == type && replay->when <= sched_now(replay->sched);
+}
+
+int replay_open(REPLAY* replay, const char* filename, int mode, SCHED* sched) {
+	replay_close(replay);
+	memset(replay, 0, sizeof(REPLAY));
+	fopen_s(&replay->file, filename, mode == REPLAY_RECORD ? "wb" : "rb");
+	if (replay->file == NULL) {
+		printf("Error: could not open file: %s\n", filename);
+		return 1;
+	}
+	replay->mode = mode;
+	replay->filename = filename;
+	replay->sched = sched;
+	replay->output = 0xCBF29CE484222325ULL;
+	return 0;
+}
+void replay_close(REPLAY* replay) {
+	if (replay->file == NULL) {
+		return;
+	}
+	if (replay->mode == REPLAY_RECORD) {
+		printf("%s\t<- REPLAY ( %u records )\n", replay->filename, replay->records);
+		if (replay->started) {
+			put_record(replay, RECORD_END);
+		}
+	}
+	else {
+		printf("%s\t-> REPLAY ( %u records, %u of %u checkpoints match )\n",
+			replay->filename, replay->records, replay->checks - replay->mismatches, replay->checks);
+	}
+	fclose(replay->file);
+	replay->file = NULL;
+	replay->mode = REPLAY_OFF;
+}
+
+int replay_begin(REPLAY* replay, const uint8_t* memory, uint8_t* switches, DCDD* dcdd) {
+	replay->started = 1;
+	replay->last = sched_now(replay->sched);
+	uint64_t memory_hash = snapshot_hash(memory, 0x10000);
+
+	if (replay->mode == REPLAY_RECORD) {
+		fwrite(REPLAY_MAGIC, 1, 4, replay->file);
+		put16(replay, REPLAY_VERSION);
+		put64(replay, replay->last);
+		put64(replay, memory_hash);
+		put8(replay, *switches);
+		for (int i = 0; i < DCDD_MAX_DISKS; ++i) {
+			DISK* disk = &dcdd->disks[i];
+			put8(replay, disk->buffer != NULL);
+			if (disk->buffer != NULL) {
+				dcdd_fill_hostdir(disk);
+				put64(replay, snapshot_hash(disk->buffer, DCDD_DISK_SIZE));
+			}
+		}
+		return 0;
+	}
+
+	char magic[4];
+	uint16_t version;
+	uint64_t start, hash;
+	uint8_t value;
+	if (fread(magic, 1, 4, replay->file) != 4 || memcmp(magic, REPLAY_MAGIC, 4) != 0 ||
+		get16(replay, &version) || version != REPLAY_VERSION) {
+		printf("Error: not a replay log, or an unsupported version: %s\n", replay->filename);
+		return 1;
+	}
+	if (get64(replay, &start) || get64(replay, &hash) || get8(replay, &value)) {
+		printf("Error: replay log is truncated: %s\n", replay->filename);
+		return 1;
+	}
+	if (start != replay->last) {
+		printf("Error: replay starts at cycle %llu; the machine is at %llu\n",
+			(unsigned long long)start, (unsigned long long)replay->last);
+		return 1;
+	}
+	if (hash != memory_hash) {
+		printf("Error: memory differs from the recording; load the same ROM and RAM\n");
+		return 1;
+	}
+	*switches = value;
+	for (int i = 0; i < DCDD_MAX_DISKS; ++i) {
+		DISK* disk = &dcdd->disks[i];
+		uint8_t mounted;
+		hash = 0;
+		if (get8(replay, &mounted) || (mounted && get64(replay, &hash))) {
+			printf("Error: replay log is truncated: %s\n", replay->filename);
+			return 1;
+		}
+		if (disk->buffer != NULL) {
+			dcdd_fill_hostdir(disk);
+		}
+		if (mounted != (disk->buffer != NULL) || (mounted && hash != snapshot_hash(disk->buffer, DCDD_DISK_SIZE))) {
+			printf("Error: disk %c: differs from the recording\n", 'A' + i);
+			return 1;
+		}
+	}
+	next_record(replay);
+	return 0;
+}
+
+int replay_frame(REPLAY* replay, const uint8_t* memory) {
+	if (replay->mode == REPLAY_RECORD) {
+		if (++replay->frames >= REPLAY_CHECK_FRAMES) {
+			replay->frames = 0;
+			put_record(replay, RECORD_CHECK);
+			put64(replay, replay->output);
+			put64(replay, snapshot_hash(memory, 0x10000));
+		}
+		return 0;
+	}
+
+	while (due(replay, RECORD_CHECK)) {
+		uint64_t memory_hash = snapshot_hash(memory, 0x10000);
+		replay->checks++;
+		if (replay->check_output != replay->output || replay->check_memory != memory_hash) {
+			if (replay->mismatches == 0) {
+				printf("Error: replay differs at cycle %llu;%s%s\n", (unsigned long long)replay->when,
+					replay->check_output != replay->output ? " output" : "",
+					replay->check_memory != memory_hash ? " memory" : "");
+			}
+			replay->mismatches++;
+		}
+		next_record(replay);
+	}
+	if (due(replay, RECORD_END)) {
+		return 1;
+	}
+	if (replay->when <= sched_now(replay->sched)) {
+		/* input the guest took at this cycle in the recording was not taken this time */
+		printf("Error: replay diverged at cycle %llu; the guest did not take its input\n", (unsigned long long)replay->when);
+		replay->mismatches++;
+		return 1;
+	}
+	return 0;
+}
+
+void replay_record_input(REPLAY* replay, uint8_t channel, char ch) {
+	put_record(replay, RECORD_INPUT_A + (channel & 1));
+	put8(replay, (uint8_t)ch);
+}
+int replay_input_ready(REPLAY* replay, uint8_t channel) {
+	return due(replay, RECORD_INPUT_A + (channel & 1));
+}
+char replay_getch(REPLAY* replay, uint8_t channel) {
+	char ch = (char)replay->data;
+	replay->records++;
+	next_record(replay);
+	return ch;
+}
+
+void replay_record_command(REPLAY* replay, const char* command) {
+	size_t len = strlen(command);
+	if (len > 0xFF) {
+		len = 0xFF;
+	}
+	put_record(replay, RECORD_COMMAND);
+	put8(replay, (uint8_t)len);
+	fwrite(command, 1, len, replay->file);
+}
+int replay_command(REPLAY* replay, char* command, size_t size) {
+	if (!due(replay, RECORD_COMMAND)) {
+		return 0;
+	}
+	snprintf(command, size, "%s", replay->command);
+	replay->records++;
+	next_record(replay);
+	return 1;
+}
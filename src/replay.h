@@ -0,0 +1,69 @@
+/* replay.h
+ * Deterministic record and replay of external input
+ * Github: https:\\github.com\tommojphillips
+ */
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "88_dcdd.h"
+#include "sched.h"
+
+#define REPLAY_MAGIC        "A88R"
+#define REPLAY_VERSION      1
+#define REPLAY_CHECK_FRAMES 60  // frames between checkpoints while recording
+#define REPLAY_COMMAND      260 // longest disk command
+
+#define REPLAY_OFF          0
+#define REPLAY_RECORD       1
+#define REPLAY_PLAY         2
+
+typedef struct {
+	int mode;              // REPLAY_OFF, REPLAY_RECORD or REPLAY_PLAY
+	FILE* file;            // the log
+	const char* filename;
+	SCHED* sched;          // machine clock
+	int started;           // the header has been written or checked
+	uint64_t last;         // cycle of the last record written or read
+	uint64_t output;       // FNV-1a of every byte the guest has transmitted
+	uint32_t frames;       // record: frames since the last checkpoint
+
+	/* play: the next record */
+	uint8_t type;
+	uint64_t when;
+	uint8_t data;
+	char command[REPLAY_COMMAND];
+	uint64_t check_output;
+	uint64_t check_memory;
+
+	uint32_t records;      // records written or replayed
+	uint32_t checks;       // play: checkpoints compared
+	uint32_t mismatches;   // play: checkpoints that differed
+} REPLAY;
+
+int replay_open(REPLAY* replay, const char* filename, int mode, SCHED* sched);
+void replay_close(REPLAY* replay);
+
+/* first frame; records or checks the machine state the log starts from */
+int replay_begin(REPLAY* replay, const uint8_t* memory, uint8_t* switches, DCDD* dcdd);
+
+/* end of a frame; checkpoints. returns 1 when playback has ended or diverged */
+int replay_frame(REPLAY* replay, const uint8_t* memory);
+
+/* console input on an SIO channel (0 port A, 1 port B) */
+void replay_record_input(REPLAY* replay, uint8_t channel, char ch);
+int replay_input_ready(REPLAY* replay, uint8_t channel);
+char replay_getch(REPLAY* replay, uint8_t channel);
+
+/* disk commands; play: copies the next command that is due into <command> */
+void replay_record_command(REPLAY* replay, const char* command);
+int replay_command(REPLAY* replay, char* command, size_t size);
+
+#define replay_playing(replay)   ((replay) != NULL && (replay)->mode == REPLAY_PLAY)
+#define replay_recording(replay) ((replay) != NULL && (replay)->mode == REPLAY_RECORD)
+#define replay_output(replay, ch) ((replay)->output = ((replay)->output ^ (uint8_t)(ch)) * 0x100000001B3ULL)
+
+#endif
@@ -0,0 +1,138 @@
+/* sched.c
+ * Cycle scheduled device events and interrupt requests
+ * Github: https:\\github.com\tommojphillips
+ */
+
+ /* Devices post events for a machine cycle instead of being polled every instruction. The frame loop
+	runs the cpu up to the next event (sched_limit), runs the events that are due, and carries on
+	to the end of the frame. A guest that is idle, or halted, skips straight to the next event.
+
+	The machine cycle counter is the cycles of past frames (base) plus the cpu's counter for this frame,
+	so it keeps counting across frames and includes cycles skipped while idle.
+
+	Interrupt requests are level triggered lines. A device adds a source with the RST it is answered with
+	(there is no vectored interrupt board; the 2SIO and the disk controller share the INT line, RST 7)
+	and asserts or clears it as its state changes. The cpu takes the request when interrupts are enabled.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "sched.h"
+
+void sched_init(SCHED* sched, const uint32_t* cycles) {
+	memset(sched, 0, sizeof(SCHED));
+	sched->cycles = cycles;
+	sched->next = SCHED_NEVER;
+}
+
+void sched_clear(SCHED* sched) {
+	sched->count = 0;
+	sched->next = SCHED_NEVER;
+	sched->irq = 0;
+}
+
+static void swap(SCHED_EVENT* a, SCHED_EVENT* b) {
+	SCHED_EVENT t = *a;
+	*a = *b;
+	*b = t;
+}
+static void sift_up(SCHED* sched, uint32_t i) {
+	while (i > 0 && sched->events[(i - 1) / 2].when > sched->events[i].when) {
+		swap(&sched->events[(i - 1) / 2], &sched->events[i]);
+		i = (i - 1) / 2;
+	}
+}
+static void sift_down(SCHED* sched, uint32_t i) {
+	for (;;) {
+		uint32_t smallest = i;
+		uint32_t left = i * 2 + 1;
+		uint32_t right = left + 1;
+		if (left < sched->count && sched->events[left].when < sched->events[smallest].when) {
+			smallest = left;
+		}
+		if (right < sched->count && sched->events[right].when < sched->events[smallest].when) {
+			smallest = right;
+		}
+		if (smallest == i) {
+			return;
+		}
+		swap(&sched->events[smallest], &sched->events[i]);
+		i = smallest;
+	}
+}
+static void remove_at(SCHED* sched, uint32_t i) {
+	sched->count--;
+	if (i != sched->count) {
+		sched->events[i] = sched->events[sched->count];
+		sift_down(sched, i);
+		sift_up(sched, i);
+	}
+	sched->next = sched->count != 0 ? sched->events[0].when : SCHED_NEVER;
+}
+
+int sched_post(SCHED* sched, uint64_t when, SCHED_CALLBACK callback, void* context) {
+	if (sched->count == SCHED_EVENTS) {
+		return 1;
+	}
+	uint64_t now = sched_now(sched);
+	SCHED_EVENT* event = &sched->events[sched->count];
+	event->when = when > now ? when : now;
+	event->callback = callback;
+	event->context = context;
+	sift_up(sched, sched->count++);
+	sched->next = sched->events[0].when;
+	return 0;
+}
+void sched_cancel(SCHED* sched, SCHED_CALLBACK callback, void* context) {
+	for (uint32_t i = 0; i < sched->count; ) {
+		if (sched->events[i].callback == callback && sched->events[i].context == context) {
+			remove_at(sched, i);
+		}
+		else {
+			++i;
+		}
+	}
+}
+
+void sched_run(SCHED* sched) {
+	/* an event may post more events, even ones that are already due */
+	while (sched->count != 0 && sched->events[0].when <= sched_now(sched)) {
+		SCHED_EVENT event = sched->events[0];
+		remove_at(sched, 0);
+		event.callback(event.context);
+	}
+}
+void sched_frame(SCHED* sched, uint32_t cycles) {
+	/* the last instruction of a frame can run past an event */
+	sched_run(sched);
+	sched->base += cycles;
+}
+
+int sched_add_source(SCHED* sched, uint8_t rst) {
+	if (sched->sources == SCHED_SOURCES) {
+		return -1;
+	}
+	sched->rst[sched->sources] = rst & 0x07;
+	return (int)sched->sources++;
+}
+void sched_irq(SCHED* sched, int source, int asserted) {
+	if (source < 0) {
+		return;
+	}
+	if (asserted) {
+		sched->irq |= 1u << source;
+	}
+	else {
+		sched->irq &= ~(1u << source);
+	}
+}
+uint8_t sched_vector(SCHED* sched) {
+	uint8_t rst = 7;
+	for (uint32_t i = 0; i < sched->sources; ++i) {
+		if ((sched->irq & (1u << i)) && sched->rst[i] < rst) {
+			rst = sched->rst[i];
+		}
+	}
+	return rst;
+}
@@ -0,0 +1,62 @@
+/* sched.h
+ * Cycle scheduled device events and interrupt requests
+ * Github: https:\\github.com\tommojphillips
+ */
+
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdint.h>
+
+#define SCHED_EVENTS  16         // events pending at once
+#define SCHED_SOURCES 8          // interrupt sources
+#define SCHED_NEVER   UINT64_MAX // no event pending
+
+typedef void (*SCHED_CALLBACK)(void* context);
+
+typedef struct {
+	uint64_t when;           // machine cycle the event is due
+	SCHED_CALLBACK callback;
+	void* context;
+} SCHED_EVENT;
+
+typedef struct {
+	uint64_t base;           // machine cycles before the current frame
+	const uint32_t* cycles;  // cycles into the current frame; the cpu's counter
+	uint64_t next;           // when of the earliest event, or SCHED_NEVER
+	SCHED_EVENT events[SCHED_EVENTS]; // min heap on when
+	uint32_t count;          // events pending
+	uint32_t irq;            // interrupt requests; one bit per source
+	uint32_t sources;        // sources added
+	uint8_t rst[SCHED_SOURCES]; // RST instruction each source is answered with
+} SCHED;
+
+void sched_init(SCHED* sched, const uint32_t* cycles);
+
+/* drop every event and request; sources and the clock are kept */
+void sched_clear(SCHED* sched);
+
+/* the machine cycle counter */
+#define sched_now(sched) ((sched)->base + *(sched)->cycles)
+
+/* cycle in a frame of <frame> cycles the next event is due at, or <frame> */
+#define sched_limit(sched, frame) ((sched)->next - (sched)->base < (frame) ? (uint32_t)((sched)->next - (sched)->base) : (frame))
+
+/* post an event for machine cycle <when>; returns 1 if the queue is full */
+int sched_post(SCHED* sched, uint64_t when, SCHED_CALLBACK callback, void* context);
+void sched_cancel(SCHED* sched, SCHED_CALLBACK callback, void* context);
+
+/* run every event that is due */
+void sched_run(SCHED* sched);
+
+/* the frame of <cycles> cycles has ended */
+void sched_frame(SCHED* sched, uint32_t cycles);
+
+/* interrupt sources; returns the source number, or -1 if there are too many */
+int sched_add_source(SCHED* sched, uint8_t rst);
+void sched_irq(SCHED* sched, int source, int asserted);
+
+/* RST of the highest priority request (the lowest RST) */
+uint8_t sched_vector(SCHED* sched);
+
+#endif
@@ -0,0 +1,483 @@
+/* screen.c
+ * Terminal emulation for SIO port A - screen buffer and dirty cell rendering
+ * Github: https:\\github.com\tommojphillips
+ */
+
+ /* Full screen CP/M programs redraw through the terminal's escape sequences, often the same cells many
+	times a second. Passed straight through, that output can cost the host terminal more than the guest
+	took to produce it, and in turbo it is the bottleneck. With -aterm the port A output is parsed into an
+	80x24 cell buffer instead, and once per device poll only the cells that differ from what the host
+	terminal shows are drawn, as ANSI sequences, in a single console write.
+
+	The host terminal needs to understand ANSI (xterm, any VT100 compatible). The screen uses its top 24
+	rows; a scroll region is set over them so lines scrolled by the guest are scrolled on the host too
+	instead of redrawn. Capture files (-c) still get the guest's own bytes.
+
+	ADM-3A (default)
+		^H left, ^J down, ^K up, ^L right, ^M return, ^I tab, ^G bell, ^Z clear, ^^ home
+		ESC = <row+20h> <col+20h>  cursor address
+		TeleVideo 910/920: ESC T/t clear to end of line, ESC Y/y clear to end of screen, ESC * + : ; clear,
+		ESC E insert line, ESC R delete line, ESC Q insert char, ESC W delete char, ESC j reverse line feed,
+		ESC ) dim, ESC ( normal, ESC G <4 reverse, anything else normal>
+
+	VT52
+		^H left, ^J ^K ^L line feed, ^M return, ^I tab, ^G bell
+		ESC A up, ESC B down, ESC C right, ESC D left, ESC H home, ESC I reverse line feed,
+		ESC J clear to end of screen, ESC K clear to end of line, ESC Y <row+20h> <col+20h> cursor address
+		Heath H19: ESC E clear, ESC L insert line, ESC M delete line, ESC N delete char, ESC p reverse, ESC q normal
+
+	Other sequences are consumed and ignored.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "screen.h"
+#include "console.h"
+
+#define ESCAPE_NONE 0
+#define ESCAPE_START 1
+#define ESCAPE_ROW  2 // cursor address; row next
+#define ESCAPE_COL  3 // cursor address; column next
+#define ESCAPE_ATTR 4 // TeleVideo ESC G; attribute next
+#define ESCAPE_SKIP 5 // one parameter byte to ignore
+
+#define ALL_ROWS ((1u << SCREEN_ROWS) - 1)
+
+static void blank_row(SCREEN* screen, int row) {
+	memset(screen->cells[row], ' ', SCREEN_COLS);
+	memset(screen->attrs[row], 0, SCREEN_COLS);
+}
+static void clear_screen(SCREEN* screen) {
+	for (int i = 0; i < SCREEN_ROWS; ++i) {
+		blank_row(screen, i);
+	}
+	screen->row = 0;
+	screen->col = 0;
+	screen->cleared = 1;
+	screen->scrolled = 0;
+	screen->dirty = ALL_ROWS;
+}
+static void clear_line(SCREEN* screen) {
+	memset(screen->cells[screen->row] + screen->col, ' ', SCREEN_COLS - screen->col);
+	memset(screen->attrs[screen->row] + screen->col, 0, SCREEN_COLS - screen->col);
+	screen->dirty |= 1u << screen->row;
+}
+static void clear_end(SCREEN* screen) {
+	clear_line(screen);
+	for (int i = screen->row + 1; i < SCREEN_ROWS; ++i) {
+		blank_row(screen, i);
+		screen->dirty |= 1u << i;
+	}
+}
+static void insert_line(SCREEN* screen, int row) {
+	memmove(screen->cells[row + 1], screen->cells[row], (SCREEN_ROWS - 1 - row) * SCREEN_COLS);
+	memmove(screen->attrs[row + 1], screen->attrs[row], (SCREEN_ROWS - 1 - row) * SCREEN_COLS);
+	blank_row(screen, row);
+	screen->dirty |= ALL_ROWS & ~((1u << row) - 1);
+}
+static void delete_line(SCREEN* screen, int row) {
+	memmove(screen->cells[row], screen->cells[row + 1], (SCREEN_ROWS - 1 - row) * SCREEN_COLS);
+	memmove(screen->attrs[row], screen->attrs[row + 1], (SCREEN_ROWS - 1 - row) * SCREEN_COLS);
+	blank_row(screen, SCREEN_ROWS - 1);
+	screen->dirty |= ALL_ROWS & ~((1u << row) - 1);
+}
+static void insert_char(SCREEN* screen) {
+	uint8_t* cells = screen->cells[screen->row];
+	uint8_t* attrs = screen->attrs[screen->row];
+	memmove(cells + screen->col + 1, cells + screen->col, SCREEN_COLS - 1 - screen->col);
+	memmove(attrs + screen->col + 1, attrs + screen->col, SCREEN_COLS - 1 - screen->col);
+	cells[screen->col] = ' ';
+	attrs[screen->col] = 0;
+	screen->dirty |= 1u << screen->row;
+}
+static void delete_char(SCREEN* screen) {
+	uint8_t* cells = screen->cells[screen->row];
+	uint8_t* attrs = screen->attrs[screen->row];
+	memmove(cells + screen->col, cells + screen->col + 1, SCREEN_COLS - 1 - screen->col);
+	memmove(attrs + screen->col, attrs + screen->col + 1, SCREEN_COLS - 1 - screen->col);
+	cells[SCREEN_COLS - 1] = ' ';
+	attrs[SCREEN_COLS - 1] = 0;
+	screen->dirty |= 1u << screen->row;
+}
+
+static void line_feed(SCREEN* screen) {
+	if (screen->row < SCREEN_ROWS - 1) {
+		screen->row++;
+		return;
+	}
+	/* the host scrolls too; only the new bottom line is drawn */
+	delete_line(screen, 0);
+	screen->scrolled++;
+}
+static void reverse_line_feed(SCREEN* screen) {
+	if (screen->row > 0) {
+		screen->row--;
+		return;
+	}
+	insert_line(screen, 0);
+}
+static void put_char(SCREEN* screen, char ch) {
+	screen->cells[screen->row][screen->col] = (uint8_t)ch;
+	screen->attrs[screen->row][screen->col] = screen->attr;
+	screen->dirty |= 1u << screen->row;
+	if (screen->col < SCREEN_COLS - 1) {
+		screen->col++;
+	}
+	else if (screen->type == SCREEN_ADM3A) {
+		/* the ADM-3A wraps; the VT52 stays in the last column */
+		screen->col = 0;
+		line_feed(screen);
+	}
+}
+
+static void control(SCREEN* screen, char ch) {
+	switch (ch) {
+		case 0x07:
+			screen->bells++;
+			break;
+		case 0x08:
+			if (screen->col > 0) {
+				screen->col--;
+			}
+			break;
+		case 0x09:
+			screen->col = (screen->col | 7) + 1;
+			if (screen->col >= SCREEN_COLS) {
+				screen->col = SCREEN_COLS - 1;
+			}
+			break;
+		case 0x0A:
+			line_feed(screen);
+			break;
+		case 0x0B:
+			if (screen->type == SCREEN_VT52) {
+				line_feed(screen);
+			}
+			else if (screen->row > 0) {
+				screen->row--;
+			}
+			break;
+		case 0x0C:
+			if (screen->type == SCREEN_VT52) {
+				line_feed(screen);
+			}
+			else if (screen->col < SCREEN_COLS - 1) {
+				screen->col++;
+			}
+			break;
+		case 0x0D:
+			screen->col = 0;
+			break;
+		case 0x1A:
+			if (screen->type == SCREEN_ADM3A) {
+				clear_screen(screen);
+			}
+			break;
+		case 0x1B:
+			screen->escape = ESCAPE_START;
+			break;
+		case 0x1E:
+			if (screen->type == SCREEN_ADM3A) {
+				screen->row = 0;
+				screen->col = 0;
+			}
+			break;
+	}
+}
+
+static void escape_adm3a(SCREEN* screen, char ch) {
+	switch (ch) {
+		case '=':
+			screen->escape = ESCAPE_ROW;
+			return;
+		case 'G':
+			screen->escape = ESCAPE_ATTR;
+			return;
+		case 'T':
+		case 't':
+			clear_line(screen);
+			break;
+		case 'Y':
+		case 'y':
+			clear_end(screen);
+			break;
+		case '*':
+		case '+':
+		case ':':
+		case ';':
+			clear_screen(screen);
+			break;
+		case 'E':
+			insert_line(screen, screen->row);
+			break;
+		case 'R':
+			delete_line(screen, screen->row);
+			break;
+		case 'Q':
+			insert_char(screen);
+			break;
+		case 'W':
+			delete_char(screen);
+			break;
+		case 'j':
+			reverse_line_feed(screen);
+			break;
+		case ')':
+			screen->attr |= SCREEN_ATTR_DIM;
+			break;
+		case '(':
+			screen->attr &= ~SCREEN_ATTR_DIM;
+			break;
+	}
+	screen->escape = ESCAPE_NONE;
+}
+static void escape_vt52(SCREEN* screen, char ch) {
+	switch (ch) {
+		case 'Y':
+			screen->escape = ESCAPE_ROW;
+			return;
+		case 'x':
+		case 'y':
+			/* H19 set/reset mode */
+			screen->escape = ESCAPE_SKIP;
+			return;
+		case 'A':
+			if (screen->row > 0) {
+				screen->row--;
+			}
+			break;
+		case 'B':
+			if (screen->row < SCREEN_ROWS - 1) {
+				screen->row++;
+			}
+			break;
+		case 'C':
+			if (screen->col < SCREEN_COLS - 1) {
+				screen->col++;
+			}
+			break;
+		case 'D':
+			if (screen->col > 0) {
+				screen->col--;
+			}
+			break;
+		case 'H':
+			screen->row = 0;
+			screen->col = 0;
+			break;
+		case 'I':
+			reverse_line_feed(screen);
+			break;
+		case 'J':
+			clear_end(screen);
+			break;
+		case 'K':
+			clear_line(screen);
+			break;
+		case 'E':
+			clear_screen(screen);
+			break;
+		case 'L':
+			insert_line(screen, screen->row);
+			break;
+		case 'M':
+			delete_line(screen, screen->row);
+			break;
+		case 'N':
+			delete_char(screen);
+			break;
+		case 'p':
+			screen->attr |= SCREEN_ATTR_REVERSE;
+			break;
+		case 'q':
+			screen->attr &= ~SCREEN_ATTR_REVERSE;
+			break;
+	}
+	screen->escape = ESCAPE_NONE;
+}
+
+static uint8_t address(char ch, int limit) {
+	int value = (uint8_t)ch - 0x20;
+	if (value < 0) {
+		return 0;
+	}
+	return (uint8_t)(value >= limit ? limit - 1 : value);
+}
+
+void screen_init(SCREEN* screen, int type) {
+	memset(screen, 0, sizeof(SCREEN));
+	screen->enabled = 1;
+	screen->type = type;
+	clear_screen(screen);
+	memset(screen->shown, ' ', sizeof(screen->shown));
+	screen->host_row = -1;
+	screen->host_col = -1;
+}
+
+void screen_write(SCREEN* screen, const char* data, size_t len) {
+	for (size_t i = 0; i < len; ++i) {
+		char ch = data[i] & 0x7F;
+		switch (screen->escape) {
+			case ESCAPE_START:
+				if (screen->type == SCREEN_VT52) {
+					escape_vt52(screen, ch);
+				}
+				else {
+					escape_adm3a(screen, ch);
+				}
+				break;
+			case ESCAPE_ROW:
+				screen->param = address(ch, SCREEN_ROWS);
+				screen->escape = ESCAPE_COL;
+				break;
+			case ESCAPE_COL:
+				screen->row = screen->param;
+				screen->col = address(ch, SCREEN_COLS);
+				screen->escape = ESCAPE_NONE;
+				break;
+			case ESCAPE_ATTR:
+				screen->attr = ch == '4' ? SCREEN_ATTR_REVERSE : 0;
+				screen->escape = ESCAPE_NONE;
+				break;
+			case ESCAPE_SKIP:
+				screen->escape = ESCAPE_NONE;
+				break;
+			default:
+				if (ch >= 0x20 && ch < 0x7F) {
+					put_char(screen, ch);
+				}
+				else {
+					control(screen, ch);
+				}
+				break;
+		}
+	}
+}
+
+static void emit(SCREEN* screen, CONSOLE* console, const char* data, size_t len) {
+	if (screen->out_len + len > SCREEN_OUTPUT) {
+		console_display(console, screen->out, screen->out_len);
+		screen->out_len = 0;
+	}
+	memcpy(screen->out + screen->out_len, data, len);
+	screen->out_len += len;
+}
+static void emit_move(SCREEN* screen, CONSOLE* console, int row, int col) {
+	char seq[16];
+	int n = snprintf(seq, sizeof(seq), "\x1B[%d;%dH", row + 1, col + 1);
+	emit(screen, console, seq, n);
+	screen->host_row = row;
+	screen->host_col = col;
+}
+static void emit_attr(SCREEN* screen, CONSOLE* console, uint8_t attr) {
+	if (attr == screen->host_attr) {
+		return;
+	}
+	char seq[16];
+	int n = snprintf(seq, sizeof(seq), "\x1B[0%s%sm",
+		(attr & SCREEN_ATTR_REVERSE) ? ";7" : "", (attr & SCREEN_ATTR_DIM) ? ";2" : "");
+	emit(screen, console, seq, n);
+	screen->host_attr = attr;
+}
+static void emit_cell(SCREEN* screen, CONSOLE* console, int row, int col) {
+	emit_attr(screen, console, screen->attrs[row][col]);
+	emit(screen, console, (const char*)&screen->cells[row][col], 1);
+	screen->shown[row][col] = screen->cells[row][col];
+	screen->shown_attrs[row][col] = screen->attrs[row][col];
+	screen->host_col = col + 1;
+	if (screen->host_col == SCREEN_COLS) {
+		/* the host may or may not have wrapped */
+		screen->host_row = -1;
+	}
+}
+static void blank_shown(SCREEN* screen, int row, int count) {
+	memset(screen->shown[row], ' ', count * SCREEN_COLS);
+	memset(screen->shown_attrs[row], 0, count * SCREEN_COLS);
+}
+
+void screen_render(SCREEN* screen, CONSOLE* console) {
+	if (!screen->started) {
+		/* scroll region over the screen, then a clean slate */
+		char start[32];
+		int n = snprintf(start, sizeof(start), "\x1B[0m\x1B[1;%dr\x1B[H\x1B[2J", SCREEN_ROWS);
+		emit(screen, console, start, n);
+		blank_shown(screen, 0, SCREEN_ROWS);
+		screen->host_attr = 0;
+		screen->host_row = 0;
+		screen->host_col = 0;
+		screen->started = 1;
+	}
+	else if (screen->cleared || screen->scrolled >= SCREEN_ROWS) {
+		emit_attr(screen, console, 0);
+		emit(screen, console, "\x1B[H\x1B[2J", 7);
+		blank_shown(screen, 0, SCREEN_ROWS);
+		screen->host_row = 0;
+		screen->host_col = 0;
+	}
+	else if (screen->scrolled != 0) {
+		/* scroll the host the same way; what was shown moves up with it */
+		emit_attr(screen, console, 0);
+		emit_move(screen, console, SCREEN_ROWS - 1, 0);
+		for (uint32_t i = 0; i < screen->scrolled; ++i) {
+			emit(screen, console, "\n", 1);
+		}
+		memmove(screen->shown[0], screen->shown[screen->scrolled], (SCREEN_ROWS - screen->scrolled) * SCREEN_COLS);
+		memmove(screen->shown_attrs[0], screen->shown_attrs[screen->scrolled], (SCREEN_ROWS - screen->scrolled) * SCREEN_COLS);
+		blank_shown(screen, SCREEN_ROWS - screen->scrolled, screen->scrolled);
+		screen->host_row = -1;
+	}
+	screen->cleared = 0;
+	screen->scrolled = 0;
+
+	for (int row = 0; screen->dirty != 0 && row < SCREEN_ROWS; ++row) {
+		if ((screen->dirty & (1u << row)) == 0) {
+			continue;
+		}
+		screen->dirty &= ~(1u << row);
+		for (int col = 0; col < SCREEN_COLS; ++col) {
+			if (screen->shown[row][col] == screen->cells[row][col] && screen->shown_attrs[row][col] == screen->attrs[row][col]) {
+				continue;
+			}
+			if (screen->host_row >= 0 && screen->host_row + 1 == row && col <= SCREEN_MOVE_GAP) {
+				/* the next line down, as a guest printing lines does; never from the bottom line, so it can't scroll */
+				emit(screen, console, "\r\n", 2);
+				screen->host_row = row;
+				screen->host_col = 0;
+			}
+			if (screen->host_row == row && screen->host_col <= col && col - screen->host_col <= SCREEN_MOVE_GAP) {
+				/* cheaper to write the few unchanged cells in between than to move */
+				while (screen->host_col < col) {
+					emit_cell(screen, console, row, screen->host_col);
+				}
+			}
+			else {
+				emit_move(screen, console, row, col);
+			}
+			emit_cell(screen, console, row, col);
+		}
+	}
+
+	if (screen->host_row != screen->row || screen->host_col != screen->col) {
+		emit_move(screen, console, screen->row, screen->col);
+	}
+	if (screen->bells != 0) {
+		emit(screen, console, "\a", 1);
+		screen->bells = 0;
+	}
+	if (screen->out_len != 0) {
+		console_display(console, screen->out, screen->out_len);
+		screen->out_len = 0;
+	}
+}
+
+void screen_end(SCREEN* screen, CONSOLE* console) {
+	if (!screen->started) {
+		return;
+	}
+	char end[32];
+	int n = snprintf(end, sizeof(end), "\x1B[0m\x1B[r\x1B[%d;1H\r\n", SCREEN_ROWS);
+	console_display(console, end, n);
+	screen->started = 0;
+}
@@ -0,0 +1,58 @@
+/* screen.h
+ * Terminal emulation for SIO port A - screen buffer and dirty cell rendering
+ * Github: https:\\github.com\tommojphillips
+ */
+
+#ifndef SCREEN_H
+#define SCREEN_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "console.h"
+
+#define SCREEN_COLS       80
+#define SCREEN_ROWS       24
+#define SCREEN_OUTPUT     0x4000 // rendered ANSI output; written to the console in one piece when it fits
+#define SCREEN_MOVE_GAP   4      // unchanged cells rewritten rather than moving the cursor over them
+
+#define SCREEN_ADM3A      0 // Lear Siegler ADM-3A plus the common TeleVideo 910/920 extensions
+#define SCREEN_VT52       1 // DEC VT52 plus the Heath H19 extensions
+
+#define SCREEN_ATTR_REVERSE 0x01
+#define SCREEN_ATTR_DIM     0x02
+
+typedef struct {
+	int enabled;           // port A output goes through the screen
+	int type;              // SCREEN_ADM3A or SCREEN_VT52
+	uint8_t cells[SCREEN_ROWS][SCREEN_COLS]; // what the guest drew
+	uint8_t attrs[SCREEN_ROWS][SCREEN_COLS];
+	uint8_t shown[SCREEN_ROWS][SCREEN_COLS]; // what the host terminal shows
+	uint8_t shown_attrs[SCREEN_ROWS][SCREEN_COLS];
+	uint32_t dirty;        // rows written since the last render; 1 bit per row
+	uint8_t row;           // guest cursor
+	uint8_t col;
+	uint8_t attr;          // attribute for the next character
+	uint8_t escape;        // escape sequence state
+	uint8_t param;         // first parameter of a cursor address sequence
+	int cleared;           // the guest cleared the screen since the last render
+	uint32_t scrolled;     // lines the screen scrolled up since the last render
+	uint32_t bells;
+	int host_row;          // host cursor, or -1 when unknown
+	int host_col;
+	uint8_t host_attr;
+	int started;           // the host screen has been cleared and the scroll region set
+	char out[SCREEN_OUTPUT];
+	size_t out_len;
+} SCREEN;
+
+void screen_init(SCREEN* screen, int type);
+void screen_write(SCREEN* screen, const char* data, size_t len);
+
+/* draw the cells that changed since the last render on <console> in one write */
+void screen_render(SCREEN* screen, CONSOLE* console);
+
+/* leave the host terminal usable: reset the scroll region and attributes, cursor below the screen */
+void screen_end(SCREEN* screen, CONSOLE* console);
+
+#endif
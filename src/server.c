@@ -0,0 +1,348 @@
+/* server.c
+ * Fork server - clone a booted machine per job
+ * Github: https:\\github.com\tommojphillips
+ */
+
+ /* The server boots a machine once, then listens on a unix socket. Every connection is a job;
+	the server forks and the child continues from the booted state with copy-on-write
+	memory, disk images and translated code, so a job costs a fork instead of a boot.
+
+	REQUEST
+	Text lines, ending with run.
+
+		script <bytes>           followed by <bytes> of console script (see console_script.c)
+		disk <drive> <file>      mount <file> in <drive> (A-P) for this job
+		export <drive> <file>    write the image in <drive> to <file> when the job ends;
+		                         if <file> is a directory, write the CP/M files on the disk into it
+		delta <drive> <file>     write the delta of the overlay disk in <drive> to <file> when the job ends
+		limit <seconds>          wall-clock limit for this job; at most the server's limit, and 0 (none) is
+		                         rejected unless the server has no limit either
+		run                      start the job
+
+	Every disk is detached from its file in the child, so writes stay private to the job;
+	a host directory disk (see dcdd_hostdir.c) is not written back either.
+	Use export, or delta for an overlay disk (<base>,<delta>; see dcdd_overlay.c), to keep them.
+
+	RESPONSE
+	Frames until the job ends, then the connection is closed.
+
+		+------+------------+----------------+
+		| TYPE | LENGTH (4) | PAYLOAD        |
+		+------+------------+----------------+
+
+		O  guest SIO output
+		S  {"status":"ok","exit":0,"instructions":0,"cycles":0,"wall_s":0.000}
+
+	status is "ok" when the script ran to the end, "timeout" when the limit was hit,
+	"disconnected" when the client went away and "error" when the request was rejected.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "server.h"
+#include "altair8800.h"
+#include "console.h"
+#include "dcdd_overlay.h"
+#include "timing.h"
+
+#ifdef _WIN32
+
+int server_run(ALTAIR8800* machine, const char* path, uint64_t time_limit) {
+	printf("Error: the fork server needs fork() and unix sockets\n");
+	return 1;
+}
+
+#else
+
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+typedef struct {
+	char* script;
+	size_t script_len;
+	char* exports[DCDD_MAX_DISKS];
+	char* deltas[DCDD_MAX_DISKS];
+	uint64_t time_limit;
+	uint64_t max_time_limit; // the server's limit; a job can only lower it (0 = none)
+} JOB;
+
+static int write_all(int fd, const void* data, size_t len) {
+	const uint8_t* p = (const uint8_t*)data;
+	while (len > 0) {
+		ssize_t n = write(fd, p, len);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return 1;
+		}
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static int send_frame(int fd, char type, const void* data, uint32_t len) {
+	uint8_t header[5];
+	header[0] = (uint8_t)type;
+	header[1] = len & 0xFF;
+	header[2] = (len >> 8) & 0xFF;
+	header[3] = (len >> 16) & 0xFF;
+	header[4] = (len >> 24) & 0xFF;
+	if (write_all(fd, header, sizeof(header)) != 0) {
+		return 1;
+	}
+	return write_all(fd, data, len);
+}
+
+static int send_output(int fd, FILE* capture, char** buffer, size_t* size) {
+	/* drain the capture stream and rewind it so it never grows past one frame's worth; <size> only changes on a flush */
+	fflush(capture);
+	if (*size == 0) {
+		return 0;
+	}
+	size_t pos = 0;
+	while (pos < *size) {
+		uint32_t len = (uint32_t)(*size - pos);
+		if (len > SERVER_OUTPUT_CHUNK) {
+			len = SERVER_OUTPUT_CHUNK;
+		}
+		if (send_frame(fd, SERVER_FRAME_OUTPUT, *buffer + pos, len) != 0) {
+			return 1;
+		}
+		pos += len;
+	}
+	rewind(capture);
+	return 0;
+}
+
+static int parse_drive(const char* arg, uint8_t* drive, const char** filename) {
+	char letter = arg[0] & ~0x20;
+	if (letter < 'A' || letter >= 'A' + DCDD_MAX_DISKS || arg[1] != ' ' || arg[2] == '\0') {
+		return 1;
+	}
+	*drive = letter - 'A';
+	*filename = arg + 2;
+	return 0;
+}
+
+static int read_request(ALTAIR8800* machine, FILE* in, JOB* job) {
+	char line[SERVER_LINE];
+	while (fgets(line, sizeof(line), in) != NULL) {
+		line[strcspn(line, "\r\n")] = '\0';
+
+		if (strncmp(line, "script ", 7) == 0) {
+			size_t len = strtoul(line + 7, NULL, 10);
+			if (len == 0 || len > SERVER_SCRIPT_MAX || job->script != NULL) {
+				return 1;
+			}
+			job->script = (char*)malloc(len + 1);
+			if (job->script == NULL || fread(job->script, 1, len, in) != len) {
+				return 1;
+			}
+			job->script[len] = '\0';
+			job->script_len = len;
+			continue;
+		}
+
+		if (strncmp(line, "disk ", 5) == 0) {
+			uint8_t drive;
+			const char* filename;
+			if (parse_drive(line + 5, &drive, &filename) != 0 || dcdd_load_disk(&machine->dcdd, drive, filename) != 0) {
+				return 1;
+			}
+			dcdd_detach_disk(&machine->dcdd, drive);
+			continue;
+		}
+
+		if (strncmp(line, "export ", 7) == 0) {
+			uint8_t drive;
+			const char* filename;
+			if (parse_drive(line + 7, &drive, &filename) != 0) {
+				return 1;
+			}
+			free(job->exports[drive]);
+			job->exports[drive] = strdup(filename);
+			continue;
+		}
+
+		if (strncmp(line, "delta ", 6) == 0) {
+			uint8_t drive;
+			const char* filename;
+			if (parse_drive(line + 6, &drive, &filename) != 0) {
+				return 1;
+			}
+			free(job->deltas[drive]);
+			job->deltas[drive] = strdup(filename);
+			continue;
+		}
+
+		if (strncmp(line, "limit ", 6) == 0) {
+			uint64_t limit = strtoull(line + 6, NULL, 10) * 1000000ULL;
+			if (job->max_time_limit != 0) {
+				if (limit == 0) {
+					return 1; // no limit is not allowed
+				}
+				if (limit > job->max_time_limit) {
+					limit = job->max_time_limit;
+				}
+			}
+			job->time_limit = limit;
+			continue;
+		}
+
+		if (strcmp(line, "run") == 0) {
+			return job->script == NULL;
+		}
+
+		return 1;
+	}
+	return 1;
+}
+
+static void server_job(ALTAIR8800* machine, int fd, uint64_t time_limit) {
+	/* runs in the child; never returns */
+	char status_line[SERVER_LINE];
+	const char* status = "error";
+	uint64_t instructions = machine->instructions;
+	uint64_t cycles = machine->timing.total_cycles - machine->idle.skipped;
+	uint64_t elapsed = 0;
+	int exit_code = 1;
+
+	signal(SIGPIPE, SIG_IGN);
+
+	/* the image files belong to the server; this job only sees its own copy */
+	for (uint8_t i = 0; i < DCDD_MAX_DISKS; ++i) {
+		dcdd_detach_disk(&machine->dcdd, i);
+	}
+
+	JOB job = { 0 };
+	job.time_limit = time_limit;
+	job.max_time_limit = time_limit;
+	FILE* in = fdopen(dup(fd), "rb");
+	if (in == NULL || read_request(machine, in, &job) != 0) {
+		goto done;
+	}
+
+	FILE* script = fmemopen(job.script, job.script_len, "rb");
+	if (script == NULL) {
+		goto done;
+	}
+	console_destroy(&machine->console);
+	if (console_init_script_file(&machine->console, script, 0) != 0) {
+		fclose(script);
+		goto done;
+	}
+
+	char* output = NULL;
+	size_t output_size = 0;
+	machine->console.capture = open_memstream(&output, &output_size);
+	if (machine->console.capture == NULL) {
+		goto done;
+	}
+
+	status = "ok";
+	exit_code = 0;
+	machine->running = 1;
+	uint64_t start = timing_now();
+	while (machine->running) {
+		altair8800_step(machine);
+		if (send_output(fd, machine->console.capture, &output, &output_size) != 0) {
+			status = "disconnected";
+			exit_code = 1;
+			break;
+		}
+		elapsed = timing_now() - start;
+		if (job.time_limit != 0 && elapsed >= job.time_limit) {
+			status = "timeout";
+			exit_code = 1;
+			break;
+		}
+	}
+	send_output(fd, machine->console.capture, &output, &output_size);
+
+	for (uint8_t i = 0; i < DCDD_MAX_DISKS; ++i) {
+		if (job.exports[i] != NULL && dcdd_export_disk(&machine->dcdd, i, job.exports[i]) != 0) {
+			status = "error";
+			exit_code = 1;
+		}
+		if (job.deltas[i] != NULL && dcdd_export_overlay(&machine->dcdd, i, job.deltas[i]) != 0) {
+			status = "error";
+			exit_code = 1;
+		}
+	}
+
+done:
+	instructions = machine->instructions - instructions;
+	cycles = machine->timing.total_cycles - machine->idle.skipped - cycles;
+	int len = snprintf(status_line, sizeof(status_line), "{\"status\":\"%s\",\"exit\":%d,\"instructions\":%llu,\"cycles\":%llu,\"wall_s\":%.3f}\n",
+		status, exit_code, (unsigned long long)instructions, (unsigned long long)cycles, elapsed / 1000000.0);
+	send_frame(fd, SERVER_FRAME_STATUS, status_line, (uint32_t)len);
+	close(fd);
+	_exit(exit_code);
+}
+
+int server_run(ALTAIR8800* machine, const char* path, uint64_t time_limit) {
+	struct sockaddr_un addr = { 0 };
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		printf("Error: socket path is too long: %s\n", path);
+		return 1;
+	}
+	strcpy(addr.sun_path, path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		printf("Error: could not create socket\n");
+		return 1;
+	}
+	unlink(path);
+	if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 64) != 0) {
+		printf("Error: could not listen on %s\n", path);
+		close(fd);
+		return 1;
+	}
+
+	/* the children inherit everything below; leave nothing buffered or dirty */
+	for (uint8_t i = 0; i < DCDD_MAX_DISKS; ++i) {
+		dcdd_flush_disk(&machine->dcdd, i);
+	}
+	console_destroy(&machine->console);
+	console_init_null(&machine->console);
+	fflush(stdout);
+
+	/* children are reaped by the kernel */
+	signal(SIGCHLD, SIG_IGN);
+	printf("%s\t<- JOBS\n", path);
+	fflush(stdout);
+
+	for (;;) {
+		int client = accept(fd, NULL, NULL);
+		if (client < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			printf("Error: accept failed\n");
+			close(fd);
+			return 1;
+		}
+
+		pid_t pid = fork();
+		if (pid == 0) {
+			close(fd);
+			server_job(machine, client, time_limit);
+		}
+		if (pid < 0) {
+			printf("Error: fork failed\n");
+		}
+		close(client);
+	}
+}
+
+#endif
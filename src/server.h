@@ -0,0 +1,25 @@
+/* server.h
+ * Fork server - clone a booted machine per job
+ * Github: https:\\github.com\tommojphillips
+ */
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdint.h>
+
+#include "altair8800.h"
+
+#define SERVER_LINE         1024
+#define SERVER_SCRIPT_MAX   0x100000 // largest job script in bytes
+#define SERVER_OUTPUT_CHUNK 0x1000   // largest output frame payload
+
+#define SERVER_FRAME_OUTPUT 'O'      // guest SIO output
+#define SERVER_FRAME_STATUS 'S'      // JSON status line; the last frame of a job
+
+/* Listen on the unix socket <path> and fork <machine> for every job.
+ * time_limit is the per job wall-clock limit in microseconds (0 = none); a job can ask for less, not more.
+ * returns 1 if the server could not be started; otherwise it does not return */
+int server_run(ALTAIR8800* machine, const char* path, uint64_t time_limit);
+
+#endif
@@ -0,0 +1,84 @@
+/* server_main.c
+ * Boot once, then fork a copy of the machine per job
+ * Github: https:\\github.com\tommojphillips
+ */
+
+ /* Runs the machine in turbo with the boot script until the script ends; that is the ready point.
+	Then listens on a unix socket and forks the booted machine for every job (see server.c).
+
+	Usage: altair-server -u<socket> -i<boot script> [altair options]
+		-u<socket>   unix socket to listen on
+		-i<script>   boot script; the server is ready when it ends
+		-l<seconds>  wall-clock time limit per job; jobs may only lower it (default 300, 0 = none)
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "altair8800.h"
+#include "args.h"
+#include "console.h"
+#include "timing.h"
+#include "server.h"
+
+#define SERVER_TIME_LIMIT 300 // seconds
+
+static const char* socket_path = NULL;
+static uint64_t time_limit = SERVER_TIME_LIMIT * 1000000ULL;
+
+static int server_args(ALTAIR8800* altair, const char* arg) {
+	if (strncmp("-u", arg, 2) == 0) {
+		socket_path = arg + 2;
+		return 1;
+	}
+
+	if (strncmp("-l", arg, 2) == 0) {
+		time_limit = strtoull(arg + 2, NULL, 10) * 1000000ULL;
+		return 1;
+	}
+
+	if (strncmp("-i", arg, 2) == 0) {
+		FILE* capture = altair->console.capture;
+		altair->console.capture = NULL;
+		console_destroy(&altair->console);
+		if (console_init_script(&altair->console, arg + 2, 0) != 0) {
+			console_init_null(&altair->console);
+			altair->running = 0;
+		}
+		altair->console.capture = capture;
+		return 1;
+	}
+
+	return 0;
+}
+
+int main(int argc, char** argv) {
+	ALTAIR8800* altair = altair8800_create();
+	if (altair == NULL) {
+		return 1;
+	}
+	altair->timing.multiplier = TIMING_TURBO;
+	args(altair, argc, argv, server_args);
+	if (socket_path == NULL) {
+		printf("Usage: altair-server -u<socket> -i<boot script> [altair options]\n");
+		altair8800_destroy(altair);
+		return 1;
+	}
+
+	uint64_t start = timing_now();
+	while (altair->running) {
+		altair8800_step(altair);
+	}
+	if (!altair->console.done) {
+		printf("Error: the machine stopped before the boot script ended\n");
+		altair8800_destroy(altair);
+		return 1;
+	}
+	printf("READY\t-> %.3fs, %llu instructions\n", (timing_now() - start) / 1000000.0, (unsigned long long)altair->instructions);
+
+	server_run(altair, socket_path, time_limit);
+	altair8800_destroy(altair);
+	return 1;
+}
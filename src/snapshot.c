@@ -0,0 +1,482 @@
+/* snapshot.c
+ * Machine save states
+ * Github: https:\\github.com\tommojphillips
+ */
+
+ /* SNAPSHOT FILE (little endian)
+
+	0x0000	header and state, zero padded to SNAPSHOT_MEMORY_OFFSET
+			magic         char[4]  "A88S"
+			version       u16
+			state size    u16      bytes of state that follow the header
+			memory offset u32
+			memory size   u32
+
+			CPU           registers[8], pc u16, sp u16, flags c p ac z s interrupt halt (u8 each), cycles u32,
+			              machine clock u64 (cycles before the current frame)
+			MEMORY        ram_size u32, page type[256] (0 unmapped, 1 RAM, 2 ROM), front panel switches u8
+			BANK          count u8, size u32, port u8, selected u8
+			SIO           port A: status, control, output_interrupt, input_interrupt, ch, base (u8 each)
+			              port B: status, control, output_interrupt, input_interrupt, ch (u8 each)
+			DCDD          selector i8, then for each of the 16 disks:
+			                mounted u8; if mounted: status u8, sector u8, track u8, index u32,
+			                image hash u64 (FNV-1a), path length u16, path
+
+	0x1000	memory image (64K); bank 0 and common memory
+	0x11000	banks 1 to count - 1, size bytes each
+
+	Disks are referenced, not stored. Dirty sectors are flushed before saving, and on load each
+	referenced image is mounted (unless it already is) and must hash to the saved value, so the
+	guest never sees a disk that disagrees with what it has cached in memory. Nothing is applied
+	until every record has been checked; a failed load unloads the disks it mounted.
+
+	Pending device events are not stored; devices post them again from their state. With -frotate the
+	disk position follows the restored machine clock.
+
+	Engines and host state (timing, idle detection, console) are not saved.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "snapshot.h"
+#include "altair8800.h"
+#include "88_dcdd.h"
+#include "88_sio.h"
+#include "dcdd_hostdir.h"
+#include "bank.h"
+#include "memmap.h"
+#include "jit.h"
+#include "file.h"
+
+#define PAGE_TYPE_UNMAPPED 0
+#define PAGE_TYPE_RAM      1
+#define PAGE_TYPE_ROM      2
+
+#define HEADER_SIZE        16
+
+typedef struct {
+	uint8_t* buffer;
+	uint32_t pos;
+	uint32_t size;
+	int error; // read or write past the end
+} STREAM;
+
+typedef struct {
+	uint8_t saved;   // the drive had a disk when the snapshot was taken
+	uint8_t status;
+	uint8_t sector;
+	uint8_t track;
+	uint32_t index;
+	uint64_t hash;
+	char path[SNAPSHOT_STATE_MAX];
+	int mounted;     // mounted by this load; unloaded again if the load fails
+} SNAPSHOT_DISK;
+
+static void put8(STREAM* s, uint8_t value) {
+	if (s->pos >= s->size) {
+		s->error = 1;
+		return;
+	}
+	s->buffer[s->pos++] = value;
+}
+static void put16(STREAM* s, uint16_t value) {
+	put8(s, value & 0xFF);
+	put8(s, value >> 8);
+}
+static void put32(STREAM* s, uint32_t value) {
+	put16(s, value & 0xFFFF);
+	put16(s, value >> 16);
+}
+static void put64(STREAM* s, uint64_t value) {
+	put32(s, value & 0xFFFFFFFF);
+	put32(s, value >> 32);
+}
+static void put_bytes(STREAM* s, const void* data, uint32_t size) {
+	if (s->pos + size > s->size) {
+		s->error = 1;
+		return;
+	}
+	memcpy(s->buffer + s->pos, data, size);
+	s->pos += size;
+}
+static uint8_t get8(STREAM* s) {
+	if (s->pos >= s->size) {
+		s->error = 1;
+		return 0;
+	}
+	return s->buffer[s->pos++];
+}
+static void get_bytes(STREAM* s, void* data, uint32_t size) {
+	if (s->pos + size > s->size) {
+		s->error = 1;
+		memset(data, 0, size);
+		return;
+	}
+	memcpy(data, s->buffer + s->pos, size);
+	s->pos += size;
+}
+static uint16_t get16(STREAM* s) {
+	uint16_t value = get8(s);
+	return value | (get8(s) << 8);
+}
+static uint32_t get32(STREAM* s) {
+	uint32_t value = get16(s);
+	return value | ((uint32_t)get16(s) << 16);
+}
+static uint64_t get64(STREAM* s) {
+	uint64_t value = get32(s);
+	return value | ((uint64_t)get32(s) << 32);
+}
+
+uint64_t snapshot_hash(const uint8_t* data, uint32_t size) {
+	/* FNV-1a */
+	uint64_t hash = 0xCBF29CE484222325ULL;
+	for (uint32_t i = 0; i < size; ++i) {
+		hash ^= data[i];
+		hash *= 0x100000001B3ULL;
+	}
+	return hash;
+}
+
+static void put_sio(STREAM* s, SIO* sio) {
+	put8(s, sio->status);
+	put8(s, sio->control);
+	put8(s, sio->output_interrupt);
+	put8(s, sio->input_interrupt);
+	put8(s, (uint8_t)sio->ch);
+}
+static void get_sio(STREAM* s, SIO* sio) {
+	sio->status = get8(s);
+	sio->control = get8(s);
+	sio->output_interrupt = get8(s);
+	sio->input_interrupt = get8(s);
+	sio->ch = (char)get8(s);
+	sio->rx_head = 0; // input in flight belongs to the old session
+	sio->rx_tail = 0;
+}
+
+static uint8_t page_type(PAGE* page) {
+	if (page->ptr == NULL) {
+		return PAGE_TYPE_UNMAPPED;
+	}
+	/* pages write protected by the JIT are still RAM */
+	if ((page->flags & PAGE_WRITE) || (page->flags & PAGE_MMIO)) {
+		return PAGE_TYPE_RAM;
+	}
+	return PAGE_TYPE_ROM;
+}
+
+int snapshot_save(ALTAIR8800* machine, const char* filename) {
+	uint8_t state[SNAPSHOT_MEMORY_OFFSET] = { 0 };
+	STREAM s = { state, HEADER_SIZE, SNAPSHOT_STATE_MAX, 0 };
+	I8080* cpu = &machine->cpu;
+
+	put_bytes(&s, cpu->registers, 8);
+	put16(&s, cpu->pc);
+	put16(&s, cpu->sp);
+	put8(&s, cpu->flags.c);
+	put8(&s, cpu->flags.p);
+	put8(&s, cpu->flags.ac);
+	put8(&s, cpu->flags.z);
+	put8(&s, cpu->flags.s);
+	put8(&s, cpu->flags.interrupt);
+	put8(&s, cpu->flags.halt);
+	put32(&s, cpu->cycles);
+	put64(&s, machine->sched.base);
+
+	put32(&s, machine->ram_size);
+	for (int i = 0; i < MEMMAP_PAGES; ++i) {
+		put8(&s, page_type(&machine->memmap.pages[i]));
+	}
+	put8(&s, machine->front_panel_switches);
+	put8(&s, machine->bank.count);
+	put32(&s, machine->bank.size);
+	put8(&s, machine->bank.port);
+	put8(&s, machine->bank.selected);
+
+	put_sio(&s, &machine->sio);
+	put8(&s, machine->sio.base);
+	put_sio(&s, &machine->sio_b);
+
+	put8(&s, (uint8_t)machine->dcdd.selector);
+	for (uint8_t i = 0; i < DCDD_MAX_DISKS; ++i) {
+		DISK* disk = &machine->dcdd.disks[i];
+		if (disk->buffer == NULL || disk->filename == NULL) {
+			put8(&s, 0);
+			continue;
+		}
+		dcdd_flush_disk(&machine->dcdd, i);
+		dcdd_fill_hostdir(disk);
+		uint16_t len = (uint16_t)strlen(disk->filename);
+		put8(&s, 1);
+		put8(&s, disk->status);
+		put8(&s, disk->sector);
+		put8(&s, disk->track);
+		put32(&s, disk->index);
+		put64(&s, snapshot_hash(disk->buffer, DCDD_DISK_SIZE));
+		put16(&s, len);
+		put_bytes(&s, disk->filename, len);
+	}
+
+	if (s.error) {
+		printf("Error: snapshot state is too large\n");
+		return 1;
+	}
+
+	uint32_t state_size = s.pos - HEADER_SIZE;
+	s.pos = 0;
+	put_bytes(&s, SNAPSHOT_MAGIC, 4);
+	put16(&s, SNAPSHOT_VERSION);
+	put16(&s, (uint16_t)state_size);
+	put32(&s, SNAPSHOT_MEMORY_OFFSET);
+	put32(&s, 0x10000);
+
+	FILE* file = NULL;
+	fopen_s(&file, filename, "wb");
+	if (file == NULL) {
+		printf("Error: could not open file: %s\n", filename);
+		return 1;
+	}
+	size_t banks_size = machine->bank.count > 1 ? (size_t)(machine->bank.count - 1) * machine->bank.size : 0;
+	if (fwrite(state, 1, sizeof(state), file) != sizeof(state) ||
+		fwrite(machine->memory, 1, 0x10000, file) != 0x10000 ||
+		fwrite(machine->bank.banks, 1, banks_size, file) != banks_size) {
+		printf("Error: could not write snapshot: %s\n", filename);
+		fclose(file);
+		return 1;
+	}
+	fclose(file);
+	printf("%s\t<- SNAPSHOT\n", filename);
+	return 0;
+}
+
+int snapshot_load(ALTAIR8800* machine, const char* filename) {
+	uint8_t state[SNAPSHOT_MEMORY_OFFSET];
+	STREAM s = { state, 0, sizeof(state), 0 };
+	FILE* file = NULL;
+
+	fopen_s(&file, filename, "rb");
+	if (file == NULL) {
+		printf("Error: could not open file: %s\n", filename);
+		return 1;
+	}
+	if (fread(state, 1, sizeof(state), file) != sizeof(state)) {
+		printf("Error: invalid snapshot: %s\n", filename);
+		fclose(file);
+		return 1;
+	}
+
+	if (memcmp(state, SNAPSHOT_MAGIC, 4) != 0) {
+		printf("Error: invalid snapshot: %s\n", filename);
+		fclose(file);
+		return 1;
+	}
+	s.pos = 4;
+	uint16_t version = get16(&s);
+	uint16_t state_size = get16(&s);
+	uint32_t memory_offset = get32(&s);
+	uint32_t memory_size = get32(&s);
+	if (version != SNAPSHOT_VERSION || memory_offset != SNAPSHOT_MEMORY_OFFSET || memory_size != 0x10000 ||
+		state_size > SNAPSHOT_STATE_MAX - HEADER_SIZE) {
+		printf("Error: unsupported snapshot version %u: %s\n", version, filename);
+		fclose(file);
+		return 1;
+	}
+	s.size = HEADER_SIZE + state_size;
+
+	/* read everything before touching the machine */
+	uint8_t* memory = (uint8_t*)malloc(0x10000);
+	if (memory == NULL) {
+		fclose(file);
+		return 1;
+	}
+	if (fread(memory, 1, 0x10000, file) != 0x10000) {
+		printf("Error: snapshot is truncated: %s\n", filename);
+		free(memory);
+		fclose(file);
+		return 1;
+	}
+
+	I8080 cpu = machine->cpu;
+	get_bytes(&s, cpu.registers, 8);
+	cpu.pc = get16(&s);
+	cpu.sp = get16(&s);
+	cpu.flags.c = get8(&s);
+	cpu.flags.p = get8(&s);
+	cpu.flags.ac = get8(&s);
+	cpu.flags.z = get8(&s);
+	cpu.flags.s = get8(&s);
+	cpu.flags.interrupt = get8(&s);
+	cpu.flags.halt = get8(&s);
+	cpu.cycles = get32(&s);
+	uint64_t clock = get64(&s);
+
+	uint32_t ram_size = get32(&s);
+	uint8_t pages[MEMMAP_PAGES];
+	get_bytes(&s, pages, MEMMAP_PAGES);
+	uint8_t front_panel_switches = get8(&s);
+
+	BANK bank = machine->bank;
+	bank.count = get8(&s);
+	bank.size = get32(&s);
+	bank.port = get8(&s);
+	uint8_t bank_selected = get8(&s);
+	size_t banks_size = bank.count > 1 ? (size_t)(bank.count - 1) * bank.size : 0;
+	uint8_t* banks = NULL;
+	if (!s.error && bank.count > 1) {
+		banks = (uint8_t*)malloc(banks_size);
+		if (banks == NULL || fread(banks, 1, banks_size, file) != banks_size) {
+			printf("Error: snapshot is truncated: %s\n", filename);
+			free(banks);
+			free(memory);
+			fclose(file);
+			return 1;
+		}
+	}
+	fclose(file);
+
+	SIO sio = machine->sio;
+	get_sio(&s, &sio);
+	uint8_t sio_base = get8(&s);
+	SIO sio_b = machine->sio_b;
+	get_sio(&s, &sio_b);
+
+	/* parse every disk record before mounting anything */
+	SNAPSHOT_DISK* disks = (SNAPSHOT_DISK*)calloc(DCDD_MAX_DISKS, sizeof(SNAPSHOT_DISK));
+	if (disks == NULL) {
+		free(memory);
+		free(banks);
+		return 1;
+	}
+	int8_t selector = (int8_t)get8(&s);
+	for (uint8_t i = 0; i < DCDD_MAX_DISKS && !s.error; ++i) {
+		SNAPSHOT_DISK* d = &disks[i];
+		d->saved = get8(&s);
+		if (d->saved == 0) {
+			continue;
+		}
+		d->status = get8(&s);
+		d->sector = get8(&s);
+		d->track = get8(&s);
+		d->index = get32(&s);
+		d->hash = get64(&s);
+		uint16_t len = get16(&s);
+		get_bytes(&s, d->path, len < sizeof(d->path) ? len : sizeof(d->path) - 1);
+	}
+	if (s.error) {
+		printf("Error: snapshot is truncated: %s\n", filename);
+		free(disks);
+		free(memory);
+		free(banks);
+		return 1;
+	}
+
+	/* mount and check every disk; on failure unload the ones mounted here so the machine is left as it was */
+	int failed = 0;
+	for (uint8_t i = 0; i < DCDD_MAX_DISKS && !failed; ++i) {
+		SNAPSHOT_DISK* d = &disks[i];
+		DISK* disk = &machine->dcdd.disks[i];
+		if (d->saved == 0) {
+			continue;
+		}
+
+		/* a disk mounted on the command line takes the place of the saved path */
+		if (disk->buffer == NULL) {
+			if (dcdd_load_disk(&machine->dcdd, i, d->path) != 0) {
+				failed = 1;
+				break;
+			}
+			d->mounted = 1;
+		}
+		dcdd_fill_hostdir(disk);
+		if (snapshot_hash(disk->buffer, DCDD_DISK_SIZE) != d->hash) {
+			printf("Error: %c: %s does not match the snapshot\n", 'A' + i, disk->filename);
+			failed = 1;
+		}
+	}
+	if (!failed && bank.count > 1 && (bank.count != machine->bank.count || bank.size != machine->bank.size) &&
+		bank_init(&machine->bank, &machine->memmap, machine->memory, bank.count, bank.size) != 0) {
+		failed = 1;
+	}
+	if (failed) {
+		for (uint8_t i = 0; i < DCDD_MAX_DISKS; ++i) {
+			if (disks[i].mounted) {
+				dcdd_unload_disk(&machine->dcdd, i);
+			}
+		}
+		free(disks);
+		free(memory);
+		free(banks);
+		return 1;
+	}
+	for (uint8_t i = 0; i < DCDD_MAX_DISKS; ++i) {
+		SNAPSHOT_DISK* d = &disks[i];
+		DISK* disk = &machine->dcdd.disks[i];
+		if (d->saved == 0) {
+			continue;
+		}
+		if (d->mounted) {
+			printf("%c:\t-> %s\n", 'A' + i, d->path);
+		}
+		disk->status = d->status;
+		disk->sector = d->sector;
+		disk->track = d->track;
+		disk->index = d->index;
+	}
+	free(disks);
+
+	/* translated code is stale; remapping bumps every page generation */
+	if (machine->engine == ENGINE_JIT) {
+		jit_flush(&machine->jit);
+	}
+	memcpy(machine->memory, memory, 0x10000);
+	free(memory);
+	machine->ram_size = ram_size;
+	for (int i = 0; i < MEMMAP_PAGES; ++i) {
+		uint16_t address = (uint16_t)(i * MEMMAP_PAGE_SIZE);
+		switch (pages[i]) {
+			case PAGE_TYPE_RAM:
+				memmap_map(&machine->memmap, address, MEMMAP_PAGE_SIZE, machine->memory + address, PAGE_RAM);
+				break;
+			case PAGE_TYPE_ROM:
+				memmap_map(&machine->memmap, address, MEMMAP_PAGE_SIZE, machine->memory + address, PAGE_ROM);
+				break;
+			default:
+				memmap_unmap(&machine->memmap, address, MEMMAP_PAGE_SIZE);
+				break;
+		}
+	}
+	machine->front_panel_switches = front_panel_switches;
+	if (bank.count > 1) {
+		/* every page now shows bank 0 */
+		machine->bank.selected = 0;
+		memcpy(machine->bank.banks, banks, banks_size);
+		if (machine->bank.io == NULL || machine->bank.port != bank.port) {
+			bank_register_io(&machine->bank, &machine->io, bank.port);
+		}
+		bank_select(&machine->bank, bank_selected);
+	}
+	free(banks);
+
+	machine->cpu = cpu;
+	machine->sio = sio;
+	machine->sio_b = sio_b;
+	if (sio_base != machine->sio.base) {
+		altair8800_map_sio(machine, sio_base);
+	}
+	machine->dcdd.selector = selector;
+	idle_init(&machine->idle);
+
+	sched_clear(&machine->sched);
+	machine->sched.base = clock;
+	sched_irq(&machine->sched, machine->sio.irq_source, sio_irq(&machine->sio));
+	sched_irq(&machine->sched, machine->sio_b.irq_source, sio_irq(&machine->sio_b));
+	machine->dcdd.pulse = 0;
+	dcdd_schedule(&machine->dcdd);
+
+	printf("%s\t-> SNAPSHOT\n", filename);
+	return 0;
+}
@@ -0,0 +1,22 @@
+/* snapshot.h
+ * Machine save states
+ * Github: https:\\github.com\tommojphillips
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+
+#include "altair8800.h"
+
+#define SNAPSHOT_MAGIC          "A88S"
+#define SNAPSHOT_VERSION        4
+#define SNAPSHOT_MEMORY_OFFSET  0x1000  // memory image is page aligned so it can be mapped directly
+#define SNAPSHOT_STATE_MAX      0x1000  // header and device state
+
+int snapshot_save(ALTAIR8800* machine, const char* filename);
+int snapshot_load(ALTAIR8800* machine, const char* filename);
+uint64_t snapshot_hash(const uint8_t* data, uint32_t size);
+
+#endif
@@ -0,0 +1,126 @@
+/* timing.c
+ * Wall-clock pacing
+ * Github: https:\\github.com\tommojphillips
+ */
+
+ /* Each frame the machine reports how many cycles it ran. In accurate and multiplier modes the
+  * deadline for those cycles is computed from the start of the pacing period, not the previous frame,
+  * so rounding and oversleeping do not accumulate into drift. If the host falls too far behind
+  * (debugger break, suspended console) the period is restarted instead of running flat out to catch up.
+  *
+  * Host devices are polled on wall-clock time at TIMING_POLL_RATE, so keyboard polling does
+  * not speed up in turbo mode or slow down when the cpu is throttled.
+  */
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 199309L
+#endif
+
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "timing.h"
+
+#define TIMING_MAX_LAG 100000 // us behind before the pacing period is restarted
+
+uint64_t timing_now() {
+#ifdef _WIN32
+	static LARGE_INTEGER frequency = { 0 };
+	LARGE_INTEGER counter;
+	if (frequency.QuadPart == 0) {
+		QueryPerformanceFrequency(&frequency);
+	}
+	QueryPerformanceCounter(&counter);
+	return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000 +
+		(uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000 / frequency.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+void timing_sleep(uint64_t us) {
+#ifdef _WIN32
+	Sleep((DWORD)(us / 1000));
+#else
+	struct timespec ts;
+	ts.tv_sec = us / 1000000;
+	ts.tv_nsec = (us % 1000000) * 1000;
+	nanosleep(&ts, NULL);
+#endif
+}
+
+void timing_init(TIMING* timing, uint32_t clock, uint32_t multiplier) {
+	timing->multiplier = multiplier;
+	timing->clock = clock;
+	timing->start = timing_now();
+	timing->cycles = 0;
+	timing->last_poll = timing->start;
+	timing->total_start = timing->start;
+	timing->total_cycles = 0;
+	timing->frames = 0;
+	timing->overruns = 0;
+}
+int timing_poll(TIMING* timing) {
+	uint64_t now = timing_now();
+	if (now - timing->last_poll >= 1000000 / TIMING_POLL_RATE) {
+		timing->last_poll = now;
+		return 1;
+	}
+	return 0;
+}
+uint32_t timing_until_poll(TIMING* timing) {
+	uint64_t elapsed = timing_now() - timing->last_poll;
+	if (elapsed >= 1000000 / TIMING_POLL_RATE) {
+		return 0;
+	}
+	return (uint32_t)(1000000 / TIMING_POLL_RATE - elapsed);
+}
+void timing_frame(TIMING* timing, uint32_t cycles) {
+	uint64_t delay = timing_frame_delay(timing, cycles);
+	if (delay != 0) {
+		timing_sleep(delay);
+	}
+}
+uint64_t timing_frame_delay(TIMING* timing, uint32_t cycles) {
+	/* account for a frame; returns how long to wait (us) before the next one */
+	timing->total_cycles += cycles;
+	timing->frames++;
+	if (timing->multiplier == TIMING_TURBO) {
+		return 0;
+	}
+
+	timing->cycles += cycles;
+	uint64_t deadline = timing->start + timing->cycles * 1000000 / ((uint64_t)timing->clock * timing->multiplier);
+	uint64_t now = timing_now();
+	if (now < deadline) {
+		return deadline - now;
+	}
+	if (now > deadline) {
+		timing->overruns++;
+	}
+	if (now - deadline > TIMING_MAX_LAG) {
+		timing->start = now;
+		timing->cycles = 0;
+	}
+	return 0;
+}
+void timing_frame_unthrottled(TIMING* timing, uint32_t cycles) {
+	/* account for a frame that may run ahead of the clock; pacing restarts from now */
+	timing->total_cycles += cycles;
+	timing->frames++;
+	timing->start = timing_now();
+	timing->cycles = 0;
+}
+double timing_mhz(TIMING* timing) {
+	uint64_t elapsed = timing_now() - timing->total_start;
+	if (elapsed == 0) {
+		return 0.0;
+	}
+	return (double)timing->total_cycles / (double)elapsed;
+}
@@ -0,0 +1,40 @@
+/* timing.h
+ * Wall-clock pacing
+ * Github: https:\\github.com\tommojphillips
+ */
+
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdint.h>
+
+#define TIMING_TURBO     0 // run as fast as possible
+#define TIMING_ACCURATE  1 // run at CPU_CLOCK
+                           // anything else runs at CPU_CLOCK * multiplier
+
+#define TIMING_POLL_RATE 60 // host device polls per second
+
+typedef struct {
+	uint32_t multiplier;    // speed multiplier; TIMING_TURBO, TIMING_ACCURATE or N
+	uint32_t clock;         // emulated cpu clock in Hz
+	uint64_t start;         // host time the current pacing period started (us)
+	uint64_t cycles;        // cycles emulated since start
+	uint64_t last_poll;     // host time of the last device poll (us)
+	uint64_t total_start;   // host time timing_init was called (us)
+	uint64_t total_cycles;  // cycles emulated since timing_init
+	uint64_t frames;        // frames accounted since timing_init
+	uint64_t overruns;      // paced frames that finished after their deadline
+} TIMING;
+
+void timing_init(TIMING* timing, uint32_t clock, uint32_t multiplier);
+int timing_poll(TIMING* timing);
+uint32_t timing_until_poll(TIMING* timing);
+void timing_frame(TIMING* timing, uint32_t cycles);
+uint64_t timing_frame_delay(TIMING* timing, uint32_t cycles);
+void timing_frame_unthrottled(TIMING* timing, uint32_t cycles);
+double timing_mhz(TIMING* timing);
+
+uint64_t timing_now();
+void timing_sleep(uint64_t us);
+
+#endif
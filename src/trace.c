@@ -0,0 +1,153 @@
+/* trace.c
+ * Execution trace - fixed size ring of binary records
+ * Github: https:\\github.com\tommojphillips
+ */
+
+ /* The ring holds the last N records: every instruction, memory write and port access.
+	When it is full the oldest records are overwritten. Nothing is allocated or
+	recorded unless tracing is on; the machine only tests trace_enabled() per instruction.
+
+	FILE
+		+-------+-------------+-------------+------------+-----------------+
+		| MAGIC | VERSION (4) | RECORD SIZE | COUNT (8)  | RECORDS ...     |
+		| A88T  |             | (4)         |            | oldest first    |
+		+-------+-------------+-------------+------------+-----------------+
+
+	All fields are little endian. COUNT is the number of records in the file.
+	Each record is TRACE_RECORD packed field by field into RECORD SIZE bytes (trace_pack),
+	so the file reads the same on any host; decode them with altair-trace.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+#include "i8080.h"
+#include "memmap.h"
+#include "file.h"
+
+int trace_init(TRACE* trace) {
+	/* round up to a power of two */
+	uint32_t size = trace->size != 0 ? trace->size : TRACE_RECORDS;
+	uint32_t ring = 1;
+	while (ring < size && ring < 0x80000000) {
+		ring <<= 1;
+	}
+	trace->records = (TRACE_RECORD*)calloc(ring, sizeof(TRACE_RECORD));
+	if (trace->records == NULL) {
+		printf("Error: could not allocate the trace ring (%u records)\n", ring);
+		return 1;
+	}
+	trace->mask = ring - 1;
+	trace->count = 0;
+	trace->dumped = 0;
+	return 0;
+}
+void trace_destroy(TRACE* trace) {
+	if (trace->records != NULL) {
+		free(trace->records);
+		trace->records = NULL;
+	}
+}
+
+static void put32(uint8_t* p, uint32_t value) {
+	for (int i = 0; i < 4; ++i) {
+		p[i] = (value >> (i * 8)) & 0xFF;
+	}
+}
+
+void trace_pack(const TRACE_RECORD* record, uint8_t* p) {
+	p[0] = record->type;
+	p[1] = record->opcode;
+	p[2] = record->address & 0xFF;
+	p[3] = record->address >> 8;
+	memcpy(p + 4, record->operand, 2);
+	memcpy(p + 6, record->registers, 8);
+	p[14] = record->sp & 0xFF;
+	p[15] = record->sp >> 8;
+}
+void trace_unpack(TRACE_RECORD* record, const uint8_t* p) {
+	record->type = p[0];
+	record->opcode = p[1];
+	record->address = p[2] | (p[3] << 8);
+	memcpy(record->operand, p + 4, 2);
+	memcpy(record->registers, p + 6, 8);
+	record->sp = p[14] | (p[15] << 8);
+}
+
+static int write_records(FILE* file, const TRACE_RECORD* records, uint64_t count) {
+	/* pack a chunk at a time; the ring can be large */
+	uint8_t buffer[256 * TRACE_RECORD_SIZE];
+	while (count != 0) {
+		uint32_t n = count < 256 ? (uint32_t)count : 256;
+		for (uint32_t i = 0; i < n; ++i) {
+			trace_pack(&records[i], buffer + i * TRACE_RECORD_SIZE);
+		}
+		if (fwrite(buffer, TRACE_RECORD_SIZE, n, file) != n) {
+			return 1;
+		}
+		records += n;
+		count -= n;
+	}
+	return 0;
+}
+
+int trace_dump(TRACE* trace, const char* filename) {
+	if (trace->records == NULL) {
+		return 1;
+	}
+
+	FILE* file = NULL;
+	fopen_s(&file, filename, "wb");
+	if (file == NULL) {
+		printf("Error: could not open file: %s\n", filename);
+		return 1;
+	}
+
+	uint64_t size = (uint64_t)trace->mask + 1;
+	uint64_t count = trace->count < size ? trace->count : size;
+	uint64_t first = trace->count - count;
+
+	uint8_t header[20];
+	memcpy(header, TRACE_MAGIC, 4);
+	put32(header + 4, TRACE_VERSION);
+	put32(header + 8, TRACE_RECORD_SIZE);
+	put32(header + 12, count & 0xFFFFFFFF);
+	put32(header + 16, count >> 32);
+	int error = fwrite(header, 1, sizeof(header), file) != sizeof(header);
+
+	/* oldest first; the ring wraps at most once */
+	uint32_t start = first & trace->mask;
+	uint64_t tail = size - start < count ? size - start : count;
+	error |= write_records(file, &trace->records[start], tail);
+	error |= write_records(file, &trace->records[0], count - tail);
+	error |= fflush(file) != 0;
+	fclose(file);
+	if (error) {
+		printf("Error: could not write file: %s\n", filename);
+		return 1;
+	}
+	printf("%s\t<- TRACE ( %llu records )\n", filename, (unsigned long long)count);
+	return 0;
+}
+
+static uint8_t peek(MEMMAP* map, uint16_t address) {
+	/* never touch MMIO handlers from the tracer */
+	uint8_t* ptr = memmap_ptr(map, address);
+	return ptr != NULL ? *ptr : 0xFF;
+}
+
+void trace_instruction(TRACE* trace, I8080* cpu, MEMMAP* map) {
+	TRACE_RECORD* record = &trace->records[trace->count++ & trace->mask];
+	uint16_t pc = cpu->pc;
+	record->type = TRACE_INSTRUCTION;
+	record->opcode = peek(map, pc);
+	record->address = pc;
+	record->operand[0] = peek(map, (uint16_t)(pc + 1));
+	record->operand[1] = peek(map, (uint16_t)(pc + 2));
+	memcpy(record->registers, cpu->registers, 8);
+	record->registers[6] = (cpu->flags.s << 7) | (cpu->flags.z << 6) | (cpu->flags.ac << 4) | (cpu->flags.p << 2) | 0x02 | cpu->flags.c;
+	record->sp = cpu->sp;
+}
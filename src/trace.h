@@ -0,0 +1,61 @@
+/* trace.h
+ * Execution trace - fixed size ring of binary records
+ * Github: https:\\github.com\tommojphillips
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+#include "i8080.h"
+#include "memmap.h"
+
+#define TRACE_MAGIC          "A88T"
+#define TRACE_VERSION        1
+#define TRACE_RECORDS        0x400000 // default ring size in records (64 MB)
+#define TRACE_NO_TRIGGER     -1
+#define TRACE_RECORD_SIZE    16       // bytes per record in the file
+
+#define TRACE_INSTRUCTION    'X' // about to execute; registers before the instruction
+#define TRACE_WRITE          'W' // memory write; address, value
+#define TRACE_IN             'I' // port read; port, value
+#define TRACE_OUT            'O' // port write; port, value
+
+/* one record; written to the file as TRACE_RECORD_SIZE bytes in field order, little endian */
+typedef struct {
+	uint8_t type;        // TRACE_*
+	uint8_t opcode;      // INSTRUCTION: opcode; WRITE, IN, OUT: value
+	uint16_t address;    // INSTRUCTION: pc; WRITE: address; IN, OUT: port
+	uint8_t operand[2];  // INSTRUCTION: the bytes after the opcode
+	uint8_t registers[8]; // INSTRUCTION: B C D E H L PSW A
+	uint16_t sp;         // INSTRUCTION: sp
+} TRACE_RECORD;
+
+typedef struct {
+	TRACE_RECORD* records; // ring, or NULL when tracing is off
+	uint32_t mask;         // ring size - 1; the size is a power of two
+	uint32_t size;         // requested ring size in records, or 0 for TRACE_RECORDS
+	uint64_t count;        // records written since tracing started
+	const char* filename;  // dumped here on exit
+	int32_t trigger;       // pc that dumps the ring, or TRACE_NO_TRIGGER
+	int dumped;            // the trigger fired; the exit dump is skipped
+} TRACE;
+
+int trace_init(TRACE* trace);
+void trace_destroy(TRACE* trace);
+int trace_dump(TRACE* trace, const char* filename);
+void trace_instruction(TRACE* trace, I8080* cpu, MEMMAP* map);
+void trace_pack(const TRACE_RECORD* record, uint8_t* p);
+void trace_unpack(TRACE_RECORD* record, const uint8_t* p);
+
+#define trace_enabled(trace) ((trace)->records != NULL)
+
+static inline void trace_event(TRACE* trace, uint8_t type, uint16_t address, uint8_t value) {
+	TRACE_RECORD* record = &trace->records[trace->count++ & trace->mask];
+	record->type = type;
+	record->opcode = value;
+	record->address = address;
+}
+
+#endif
@@ -0,0 +1,144 @@
+/* trace_main.c
+ * Decode a trace dump
+ * Github: https:\\github.com\tommojphillips
+ */
+
+ /* Prints a trace file written by -x, a script trace command or a trigger pc, oldest first:
+
+	0100  C3 00 01  JMP 0100        A=00 B=00 C=00 D=00 E=00 H=00 L=00 F=02 SP=0000
+	                W 2000 <- 41
+	                OUT 10 <- 41
+	                IN  10 -> 02
+
+	Usage: altair-trace [-t<records>] <trace file>
+		-t<records>  only print the last <records> records
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "i8080.h"
+#include "i8080_mnem.h"
+#include "cpu_ops.h"
+#include "trace.h"
+#include "file.h"
+
+/* the disassembler reads through the cpu bus; serve it the recorded bytes */
+static uint16_t decode_pc;
+static uint8_t decode_bytes[3];
+
+static uint8_t decode_read(uint16_t address) {
+	uint16_t offset = (uint16_t)(address - decode_pc);
+	return offset < 3 ? decode_bytes[offset] : 0x00;
+}
+static void decode_write(uint16_t address, uint8_t value) {
+
+}
+
+static uint32_t get32(const uint8_t* p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void print_record(I8080* cpu, const TRACE_RECORD* record) {
+	switch (record->type) {
+		case TRACE_INSTRUCTION: {
+			char mnem[64] = { 0 };
+			uint8_t length = cpu_ops[record->opcode].length;
+			decode_pc = record->address;
+			decode_bytes[0] = record->opcode;
+			decode_bytes[1] = record->operand[0];
+			decode_bytes[2] = record->operand[1];
+			cpu->pc = record->address;
+			i8080_mnem(cpu, mnem);
+
+			char bytes[12] = { 0 };
+			for (uint8_t i = 0; i < 3; ++i) {
+				if (i < length) {
+					sprintf(bytes + i * 3, "%02X ", decode_bytes[i]);
+				}
+				else {
+					strcat(bytes, "   ");
+				}
+			}
+			const uint8_t* r = record->registers;
+			printf("%04X  %s %-14s  A=%02X B=%02X C=%02X D=%02X E=%02X H=%02X L=%02X F=%02X SP=%04X\n",
+				record->address, bytes, mnem,
+				r[REG_A], r[REG_B], r[REG_C], r[REG_D], r[REG_E], r[REG_H], r[REG_L], r[6], record->sp);
+		} break;
+		case TRACE_WRITE:
+			printf("                W %04X <- %02X\n", record->address, record->opcode);
+			break;
+		case TRACE_OUT:
+			printf("                OUT %02X <- %02X\n", record->address, record->opcode);
+			break;
+		case TRACE_IN:
+			printf("                IN  %02X -> %02X\n", record->address, record->opcode);
+			break;
+		default:
+			printf("                ? %02X\n", record->type);
+			break;
+	}
+}
+
+int main(int argc, char** argv) {
+	const char* filename = NULL;
+	uint64_t last = 0;
+	for (int i = 1; i < argc; ++i) {
+		if (strncmp("-t", argv[i], 2) == 0) {
+			last = strtoull(argv[i] + 2, NULL, 10);
+		}
+		else {
+			filename = argv[i];
+		}
+	}
+	if (filename == NULL) {
+		printf("Usage: altair-trace [-t<records>] <trace file>\n");
+		return 1;
+	}
+
+	FILE* file = NULL;
+	fopen_s(&file, filename, "rb");
+	if (file == NULL) {
+		printf("Error: could not open file: %s\n", filename);
+		return 1;
+	}
+
+	uint8_t header[20];
+	if (fread(header, 1, sizeof(header), file) != sizeof(header) || memcmp(header, TRACE_MAGIC, 4) != 0) {
+		printf("Error: %s is not a trace file\n", filename);
+		fclose(file);
+		return 1;
+	}
+	if (get32(header + 4) != TRACE_VERSION || get32(header + 8) != TRACE_RECORD_SIZE) {
+		printf("Error: %s is trace version %u; expected %u\n", filename, get32(header + 4), TRACE_VERSION);
+		fclose(file);
+		return 1;
+	}
+	uint64_t count = get32(header + 12) | ((uint64_t)get32(header + 16) << 32);
+	if (last != 0 && last < count) {
+		fseek(file, (long)((count - last) * TRACE_RECORD_SIZE), SEEK_CUR);
+		count = last;
+	}
+
+	I8080 cpu;
+	memset(&cpu, 0, sizeof(cpu));
+	cpu.read_byte = decode_read;
+	cpu.write_byte = decode_write;
+
+	TRACE_RECORD record;
+	uint8_t packed[TRACE_RECORD_SIZE];
+	uint64_t read = 0;
+	while (read < count && fread(packed, sizeof(packed), 1, file) == 1) {
+		trace_unpack(&record, packed);
+		print_record(&cpu, &record);
+		++read;
+	}
+	fclose(file);
+	if (read < count) {
+		printf("Error: %s is truncated; %llu of %llu records\n", filename, (unsigned long long)read, (unsigned long long)count);
+		return 1;
+	}
+	return 0;
+}